@@ -0,0 +1,129 @@
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_BLOCK_SIZE (1 << 20)
+#define ARENA_ALIGN 16
+
+/**
+ * Helper function to round a size up to the arena alignment.
+ */
+static size_t alignUp(size_t size) {
+    return (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+/**
+ * Helper function to add a slab of at least the given size to the arena.
+ * @return Pointer to the new slab, or NULL if memory allocation fails.
+ */
+static arena_block_t *addBlock(arena_t *arena, size_t size) {
+    size_t header = alignUp(sizeof(arena_block_t));
+    arena_block_t *block = (arena_block_t *)malloc(header + size);
+    if (block == NULL) {
+        return NULL;
+    }
+
+    block->next = arena->blocks;
+    block->size = size;
+    block->used = 0;
+    arena->blocks = block;
+    arena->totalBytes += header + size;
+    return block;
+}
+
+/**
+ * Creates an empty arena.
+ */
+arena_t *createArena(size_t sizeHint) {
+    arena_t *arena = (arena_t *)malloc(sizeof(arena_t));
+    if (arena == NULL) {
+        return NULL;
+    }
+
+    arena->blocks = NULL;
+    arena->blockSize = sizeHint > 0 ? alignUp(sizeHint) : DEFAULT_BLOCK_SIZE;
+    arena->totalBytes = 0;
+    return arena;
+}
+
+/**
+ * Frees every slab of the arena.
+ */
+void freeArena(arena_t *arena) {
+    if (arena == NULL) {
+        return;
+    }
+
+    arena_block_t *block = arena->blocks;
+    while (block != NULL) {
+        arena_block_t *next = block->next;
+        free(block);
+        block = next;
+    }
+    free(arena);
+}
+
+/**
+ * Helper function to carve size bytes with the given alignment (a power of two).
+ */
+static void *carve(arena_t *arena, size_t size, size_t align) {
+    size_t header = alignUp(sizeof(arena_block_t));
+    arena_block_t *block = arena->blocks;
+
+    if (block != NULL) {
+        size_t start = (block->used + align - 1) & ~(align - 1);
+        if (start <= block->size && block->size - start >= size) {
+            block->used = start + size;
+            return (char *)block + header + start;
+        }
+    }
+
+    if (size > arena->blockSize / 4 && block != NULL) {
+        //Large requests get a slab of their own behind the current one
+        arena_block_t *own = addBlock(arena, size);
+        if (own == NULL) {
+            return NULL;
+        }
+        arena->blocks = block;
+        own->next = block->next;
+        block->next = own;
+        own->used = size;
+        return (char *)own + header;
+    }
+
+    block = addBlock(arena, size > arena->blockSize ? size : arena->blockSize);
+    if (block == NULL) {
+        return NULL;
+    }
+    block->used = size;
+    return (char *)block + header;
+}
+
+/**
+ * Allocates memory from the arena.
+ */
+void *arenaAlloc(arena_t *arena, size_t size) {
+    if (arena == NULL) {
+        return NULL;
+    }
+    return carve(arena, size > 0 ? size : 1, ARENA_ALIGN);
+}
+
+/**
+ * Copies a string into the arena. Strings need no alignment, so they
+ * are packed back to back.
+ */
+char *arenaStrndup(arena_t *arena, const char *str, size_t len) {
+    if (arena == NULL) {
+        return NULL;
+    }
+
+    char *copy = (char *)carve(arena, len + 1, 1);
+    if (copy == NULL) {
+        return NULL;
+    }
+
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    return copy;
+}
@@ -0,0 +1,52 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+//One slab of memory handed out front to back
+typedef struct arena_block arena_block_t;
+struct arena_block {
+    arena_block_t *next;
+    size_t size;
+    size_t used;
+};
+
+//Bump allocator made of a list of slabs
+typedef struct {
+    arena_block_t *blocks;
+    size_t blockSize;
+    size_t totalBytes;
+} arena_t;
+
+/**
+ * Creates an empty arena and returns a pointer to it.
+ * @param sizeHint Size in bytes of each slab (0 picks a default).
+ * @return Pointer to the arena, or NULL if memory allocation fails.
+ * Memory is handed out from large slabs, and a new slab is added when
+ * the current one is full. Allocations cannot be freed one at a time;
+ * everything is released at once by freeArena().
+ */
+arena_t* createArena(size_t sizeHint);
+
+/**
+ * Frees every slab of the arena and the arena itself.
+ * If the pointer is NULL, the function does nothing.
+ */
+void freeArena(arena_t* arena);
+
+/**
+ * Allocates memory from the arena.
+ * @param arena Pointer to the arena.
+ * @param size Number of bytes.
+ * @return Pointer to memory suitably aligned for any type, or NULL on failure.
+ */
+void* arenaAlloc(arena_t* arena, size_t size);
+
+/**
+ * Copies the first len characters of a string into the arena
+ * and adds a terminating null character.
+ * @return Pointer to the copy, or NULL on failure.
+ */
+char* arenaStrndup(arena_t* arena, const char* str, size_t len);
+
+#endif // ARENA_H
@@ -0,0 +1,887 @@
+#include "ch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define BYTE_ORDER_TAG 0x01020304u
+// Nodes a witness search may settle before giving up (and adding the shortcut)
+#define WITNESS_SETTLE_LIMIT 500
+// Lower limit for the searches that only estimate a node's priority
+#define ESTIMATE_SETTLE_LIMIT 50
+
+// Section numbers in ch_header_t.offsets
+enum {
+    SEC_RANK,
+    SEC_UP_OFFSETS,
+    SEC_UP_TARGETS,
+    SEC_UP_WEIGHTS,
+    SEC_DOWN_OFFSETS,
+    SEC_DOWN_SOURCES,
+    SEC_DOWN_WEIGHTS
+};
+
+//One edge of the graph being contracted
+typedef struct {
+    int node;
+    double weight;
+} ch_arc_t;
+
+//Growable list of the edges into or out of one node
+typedef struct {
+    ch_arc_t *arcs;
+    int count;
+    int space;
+} arc_list_t;
+
+//Entry of the witness search heap; stale entries are skipped when popped
+typedef struct {
+    double key;
+    int node;
+} witness_entry_t;
+
+//State of one contraction run
+typedef struct {
+    int nodeCount;
+    arc_list_t *out;
+    arc_list_t *in;
+    unsigned char *contracted;
+    int *deleted;
+    int *level;
+    int *edgeDiff;
+    int shortcutCount;
+
+    //Size of the remaining graph, for the witness hop limit
+    long arcCount;
+    int remaining;
+
+    //Witness search scratch, reset through touched[]; hops[] is the
+    //number of edges on the path dist[] was found by
+    double *dist;
+    int *hops;
+    int *targetMark;
+    int searchCount;
+    int *touched;
+    int touchedCount;
+    witness_entry_t *heap;
+    int heapCount;
+    int heapSpace;
+
+    //Indexed min-heap of uncontracted nodes by priority, ties by index
+    int *priority;
+    int *queue;
+    int *queuePos;
+    int queueCount;
+} contractor_t;
+
+/**
+ * Helper function to compute the 64-bit FNV-1a checksum of a buffer,
+ * continuing from a previous value.
+ */
+static uint64_t checksum(uint64_t h, const void *data, size_t len) {
+    const unsigned char *buf = (const unsigned char *)data;
+    for (size_t i = 0; i < len; i++) {
+        h ^= buf[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+/**
+ * Helper function to fingerprint the parts of a snapshot a hierarchy depends on.
+ */
+static uint64_t graphHash(frozen_graph_t *frozen) {
+    uint64_t h = 14695981039346656037ull;
+    h = checksum(h, &frozen->nodeCount, sizeof(int));
+    h = checksum(h, &frozen->edgeCount, sizeof(int));
+    h = checksum(h, frozen->ids, sizeof(int) * frozen->nodeCount);
+    h = checksum(h, frozen->rowOffsets, sizeof(int) * (frozen->nodeCount + 1));
+    h = checksum(h, frozen->colIndices, sizeof(int) * frozen->edgeCount);
+    h = checksum(h, frozen->weights, sizeof(float) * frozen->edgeCount);
+    return h;
+}
+
+/**
+ * Helper function to round a file offset up to 8 bytes.
+ */
+static uint64_t align8(uint64_t offset) {
+    return (offset + 7) & ~(uint64_t)7;
+}
+
+/**
+ * Helper function to fill in the section offsets of a header.
+ * @return The total file size.
+ */
+static uint64_t layoutSections(ch_header_t *header, uint64_t sizes[CH_SECTIONS]) {
+    uint64_t n = (uint64_t)header->nodeCount;
+
+    sizes[SEC_RANK] = n * sizeof(int32_t);
+    sizes[SEC_UP_OFFSETS] = (n + 1) * sizeof(int32_t);
+    sizes[SEC_UP_TARGETS] = (uint64_t)header->upCount * sizeof(int32_t);
+    sizes[SEC_UP_WEIGHTS] = (uint64_t)header->upCount * sizeof(double);
+    sizes[SEC_DOWN_OFFSETS] = (n + 1) * sizeof(int32_t);
+    sizes[SEC_DOWN_SOURCES] = (uint64_t)header->downCount * sizeof(int32_t);
+    sizes[SEC_DOWN_WEIGHTS] = (uint64_t)header->downCount * sizeof(double);
+
+    uint64_t offset = align8(sizeof(ch_header_t));
+    for (int i = 0; i < CH_SECTIONS; i++) {
+        header->offsets[i] = offset;
+        offset = align8(offset + sizes[i]);
+    }
+    return offset;
+}
+
+// --- Contraction ---
+
+/**
+ * Helper function to append an edge to a list.
+ * @return 1 on success, 0 if memory allocation fails.
+ */
+static int appendArc(arc_list_t *list, int node, double weight) {
+    if (list->count == list->space) {
+        int newSpace = list->space == 0 ? 4 : list->space * 2;
+        ch_arc_t *newArcs = (ch_arc_t *)realloc(list->arcs, sizeof(ch_arc_t) * newSpace);
+        if (newArcs == NULL) {
+            return 0;
+        }
+        list->arcs = newArcs;
+        list->space = newSpace;
+    }
+    list->arcs[list->count].node = node;
+    list->arcs[list->count].weight = weight;
+    list->count++;
+    return 1;
+}
+
+/**
+ * Helper function to remove the edge to or from a node by moving the
+ * last edge into its place.
+ */
+static void dropArc(arc_list_t *list, int node) {
+    for (int i = 0; i < list->count; i++) {
+        if (list->arcs[i].node == node) {
+            list->arcs[i] = list->arcs[--list->count];
+            return;
+        }
+    }
+}
+
+/**
+ * Helper function to add the edge from -> to, or lower its weight if it
+ * is already there.
+ * @return 1 on success, 0 if memory allocation fails.
+ */
+static int addOrLowerArc(contractor_t *c, int from, int to, double weight) {
+    arc_list_t *out = &c->out[from];
+    for (int i = 0; i < out->count; i++) {
+        if (out->arcs[i].node == to) {
+            if (weight < out->arcs[i].weight) {
+                out->arcs[i].weight = weight;
+                arc_list_t *in = &c->in[to];
+                for (int j = 0; j < in->count; j++) {
+                    if (in->arcs[j].node == from) {
+                        in->arcs[j].weight = weight;
+                    }
+                }
+            }
+            return 1;
+        }
+    }
+    if (!appendArc(out, to, weight) || !appendArc(&c->in[to], from, weight)) {
+        return 0;
+    }
+    c->shortcutCount++;
+    c->arcCount++;
+    return 1;
+}
+
+/**
+ * Helper function to push a witness search entry.
+ * @return 1 on success, 0 if memory allocation fails.
+ */
+static int witnessPush(contractor_t *c, double key, int node) {
+    if (c->heapCount == c->heapSpace) {
+        int newSpace = c->heapSpace == 0 ? 64 : c->heapSpace * 2;
+        witness_entry_t *newHeap = (witness_entry_t *)realloc(c->heap, sizeof(witness_entry_t) * newSpace);
+        if (newHeap == NULL) {
+            return 0;
+        }
+        c->heap = newHeap;
+        c->heapSpace = newSpace;
+    }
+
+    int pos = c->heapCount++;
+    while (pos > 0) {
+        int parent = (pos - 1) / 2;
+        if (c->heap[parent].key <= key) {
+            break;
+        }
+        c->heap[pos] = c->heap[parent];
+        pos = parent;
+    }
+    c->heap[pos].key = key;
+    c->heap[pos].node = node;
+    return 1;
+}
+
+/**
+ * Helper function to pop the witness search entry with the smallest key.
+ */
+static witness_entry_t witnessPop(contractor_t *c) {
+    witness_entry_t top = c->heap[0];
+    witness_entry_t last = c->heap[--c->heapCount];
+
+    int pos = 0;
+    while (1) {
+        int child = pos * 2 + 1;
+        if (child >= c->heapCount) {
+            break;
+        }
+        if (child + 1 < c->heapCount && c->heap[child + 1].key < c->heap[child].key) {
+            child++;
+        }
+        if (c->heap[child].key >= last.key) {
+            break;
+        }
+        c->heap[pos] = c->heap[child];
+        pos = child;
+    }
+    if (c->heapCount > 0) {
+        c->heap[pos] = last;
+    }
+    return top;
+}
+
+/**
+ * Helper function to pick how many edges a witness path may have. While
+ * the remaining graph is sparse almost every witness is a single edge,
+ * and longer searches only cost time; as shortcuts make it denser,
+ * longer witnesses are needed to keep unneeded shortcuts out.
+ */
+static int witnessHops(contractor_t *c) {
+    double degree = c->remaining > 0 ? (double)c->arcCount / c->remaining : 0;
+
+    if (degree <= 3.3) {
+        return 1;
+    }
+    if (degree <= 5) {
+        return 2;
+    }
+    if (degree <= 7) {
+        return 3;
+    }
+    return 5;
+}
+
+/**
+ * Helper function to run a bounded Dijkstra search from source over the
+ * remaining graph without passing through skip, following paths of at
+ * most maxHops edges. It stops early once the targets nodes whose
+ * targetMark[] is searchCount have all been settled. Afterwards dist[]
+ * holds the length of some path to every node it reached (DBL_MAX
+ * otherwise); a limit only makes it miss paths, which can add an
+ * unneeded shortcut but never lose a distance.
+ * @return 1 on success, 0 if memory allocation fails.
+ */
+static int witnessSearch(contractor_t *c, int source, int skip, double maxDist, int targets, int settleLimit, int maxHops) {
+    for (int i = 0; i < c->touchedCount; i++) {
+        c->dist[c->touched[i]] = DBL_MAX;
+    }
+    c->touchedCount = 0;
+    c->heapCount = 0;
+
+    c->dist[source] = 0;
+    c->hops[source] = 0;
+    c->touched[c->touchedCount++] = source;
+    if (!witnessPush(c, 0, source)) {
+        return 0;
+    }
+
+    int settled = 0;
+    while (c->heapCount > 0) {
+        witness_entry_t entry = witnessPop(c);
+        if (entry.key > c->dist[entry.node]) {
+            continue;
+        }
+        if (entry.key > maxDist || ++settled > settleLimit) {
+            break;
+        }
+        if (c->targetMark[entry.node] == c->searchCount && --targets == 0) {
+            break;
+        }
+        if (c->hops[entry.node] >= maxHops) {
+            continue;
+        }
+
+        arc_list_t *out = &c->out[entry.node];
+        for (int i = 0; i < out->count; i++) {
+            int to = out->arcs[i].node;
+            double alt = entry.key + out->arcs[i].weight;
+            if (to == skip || alt >= c->dist[to]) {
+                continue;
+            }
+            if (c->dist[to] == DBL_MAX) {
+                c->touched[c->touchedCount++] = to;
+            }
+            c->dist[to] = alt;
+            c->hops[to] = c->hops[entry.node] + 1;
+            if (!witnessPush(c, alt, to)) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+/**
+ * Helper function to find the shortcuts contracting v needs, adding them
+ * if apply is set. Estimates (apply not set) use a smaller search.
+ * @return The number of shortcuts, or -1 if memory allocation fails.
+ */
+static int contractNode(contractor_t *c, int v, int apply) {
+    arc_list_t *in = &c->in[v];
+    arc_list_t *out = &c->out[v];
+    int settleLimit = apply ? WITNESS_SETTLE_LIMIT : ESTIMATE_SETTLE_LIMIT;
+    int maxHops = witnessHops(c);
+    int shortcuts = 0;
+
+    for (int i = 0; i < in->count; i++) {
+        int u = in->arcs[i].node;
+        double toV = in->arcs[i].weight;
+
+        double maxDist = -1;
+        int targets = 0;
+        c->searchCount++;
+        for (int j = 0; j < out->count; j++) {
+            int w = out->arcs[j].node;
+            if (w == u) {
+                continue;
+            }
+            if (toV + out->arcs[j].weight > maxDist) {
+                maxDist = toV + out->arcs[j].weight;
+            }
+            if (c->targetMark[w] != c->searchCount) {
+                c->targetMark[w] = c->searchCount;
+                targets++;
+            }
+        }
+        if (maxDist < 0) {
+            continue;
+        }
+
+        if (!witnessSearch(c, u, v, maxDist, targets, settleLimit, maxHops)) {
+            return -1;
+        }
+        for (int j = 0; j < out->count; j++) {
+            int w = out->arcs[j].node;
+            double through = toV + out->arcs[j].weight;
+            if (w == u || c->dist[w] <= through) {
+                continue;
+            }
+            shortcuts++;
+            if (apply && !addOrLowerArc(c, u, w, through)) {
+                return -1;
+            }
+        }
+    }
+    return shortcuts;
+}
+
+/**
+ * Helper function to set a node's priority from its last edge difference
+ * estimate and its contracted neighbors and level, which change without
+ * any search.
+ */
+static void setPriority(contractor_t *c, int v) {
+    c->priority[v] = 2 * c->edgeDiff[v] + c->deleted[v] + c->level[v];
+}
+
+/**
+ * Helper function to estimate a node's edge difference (the shortcuts
+ * contracting it would add minus the edges it would remove) and update
+ * its priority.
+ * @return 1 on success, 0 if memory allocation fails.
+ */
+static int updatePriority(contractor_t *c, int v) {
+    int shortcuts = contractNode(c, v, 0);
+    if (shortcuts < 0) {
+        return 0;
+    }
+    c->edgeDiff[v] = shortcuts - c->in[v].count - c->out[v].count;
+    setPriority(c, v);
+    return 1;
+}
+
+/**
+ * Helper function to order two queued nodes by priority, then index.
+ */
+static int queueLess(contractor_t *c, int a, int b) {
+    if (c->priority[a] != c->priority[b]) {
+        return c->priority[a] < c->priority[b];
+    }
+    return a < b;
+}
+
+/**
+ * Helper function to move a queued node to its place after its priority changed.
+ */
+static void queueFix(contractor_t *c, int pos) {
+    int node = c->queue[pos];
+
+    while (pos > 0 && queueLess(c, node, c->queue[(pos - 1) / 2])) {
+        int parent = (pos - 1) / 2;
+        c->queue[pos] = c->queue[parent];
+        c->queuePos[c->queue[pos]] = pos;
+        pos = parent;
+    }
+    while (1) {
+        int child = pos * 2 + 1;
+        if (child >= c->queueCount) {
+            break;
+        }
+        if (child + 1 < c->queueCount && queueLess(c, c->queue[child + 1], c->queue[child])) {
+            child++;
+        }
+        if (!queueLess(c, c->queue[child], node)) {
+            break;
+        }
+        c->queue[pos] = c->queue[child];
+        c->queuePos[c->queue[pos]] = pos;
+        pos = child;
+    }
+    c->queue[pos] = node;
+    c->queuePos[node] = pos;
+}
+
+/**
+ * Helper function to remove the node at the top of the queue.
+ */
+static void queuePopTop(contractor_t *c) {
+    c->queuePos[c->queue[0]] = -1;
+    c->queueCount--;
+    if (c->queueCount > 0) {
+        c->queue[0] = c->queue[c->queueCount];
+        c->queuePos[c->queue[0]] = 0;
+        queueFix(c, 0);
+    }
+}
+
+/**
+ * Helper function to free a contraction run.
+ */
+static void freeContractor(contractor_t *c) {
+    for (int i = 0; c->out != NULL && i < c->nodeCount; i++) {
+        free(c->out[i].arcs);
+    }
+    for (int i = 0; c->in != NULL && i < c->nodeCount; i++) {
+        free(c->in[i].arcs);
+    }
+    free(c->out);
+    free(c->in);
+    free(c->contracted);
+    free(c->deleted);
+    free(c->level);
+    free(c->edgeDiff);
+    free(c->dist);
+    free(c->hops);
+    free(c->targetMark);
+    free(c->touched);
+    free(c->heap);
+    free(c->priority);
+    free(c->queue);
+    free(c->queuePos);
+}
+
+/**
+ * Helper function to copy the snapshot into per-node edge lists.
+ * Self-loops are dropped; they are never on a shortest path.
+ * @return 1 on success, 0 if memory allocation fails.
+ */
+static int initContractor(contractor_t *c, frozen_graph_t *frozen) {
+    int n = frozen->nodeCount;
+
+    memset(c, 0, sizeof(contractor_t));
+    c->nodeCount = n;
+    c->out = (arc_list_t *)calloc(n + 1, sizeof(arc_list_t));
+    c->in = (arc_list_t *)calloc(n + 1, sizeof(arc_list_t));
+    c->contracted = (unsigned char *)calloc(n + 1, sizeof(unsigned char));
+    c->deleted = (int *)calloc(n + 1, sizeof(int));
+    c->level = (int *)calloc(n + 1, sizeof(int));
+    c->edgeDiff = (int *)calloc(n + 1, sizeof(int));
+    c->dist = (double *)malloc(sizeof(double) * (n + 1));
+    c->hops = (int *)malloc(sizeof(int) * (n + 1));
+    c->targetMark = (int *)calloc(n + 1, sizeof(int));
+    c->touched = (int *)malloc(sizeof(int) * (n + 1));
+    c->priority = (int *)malloc(sizeof(int) * (n + 1));
+    c->queue = (int *)malloc(sizeof(int) * (n + 1));
+    c->queuePos = (int *)malloc(sizeof(int) * (n + 1));
+    if (c->out == NULL || c->in == NULL || c->contracted == NULL || c->deleted == NULL || c->level == NULL || c->edgeDiff == NULL ||
+        c->dist == NULL || c->hops == NULL || c->targetMark == NULL || c->touched == NULL || c->priority == NULL || c->queue == NULL || c->queuePos == NULL) {
+        return 0;
+    }
+
+    for (int i = 0; i < n; i++) {
+        c->dist[i] = DBL_MAX;
+        for (int e = frozen->rowOffsets[i]; e < frozen->rowOffsets[i + 1]; e++) {
+            int to = frozen->colIndices[e];
+            if (to != i && (!appendArc(&c->out[i], to, frozen->weights[e]) ||
+                            !appendArc(&c->in[to], i, frozen->weights[e]))) {
+                return 0;
+            }
+        }
+        c->arcCount += c->out[i].count;
+    }
+    c->remaining = n;
+    return 1;
+}
+
+/**
+ * Helper function to turn the per-node lists into CSR arrays.
+ * @return 1 on success, 0 if memory allocation fails.
+ */
+static int packLists(arc_list_t *lists, int n, int **offsets, int **nodes, double **weights) {
+    int total = 0;
+    for (int i = 0; i < n; i++) {
+        total += lists[i].count;
+    }
+
+    *offsets = (int *)malloc(sizeof(int) * (n + 1));
+    *nodes = (int *)malloc(sizeof(int) * (total + 1));
+    *weights = (double *)malloc(sizeof(double) * (total + 1));
+    if (*offsets == NULL || *nodes == NULL || *weights == NULL) {
+        return 0;
+    }
+
+    int pos = 0;
+    for (int i = 0; i < n; i++) {
+        (*offsets)[i] = pos;
+        for (int j = 0; j < lists[i].count; j++) {
+            (*nodes)[pos] = lists[i].arcs[j].node;
+            (*weights)[pos] = lists[i].arcs[j].weight;
+            pos++;
+        }
+    }
+    (*offsets)[n] = pos;
+    return 1;
+}
+
+/**
+ * Builds a contraction hierarchy for a snapshot.
+ */
+ch_graph_t *buildContractionHierarchy(frozen_graph_t *frozen) {
+    contractor_t c;
+    ch_graph_t *ch;
+    int ok = 0;
+
+    memset(&c, 0, sizeof(c));
+    if (frozen == NULL) {
+        return NULL;
+    }
+    ch = (ch_graph_t *)calloc(1, sizeof(ch_graph_t));
+    if (ch == NULL) {
+        return NULL;
+    }
+    ch->nodeCount = frozen->nodeCount;
+    ch->rank = (int *)malloc(sizeof(int) * (frozen->nodeCount + 1));
+    if (ch->rank == NULL || !initContractor(&c, frozen)) {
+        goto done;
+    }
+
+    int n = frozen->nodeCount;
+    for (int i = 0; i < n; i++) {
+        if (!updatePriority(&c, i)) {
+            goto done;
+        }
+        c.queue[i] = i;
+        c.queuePos[i] = i;
+    }
+    c.queueCount = n;
+    for (int i = n / 2 - 1; i >= 0; i--) {
+        queueFix(&c, i);
+    }
+
+    for (int rank = 0; rank < n; rank++) {
+        //Lazy update: the top's priority may be stale, so recompute it
+        //until the node on top keeps its place
+        int v;
+        while (1) {
+            v = c.queue[0];
+            int old = c.priority[v];
+            if (!updatePriority(&c, v)) {
+                goto done;
+            }
+            if (c.priority[v] <= old) {
+                break;
+            }
+            queueFix(&c, 0);
+            if (c.queue[0] == v) {
+                break;
+            }
+        }
+        queuePopTop(&c);
+
+        if (contractNode(&c, v, 1) < 0) {
+            goto done;
+        }
+        ch->rank[v] = rank;
+        c.contracted[v] = 1;
+        c.remaining--;
+        c.arcCount -= c.out[v].count + c.in[v].count;
+
+        //What is left of v's lists points at higher-ranked nodes and is
+        //kept as its upward and downward edges; v leaves the neighbors'
+        //lists, and each neighbor counts it and sits a level above it
+        for (int i = 0; i < c.out[v].count; i++) {
+            int w = c.out[v].arcs[i].node;
+            dropArc(&c.in[w], v);
+            c.deleted[w]++;
+            if (c.level[w] < c.level[v] + 1) {
+                c.level[w] = c.level[v] + 1;
+            }
+        }
+        for (int i = 0; i < c.in[v].count; i++) {
+            int u = c.in[v].arcs[i].node;
+            dropArc(&c.out[u], v);
+            c.deleted[u]++;
+            if (c.level[u] < c.level[v] + 1) {
+                c.level[u] = c.level[v] + 1;
+            }
+        }
+        for (int i = 0; i < c.out[v].count; i++) {
+            int w = c.out[v].arcs[i].node;
+            setPriority(&c, w);
+            queueFix(&c, c.queuePos[w]);
+        }
+        for (int i = 0; i < c.in[v].count; i++) {
+            int u = c.in[v].arcs[i].node;
+            setPriority(&c, u);
+            queueFix(&c, c.queuePos[u]);
+        }
+    }
+
+    ch->shortcutCount = c.shortcutCount;
+    ok = packLists(c.out, n, &ch->upOffsets, &ch->upTargets, &ch->upWeights) &&
+         packLists(c.in, n, &ch->downOffsets, &ch->downSources, &ch->downWeights);
+
+done:
+    freeContractor(&c);
+    if (!ok) {
+        freeContractionHierarchy(ch);
+        return NULL;
+    }
+    return ch;
+}
+
+// --- Files ---
+
+/**
+ * Writes a hierarchy to a file.
+ */
+int writeContractionHierarchy(const char *filename, ch_graph_t *ch, frozen_graph_t *frozen) {
+    ch_header_t header;
+    uint64_t sizes[CH_SECTIONS];
+    int n;
+    int ok = 0;
+
+    if (ch == NULL || frozen == NULL || ch->nodeCount != frozen->nodeCount) {
+        return 0;
+    }
+    n = ch->nodeCount;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CH_MAGIC, sizeof(header.magic));
+    header.version = CH_VERSION;
+    header.byteOrder = BYTE_ORDER_TAG;
+    header.graphHash = graphHash(frozen);
+    header.nodeCount = n;
+    header.upCount = ch->upOffsets[n];
+    header.downCount = ch->downOffsets[n];
+    header.shortcutCount = ch->shortcutCount;
+    header.fileSize = layoutSections(&header, sizes);
+
+    char *buf = (char *)calloc(1, header.fileSize);
+    if (buf == NULL) {
+        return 0;
+    }
+    memcpy(buf + header.offsets[SEC_RANK], ch->rank, sizes[SEC_RANK]);
+    memcpy(buf + header.offsets[SEC_UP_OFFSETS], ch->upOffsets, sizes[SEC_UP_OFFSETS]);
+    memcpy(buf + header.offsets[SEC_UP_TARGETS], ch->upTargets, sizes[SEC_UP_TARGETS]);
+    memcpy(buf + header.offsets[SEC_UP_WEIGHTS], ch->upWeights, sizes[SEC_UP_WEIGHTS]);
+    memcpy(buf + header.offsets[SEC_DOWN_OFFSETS], ch->downOffsets, sizes[SEC_DOWN_OFFSETS]);
+    memcpy(buf + header.offsets[SEC_DOWN_SOURCES], ch->downSources, sizes[SEC_DOWN_SOURCES]);
+    memcpy(buf + header.offsets[SEC_DOWN_WEIGHTS], ch->downWeights, sizes[SEC_DOWN_WEIGHTS]);
+
+    header.checksum = checksum(14695981039346656037ull, buf + sizeof(header), header.fileSize - sizeof(header));
+    memcpy(buf, &header, sizeof(header));
+
+    //Write beside the target and rename, so a reader never maps half a file
+    size_t len = strlen(filename);
+    char *tmpName = (char *)malloc(len + 5);
+    if (tmpName != NULL) {
+        memcpy(tmpName, filename, len);
+        memcpy(tmpName + len, ".tmp", 5);
+        FILE *file = fopen(tmpName, "wb");
+        if (file != NULL) {
+            ok = fwrite(buf, 1, header.fileSize, file) == header.fileSize;
+            ok = fclose(file) == 0 && ok;
+            ok = ok && rename(tmpName, filename) == 0;
+            if (!ok) {
+                remove(tmpName);
+            }
+        }
+        free(tmpName);
+    }
+
+    free(buf);
+    return ok;
+}
+
+/**
+ * Helper function to check that every CSR row is in order and every
+ * node index in range.
+ */
+static int validRows(const int *offsets, const int *nodes, int n, int count) {
+    if (offsets[0] != 0 || offsets[n] != count) {
+        return 0;
+    }
+    for (int i = 0; i < n; i++) {
+        if (offsets[i] > offsets[i + 1]) {
+            return 0;
+        }
+    }
+    for (int e = 0; e < count; e++) {
+        if (nodes[e] < 0 || nodes[e] >= n) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Helper function to check the header against the mapped file and snapshot.
+ * @return NULL if the header is valid, otherwise a description of the problem.
+ */
+static const char *checkHeader(const ch_header_t *header, size_t size, frozen_graph_t *frozen) {
+    ch_header_t expected;
+    uint64_t sizes[CH_SECTIONS];
+
+    if (memcmp(header->magic, CH_MAGIC, sizeof(header->magic)) != 0) {
+        return "not a contraction hierarchy file";
+    }
+    if (header->byteOrder != BYTE_ORDER_TAG) {
+        return "built on a machine with a different byte order";
+    }
+    if (header->version != CH_VERSION) {
+        return "unsupported version";
+    }
+    if (header->fileSize != size) {
+        return "file is truncated";
+    }
+    if (header->nodeCount < 0 || header->upCount < 0 || header->downCount < 0) {
+        return "corrupt header";
+    }
+
+    expected = *header;
+    if (layoutSections(&expected, sizes) != size ||
+        memcmp(expected.offsets, header->offsets, sizeof(expected.offsets)) != 0) {
+        return "corrupt section table";
+    }
+    if (header->nodeCount != frozen->nodeCount || header->graphHash != graphHash(frozen)) {
+        return "built for a different graph";
+    }
+    return NULL;
+}
+
+/**
+ * Maps a hierarchy file written for a snapshot.
+ */
+ch_graph_t *openContractionHierarchy(const char *filename, frozen_graph_t *frozen) {
+    struct stat st;
+    const char *problem = NULL;
+
+    if (frozen == NULL) {
+        return NULL;
+    }
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) {
+        return NULL;
+    }
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ch_header_t)) {
+        close(fd);
+        fprintf(stderr, "Warning: %s is not a contraction hierarchy file\n", filename);
+        return NULL;
+    }
+
+    void *addr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        return NULL;
+    }
+
+    ch_graph_t *ch = (ch_graph_t *)calloc(1, sizeof(ch_graph_t));
+    if (ch == NULL) {
+        munmap(addr, (size_t)st.st_size);
+        return NULL;
+    }
+    ch->base = (const char *)addr;
+    ch->size = (size_t)st.st_size;
+
+    const ch_header_t *header = (const ch_header_t *)ch->base;
+    problem = checkHeader(header, ch->size, frozen);
+    if (problem == NULL &&
+        checksum(14695981039346656037ull, ch->base + sizeof(*header), ch->size - sizeof(*header)) != header->checksum) {
+        problem = "checksum mismatch";
+    }
+
+    if (problem == NULL) {
+        const char *base = ch->base;
+        int n = header->nodeCount;
+        ch->nodeCount = n;
+        ch->shortcutCount = header->shortcutCount;
+        ch->rank = (int *)(base + header->offsets[SEC_RANK]);
+        ch->upOffsets = (int *)(base + header->offsets[SEC_UP_OFFSETS]);
+        ch->upTargets = (int *)(base + header->offsets[SEC_UP_TARGETS]);
+        ch->upWeights = (double *)(base + header->offsets[SEC_UP_WEIGHTS]);
+        ch->downOffsets = (int *)(base + header->offsets[SEC_DOWN_OFFSETS]);
+        ch->downSources = (int *)(base + header->offsets[SEC_DOWN_SOURCES]);
+        ch->downWeights = (double *)(base + header->offsets[SEC_DOWN_WEIGHTS]);
+        if (!validRows(ch->upOffsets, ch->upTargets, n, header->upCount) ||
+            !validRows(ch->downOffsets, ch->downSources, n, header->downCount)) {
+            problem = "corrupt edge table";
+        }
+    }
+
+    if (problem != NULL) {
+        fprintf(stderr, "Warning: %s: %s\n", filename, problem);
+        freeContractionHierarchy(ch);
+        return NULL;
+    }
+    return ch;
+}
+
+/**
+ * Frees or unmaps a hierarchy.
+ */
+void freeContractionHierarchy(ch_graph_t *ch) {
+    if (ch == NULL) {
+        return;
+    }
+
+    if (ch->base != NULL) {
+        munmap((void *)ch->base, ch->size);
+    }
+    else {
+        free(ch->rank);
+        free(ch->upOffsets);
+        free(ch->upTargets);
+        free(ch->upWeights);
+        free(ch->downOffsets);
+        free(ch->downSources);
+        free(ch->downWeights);
+    }
+    free(ch);
+}
@@ -0,0 +1,97 @@
+#ifndef CH_H
+#define CH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "graph.h"
+
+#define CH_MAGIC "CITYHIER"
+#define CH_VERSION 1
+#define CH_SECTIONS 7
+
+//Fixed-size header at the start of a contraction hierarchy file
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t checksum;
+    uint64_t fileSize;
+    uint64_t graphHash;
+    int32_t nodeCount;
+    int32_t upCount;
+    int32_t downCount;
+    int32_t shortcutCount;
+    uint64_t offsets[CH_SECTIONS];
+} ch_header_t;
+
+//Contraction hierarchy over a snapshot, indexed by dense node index.
+//Node i's edges to higher-ranked nodes (original edges and shortcuts)
+//are upTargets/upWeights[upOffsets[i] .. upOffsets[i + 1] - 1]; the
+//edges from higher-ranked nodes into it are downSources/downWeights
+//[downOffsets[i] .. downOffsets[i + 1] - 1]. Weights are doubles so a
+//shortcut holds the exact sum of the edges it replaces.
+typedef struct {
+    int nodeCount;
+    int shortcutCount;
+    int *rank;
+    int *upOffsets;
+    int *upTargets;
+    double *upWeights;
+    int *downOffsets;
+    int *downSources;
+    double *downWeights;
+    const char *base;
+    size_t size;
+} ch_graph_t;
+
+/**
+* Builds a contraction hierarchy for a snapshot.
+* @param frozen Pointer to the snapshot.
+* @return Pointer to the hierarchy, or NULL if memory allocation fails.
+* Nodes are contracted one at a time, least important first: a node's
+* priority is twice its edge difference (the shortcuts contracting it
+* would add minus the edges it would remove), plus the number of its
+* neighbors already contracted and its level (one more than that of its
+* highest contracted neighbor), so contraction spreads evenly across the
+* graph. The edge difference is estimated with a small witness search
+* and re-estimated only when the node reaches the top of the queue; the
+* neighbors of a contracted node just have their other terms updated.
+* Contracting v adds a shortcut u -> w for each pair of remaining
+* neighbors u -> v -> w unless a witness search (Dijkstra from u that
+* skips v, bounded by the path length, a settle limit and a hop limit
+* that grows with the average degree of the remaining graph) finds a
+* path that is no longer. An unfinished witness search only adds a
+* shortcut that was not needed, so distances are always preserved.
+**/
+ch_graph_t* buildContractionHierarchy(frozen_graph_t* frozen);
+/**
+* Writes a hierarchy to a file.
+* @param filename Path of the file to create.
+* @param ch Pointer to the hierarchy.
+* @param frozen Snapshot it was built for; a fingerprint of its IDs,
+* edges and weights is stored so a stale file is never used.
+* @return 1 on success, 0 on failure.
+* The file is written under a temporary name and renamed into place, so
+* readers never see a partial file. Like a compiled graph file it has a
+* versioned header with a 64-bit FNV-1a checksum and 8-byte aligned
+* sections: ranks, then the upward and downward CSR arrays.
+**/
+int writeContractionHierarchy(const char* filename, ch_graph_t* ch, frozen_graph_t* frozen);
+/**
+* Maps a hierarchy file written for a snapshot.
+* @param filename Path of the file.
+* @param frozen Snapshot the hierarchy must match.
+* @return Pointer to the hierarchy, which points into the mapping, or
+* NULL if the file does not exist, is invalid, or was built for a
+* different graph (a warning is printed for the last two, and the caller
+* is expected to rebuild it).
+**/
+ch_graph_t* openContractionHierarchy(const char* filename, frozen_graph_t* frozen);
+/**
+* Frees a hierarchy from buildContractionHierarchy() or unmaps one from
+* openContractionHierarchy().
+* If the pointer is NULL, the function does nothing.
+**/
+void freeContractionHierarchy(ch_graph_t* ch);
+
+#endif // CH_H
@@ -0,0 +1,637 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "graph.h"
+#include "route.h"
+#include "names.h"
+#include "geo.h"
+#include "testgraph.h"
+#include "citydata.h"
+
+// Times each benchmark repeats whole-file operations (load, teardown, diameter)
+#define DEFAULT_RUNS 5
+// Random POI pairs given to dijkstra() and chDijkstra()
+#define DEFAULT_QUERIES 1000
+// Lookups given to findNodeByName()
+#define DEFAULT_LOOKUPS 200000
+// Cheap operations are timed in batches this size; latency is batch time / size
+#define BATCH_OPS 1024
+// removeNodes() calls that together remove half of the inserted nodes
+#define REMOVE_CALLS 16
+
+// Samples and totals for one benchmark
+typedef struct {
+    const char *name;
+    const char *unit;
+    double *latencies;
+    int count;
+    int space;
+    long ops;
+    double seconds;
+    double median;
+    double p99;
+    long peakRssKb;
+} bench_result_t;
+
+// Everything measured on one input file
+typedef struct {
+    char *filename;
+    int nodeCount;
+    int edgeCount;
+    long lineCount;
+    bench_result_t results[10];
+    int resultCount;
+} bench_file_t;
+
+// Function prototypes
+void printBenchUsage(char *programName);
+int benchFile(bench_file_t *bench, int runs, int queries, int lookups);
+void printHuman(bench_file_t *bench);
+void printJson(bench_file_t *benches, int count);
+
+/**
+ * Print usage statement
+ */
+void printBenchUsage(char *programName) {
+    printf("Usage: %s [options] <filename> [<filename> ...]\n", programName);
+    printf("Options:\n");
+    printf("  -json          Print the results as JSON instead of a table\n");
+    printf("  -runs <n>      Repetitions of load, teardown and diameter (default %d)\n", DEFAULT_RUNS);
+    printf("  -queries <n>   Random POI pairs given to dijkstra() and chDijkstra() (default %d)\n", DEFAULT_QUERIES);
+    printf("  -lookups <n>   Random names given to findNodeByName() (default %d)\n", DEFAULT_LOOKUPS);
+}
+
+/**
+ * Helper function to read a monotonic clock in seconds.
+ */
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Helper function to read the peak resident set size so far, in kilobytes.
+ */
+static long peakRss() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+    return usage.ru_maxrss;
+}
+
+/**
+ * Helper function to pick the next pseudo-random number (64-bit LCG),
+ * so every run of the benchmark makes the same choices.
+ */
+static unsigned int nextRandom(unsigned long long *state) {
+    *state = *state * 6364136223846793005ull + 1442695040888963407ull;
+    return (unsigned int)(*state >> 33);
+}
+
+/**
+ * Helper function to start a benchmark.
+ */
+static bench_result_t* startResult(bench_file_t *bench, const char *name, const char *unit) {
+    bench_result_t *result;
+
+    result = &bench->results[bench->resultCount++];
+    memset(result, 0, sizeof(bench_result_t));
+    result->name = name;
+    result->unit = unit;
+    return result;
+}
+
+/**
+ * Helper function to record one sample: the latency of one operation
+ * (or the average over a batch), and the time and operations it adds to
+ * the throughput.
+ * Returns 1 on success, 0 if memory allocation fails.
+ */
+static int addSample(bench_result_t *result, double latency, double seconds, long ops) {
+    double *newLatencies;
+
+    if (result->count == result->space) {
+        result->space = result->space == 0 ? 64 : result->space * 2;
+        newLatencies = (double*)realloc(result->latencies, sizeof(double) * result->space);
+        if (newLatencies == NULL) {
+            return 0;
+        }
+        result->latencies = newLatencies;
+    }
+    result->latencies[result->count++] = latency;
+    result->seconds += seconds;
+    result->ops += ops;
+    return 1;
+}
+
+/**
+ * Helper function to order latencies.
+ */
+static int compareDoubles(const void *a, const void *b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Helper function to compute the median and 99th percentile (nearest
+ * rank) of a benchmark and note the peak memory use after it.
+ */
+static void finishResult(bench_result_t *result) {
+    int rank;
+
+    result->peakRssKb = peakRss();
+    if (result->count == 0) {
+        return;
+    }
+    qsort(result->latencies, result->count, sizeof(double), compareDoubles);
+    if (result->count % 2 == 1) {
+        result->median = result->latencies[result->count / 2];
+    }
+    else {
+        result->median = (result->latencies[result->count / 2 - 1] + result->latencies[result->count / 2]) / 2;
+    }
+    rank = (int)ceil(0.99 * result->count);
+    result->p99 = result->latencies[rank - 1];
+}
+
+/**
+ * Helper function to count the lines of a file.
+ * Returns the count, or -1 if the file cannot be read.
+ */
+static long countLines(char *filename) {
+    FILE *file;
+    char buf[65536];
+    size_t n;
+    size_t i;
+    long count;
+
+    file = fopen(filename, "rb");
+    if (file == NULL) {
+        return -1;
+    }
+    count = 0;
+    while ((n = fread(buf, 1, sizeof(buf), file)) > 0) {
+        for (i = 0; i < n; i++) {
+            count += buf[i] == '\n';
+        }
+    }
+    fclose(file);
+    return count;
+}
+
+/**
+ * Helper function to time loadFileGraph() and the teardown of its graph.
+ * Returns 1 on success, 0 on failure (a message is printed).
+ */
+static int benchLoad(bench_file_t *bench, int runs) {
+    bench_result_t *load;
+    bench_result_t *teardown;
+    name_index_t *roadNames;
+    geo_store_t *coords;
+    graph_t *graph;
+    double start;
+    double loaded;
+    double freed;
+    int ok;
+    int i;
+
+    load = startResult(bench, "loadFileGraph", "lines");
+    teardown = startResult(bench, "teardown", "nodes");
+    ok = 1;
+    for (i = 0; i < runs && ok; i++) {
+        start = now();
+        roadNames = createNameIndex();
+        coords = createGeoStore(0);
+        graph = roadNames && coords ? loadFileGraph(bench->filename, roadNames, coords, NULL) : NULL;
+        loaded = now();
+        if (graph == NULL) {
+            freeNameIndex(roadNames);
+            freeGeoStore(coords);
+            return 0;
+        }
+        bench->nodeCount = graph->nodeCount;
+        bench->edgeCount = graph->edgeCount;
+
+        freeGraphWithData(graph);
+        freeNameIndex(roadNames);
+        freeGeoStore(coords);
+        freed = now();
+
+        ok = addSample(load, loaded - start, loaded - start, bench->lineCount) &&
+             addSample(teardown, freed - loaded, freed - loaded, bench->nodeCount);
+    }
+    finishResult(load);
+    finishResult(teardown);
+    return ok;
+}
+
+/**
+ * Helper function to time addNode() and addEdge() on a graph the size of
+ * the loaded one: IDs 1 to nodeCount, and edges between random pairs
+ * (the rare repeated pair is rejected by addEdge() and still counted).
+ * Then times removeNodes() on every odd ID, in REMOVE_CALLS calls that
+ * each sweep the remaining edges, followed by compactGraph().
+ * Returns 1 on success, 0 if memory allocation fails.
+ */
+static int benchInsert(bench_file_t *bench) {
+    bench_result_t *nodes;
+    bench_result_t *edges;
+    bench_result_t *removals;
+    unsigned long long state;
+    graph_t *graph;
+    int *ids;
+    double start;
+    double seconds;
+    int batch;
+    int done;
+    int i;
+    int ok;
+
+    nodes = startResult(bench, "addNode", "nodes");
+    edges = startResult(bench, "addEdge", "edges");
+    removals = startResult(bench, "removeNodes", "nodes");
+    graph = createGraph();
+    ids = (int*)malloc(sizeof(int) * (bench->nodeCount / 2 + 1));
+    if (graph == NULL || ids == NULL) {
+        freeGraph(graph);
+        free(ids);
+        return 0;
+    }
+
+    ok = 1;
+    for (done = 0; done < bench->nodeCount && ok; done += batch) {
+        batch = bench->nodeCount - done < BATCH_OPS ? bench->nodeCount - done : BATCH_OPS;
+        start = now();
+        for (i = done; i < done + batch; i++) {
+            ok = ok && addNode(graph, i + 1, NULL) != NULL;
+        }
+        seconds = now() - start;
+        ok = ok && addSample(nodes, seconds / batch, seconds, batch);
+    }
+
+    state = 1;
+    for (done = 0; done < bench->edgeCount && ok; done += batch) {
+        batch = bench->edgeCount - done < BATCH_OPS ? bench->edgeCount - done : BATCH_OPS;
+        start = now();
+        for (i = 0; i < batch; i++) {
+            int from = (int)(nextRandom(&state) % bench->nodeCount) + 1;
+            int to = (int)(nextRandom(&state) % bench->nodeCount) + 1;
+            addEdge(graph, from, to, 1.0f, NULL);
+        }
+        seconds = now() - start;
+        ok = ok && addSample(edges, seconds / batch, seconds, batch);
+    }
+
+    for (i = 0; i < bench->nodeCount / 2; i++) {
+        ids[i] = 2 * i + 1;
+    }
+    batch = (bench->nodeCount / 2 + REMOVE_CALLS - 1) / REMOVE_CALLS;
+    for (done = 0; done < bench->nodeCount / 2 && ok; done += batch) {
+        if (batch > bench->nodeCount / 2 - done) {
+            batch = bench->nodeCount / 2 - done;
+        }
+        start = now();
+        removeNodes(graph, ids + done, batch);
+        if (done + batch == bench->nodeCount / 2) {
+            compactGraph(graph);
+        }
+        seconds = now() - start;
+        ok = addSample(removals, seconds / batch, seconds, batch);
+    }
+
+    free(ids);
+    freeGraph(graph);
+    finishResult(nodes);
+    finishResult(edges);
+    finishResult(removals);
+    return ok;
+}
+
+/**
+ * Helper function to time name lookups, shortest paths and the diameter
+ * on a city loaded with loadCity(). Contraction hierarchy preprocessing
+ * is timed once (it is by far the slowest step), then chDijkstra() on
+ * the same pairs as dijkstra().
+ * Returns 1 on success, 0 if memory allocation fails.
+ */
+static int benchQueries(bench_file_t *bench, city_t *city, int runs, int queries, int lookups) {
+    bench_result_t *find;
+    bench_result_t *paths;
+    bench_result_t *build;
+    bench_result_t *chPaths;
+    bench_result_t *diameter;
+    ch_graph_t *ch;
+    poi_data_t *poi;
+    unsigned long long state;
+    int *pois;
+    int poiCount;
+    double start;
+    double seconds;
+    int batch;
+    int done;
+    int found;
+    int i;
+    int ok;
+
+    find = startResult(bench, "findNodeByName", "lookups");
+    paths = startResult(bench, "dijkstra", "queries");
+    build = startResult(bench, "buildCH", "builds");
+    chPaths = startResult(bench, "chDijkstra", "queries");
+    diameter = startResult(bench, "findDiameter", "runs");
+
+    // Dense indices of the named POIs, to draw names and query pairs from
+    pois = (int*)malloc(sizeof(int) * (city->frozen->nodeCount + 1));
+    if (pois == NULL) {
+        return 0;
+    }
+    poiCount = 0;
+    for (i = 0; i < city->frozen->nodeCount; i++) {
+        poi = (poi_data_t*)city->frozen->nodeData[i];
+        if (poi != NULL && poi->name != NULL) {
+            pois[poiCount++] = i;
+        }
+    }
+
+    ok = 1;
+    state = 2;
+    found = 0;
+    for (done = 0; done < lookups && poiCount > 0 && ok; done += batch) {
+        batch = lookups - done < BATCH_OPS ? lookups - done : BATCH_OPS;
+        start = now();
+        for (i = 0; i < batch; i++) {
+            poi = (poi_data_t*)city->frozen->nodeData[pois[nextRandom(&state) % poiCount]];
+            found += findNodeByName(city, poi->name) != -1;
+        }
+        seconds = now() - start;
+        ok = addSample(find, seconds / batch, seconds, batch);
+    }
+    if (found != lookups && poiCount > 0) {
+        fprintf(stderr, "Warning: %d of %d names were not found\n", lookups - found, lookups);
+    }
+
+    state = 3;
+    for (i = 0; i < queries && poiCount > 0 && ok; i++) {
+        int from = pois[nextRandom(&state) % poiCount];
+        int to = pois[nextRandom(&state) % poiCount];
+        start = now();
+        dijkstra(city->frozen, city->scratch, city->frozen->ids[from], city->frozen->ids[to]);
+        seconds = now() - start;
+        ok = addSample(paths, seconds, seconds, 1);
+    }
+
+    ch = NULL;
+    if (ok) {
+        start = now();
+        ch = buildContractionHierarchy(city->frozen);
+        seconds = now() - start;
+        ok = ch != NULL && addSample(build, seconds, seconds, 1);
+    }
+    state = 3;
+    for (i = 0; i < queries && poiCount > 0 && ok; i++) {
+        int from = pois[nextRandom(&state) % poiCount];
+        int to = pois[nextRandom(&state) % poiCount];
+        start = now();
+        chDijkstra(city->frozen, ch, city->scratch, city->frozen->ids[from], city->frozen->ids[to]);
+        seconds = now() - start;
+        ok = addSample(chPaths, seconds, seconds, 1);
+    }
+    freeContractionHierarchy(ch);
+
+    for (i = 0; i < runs && ok; i++) {
+        start = now();
+        findDiameter(city);
+        seconds = now() - start;
+        ok = addSample(diameter, seconds, seconds, 1);
+    }
+
+    free(pois);
+    finishResult(find);
+    finishResult(paths);
+    finishResult(build);
+    finishResult(chPaths);
+    finishResult(diameter);
+    return ok;
+}
+
+/**
+ * Run every benchmark on one file.
+ * Returns 1 on success, 0 on failure (a message is printed).
+ */
+int benchFile(bench_file_t *bench, int runs, int queries, int lookups) {
+    city_t city;
+    FILE *sink;
+    int ok;
+
+    bench->lineCount = countLines(bench->filename);
+    if (bench->lineCount < 0) {
+        fprintf(stderr, "Error: Cannot open file %s\n", bench->filename);
+        return 0;
+    }
+    if (!benchLoad(bench, runs)) {
+        return 0;
+    }
+    if (!benchInsert(bench)) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return 0;
+    }
+
+    if (!loadCity(&city, bench->filename, NULL)) {
+        return 0;
+    }
+    sink = fopen("/dev/null", "w");
+    city.scratch = createRouteScratch(city.frozen->nodeCount, HEAP_BINARY);
+    if (sink == NULL || city.scratch == NULL) {
+        fprintf(stderr, "Error: Out of memory\n");
+        if (sink != NULL) {
+            fclose(sink);
+        }
+        closeCity(&city);
+        return 0;
+    }
+    // Query results are not wanted, only their cost
+    city.out = sink;
+    city.err = stderr;
+
+    ok = benchQueries(bench, &city, runs, queries, lookups);
+    if (!ok) {
+        fprintf(stderr, "Error: Out of memory\n");
+    }
+    closeCity(&city);
+    fclose(sink);
+    return ok;
+}
+
+/**
+ * Helper function to print a duration with a readable unit.
+ */
+static void printDuration(double seconds) {
+    if (seconds < 1e-6) {
+        printf("%10.1f ns", seconds * 1e9);
+    }
+    else if (seconds < 1e-3) {
+        printf("%10.2f us", seconds * 1e6);
+    }
+    else if (seconds < 1) {
+        printf("%10.2f ms", seconds * 1e3);
+    }
+    else {
+        printf("%10.3f s ", seconds);
+    }
+}
+
+/**
+ * Print one file's results as a table
+ */
+void printHuman(bench_file_t *bench) {
+    bench_result_t *result;
+    char rate[64];
+    int i;
+
+    printf("%s: %ld lines, %d nodes, %d edges\n", bench->filename, bench->lineCount, bench->nodeCount, bench->edgeCount);
+    printf("  %-16s %7s %13s %13s %22s %12s\n", "benchmark", "samples", "median", "p99", "throughput", "peak RSS");
+    for (i = 0; i < bench->resultCount; i++) {
+        result = &bench->results[i];
+        printf("  %-16s %7d ", result->name, result->count);
+        printDuration(result->median);
+        printf(" ");
+        printDuration(result->p99);
+        snprintf(rate, sizeof(rate), "%.0f %s/s", result->seconds > 0 ? result->ops / result->seconds : 0.0, result->unit);
+        printf(" %22s %9.1f MB\n", rate, result->peakRssKb / 1024.0);
+    }
+}
+
+/**
+ * Helper function to print a string as a JSON string literal.
+ */
+static void printJsonString(const char *text) {
+    const char *p;
+
+    putchar('"');
+    for (p = text; *p != '\0'; p++) {
+        if (*p == '"' || *p == '\\') {
+            printf("\\%c", *p);
+        }
+        else if ((unsigned char)*p < 0x20) {
+            printf("\\u%04x", *p);
+        }
+        else {
+            putchar(*p);
+        }
+    }
+    putchar('"');
+}
+
+/**
+ * Print every file's results as one JSON array, times in seconds
+ */
+void printJson(bench_file_t *benches, int count) {
+    bench_result_t *result;
+    int i;
+    int j;
+
+    printf("[\n");
+    for (i = 0; i < count; i++) {
+        printf("  {\"file\": ");
+        printJsonString(benches[i].filename);
+        printf(", \"lines\": %ld, \"nodes\": %d, \"edges\": %d, \"results\": [\n",
+               benches[i].lineCount, benches[i].nodeCount, benches[i].edgeCount);
+        for (j = 0; j < benches[i].resultCount; j++) {
+            result = &benches[i].results[j];
+            printf("    {\"name\": \"%s\", \"unit\": \"%s\", \"samples\": %d, \"ops\": %ld, "
+                   "\"seconds\": %.9g, \"median\": %.9g, \"p99\": %.9g, \"throughput\": %.9g, \"peakRssKb\": %ld}%s\n",
+                   result->name, result->unit, result->count, result->ops, result->seconds, result->median, result->p99,
+                   result->seconds > 0 ? result->ops / result->seconds : 0.0, result->peakRssKb,
+                   j + 1 < benches[i].resultCount ? "," : "");
+        }
+        printf("  ]}%s\n", i + 1 < count ? "," : "");
+    }
+    printf("]\n");
+}
+
+/**
+ * Main function
+ */
+int main(int argc, char *argv[]) {
+    bench_file_t *benches;
+    int benchCount;
+    int json;
+    int runs;
+    int queries;
+    int lookups;
+    int status;
+    int i;
+    int j;
+
+    if (argc == 1) {
+        printBenchUsage(argv[0]);
+        return 0;
+    }
+
+    benches = (bench_file_t*)calloc(argc, sizeof(bench_file_t));
+    if (benches == NULL) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return 1;
+    }
+    benchCount = 0;
+    json = 0;
+    runs = DEFAULT_RUNS;
+    queries = DEFAULT_QUERIES;
+    lookups = DEFAULT_LOOKUPS;
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-json") == 0) {
+            json = 1;
+        }
+        else if ((strcmp(argv[i], "-runs") == 0 || strcmp(argv[i], "-queries") == 0 ||
+                  strcmp(argv[i], "-lookups") == 0) && i + 1 < argc) {
+            int value = atoi(argv[i + 1]);
+            if (value < 1) {
+                fprintf(stderr, "Error: %s requires a positive number\n", argv[i]);
+                free(benches);
+                return 1;
+            }
+            if (strcmp(argv[i], "-runs") == 0) {
+                runs = value;
+            }
+            else if (strcmp(argv[i], "-queries") == 0) {
+                queries = value;
+            }
+            else {
+                lookups = value;
+            }
+            i++;
+        }
+        else {
+            benches[benchCount++].filename = argv[i];
+        }
+    }
+
+    // Tables are printed as each file finishes; JSON once at the end
+    status = 0;
+    for (i = 0; i < benchCount; i++) {
+        if (!benchFile(&benches[i], runs, queries, lookups)) {
+            status = 1;
+            break;
+        }
+        if (!json) {
+            printHuman(&benches[i]);
+            fflush(stdout);
+        }
+    }
+    if (json && status == 0) {
+        printJson(benches, benchCount);
+    }
+
+    for (i = 0; i < benchCount; i++) {
+        for (j = 0; j < benches[i].resultCount; j++) {
+            free(benches[i].results[j].latencies);
+        }
+    }
+    free(benches);
+    return status;
+}
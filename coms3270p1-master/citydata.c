@@ -3,221 +3,257 @@
 #include <string.h>
 #include <math.h>
 #include <float.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include "graph.h"
 #include "data.h"
+#include "route.h"
+#include "names.h"
+#include "gcache.h"
+#include "spatial.h"
+#include "geo.h"
+#include "testgraph.h"
+#include "citydata.h"
 
-// Earth radius in meters for Haversine formula
-#define EARTH_RADIUS 6371000.0
-#define MAX_LINE_LEN 1024
+// Largest arena slab the loader asks for, in bytes
+#define MAX_ARENA_SLAB (64 << 20)
+// Initial size of the -serve read buffer, in bytes
+#define SERVE_BUFFER_SIZE 65536
+// Most arguments any -serve command takes
+#define MAX_COMMAND_ARGS 2
+// Commands a -batch worker takes at a time
+#define BATCH_BLOCK_SIZE 256
 
-// POI data structure
+// A -batch run: the commands, split into blocks that workers claim in turn
 typedef struct {
-    char *name;
-    double latitude;
-    double longitude;
-} poi_data_t;
-
-// Function prototypes
-void printUsage(char *programName);
-graph_t* loadFileGraph(char *filename);
-double calculateDistance(double lat1, double lon1, double lat2, double lon2);
-void findLocation(graph_t *graph, char *locationName);
-void findDiameter(graph_t *graph);
-void distanceBetween(graph_t *graph, char *name1, char *name2);
-void roadDistance(graph_t *graph, char *name1, char *name2);
-double dijkstra(graph_t *graph, int startId, int endId);
-void freeGraphWithData(graph_t *graph);
-node_t* findNodeByName(graph_t *graph, char *name);
+    city_t *city;
+    heap_kind_t heapKind;
+    char **lines;
+    int lineCount;
+    int blockCount;
+    int nextBlock;
+    pthread_mutex_t lock;
+    char **blockOutput;
+    size_t *blockLength;
+    int failed;
+} batch_t;
+
+int runBatch(city_t *city, char *filename, int threadCount, heap_kind_t heapKind);
+
+// Set by SIGINT/SIGTERM to stop a socket server
+static volatile sig_atomic_t stopRequested = 0;
 
 /**
  * Print usage statement
  */
 void printUsage(char *programName) {
     printf("Usage: %s -f <filename> [options]\n", programName);
+    printf("       %s -g <graphfile> [options]\n", programName);
+    printf("       %s -compile <filename> -o <graphfile>\n", programName);
     printf("Options:\n");
-    printf("  -f <filename>              Load city data from file (required)\n");
+    printf("  -f <filename>              Load city data from file\n");
+    printf("  -g <graphfile>             Load a graph file written by -compile instead of -f\n");
+    printf("  -compile <filename>        Compile city data into the graph file given by -o\n");
+    printf("  -o <graphfile>             Output file for -compile\n");
+    printf("  -heap <binary|radix>       Priority queue used by -roaddist (default binary)\n");
+    printf("  -astar                     Make -roaddist use A* search guided by straight-line distance\n");
+    printf("  -bidir                     Make -roaddist search from both ends at once\n");
+    printf("  -ch                        Make -roaddist use a contraction hierarchy (built once, saved as <file>.ch)\n");
+    printf("  -settled                   Print the number of nodes each -roaddist settled to stderr\n");
+    printf("  -stats                     Print load phase times, lookup probes and query statistics to stderr\n");
+    printf("  -serve                     Load once, then answer commands from stdin (one per line)\n");
+    printf("  -socket <path>             Make -serve listen on a UNIX domain socket instead\n");
+    printf("  -batch <queryfile>         Run the server commands in a file, one per line\n");
+    printf("  -threads <n>               Worker threads for -batch (default: number of CPUs)\n");
     printf("  -location <name>           Find location and print lat/long\n");
     printf("  -diameter                  Find max distance between any two nodes\n");
+    printf("  -exact                     Make -diameter compare every pair instead of using the convex hull\n");
     printf("  -distance <name1> <name2>  Calculate straight-line distance\n");
     printf("  -roaddist <name1> <name2>  Calculate shortest road distance\n");
+    printf("  -route <name1> <name2>     Print the shortest road route and the streets it takes\n");
+    printf("  -matrix <from> <to>        Print road distances from each name in one file to each in another as CSV\n");
+    printf("  -reach <name> <meters>     List every node within a road distance of a location\n");
+    printf("  -nearest <lat> <lon> [k]   List the k POIs closest to a point (default 1)\n");
+    printf("  -within <lat> <lon> <m>    List the POIs within m meters of a point\n");
+    printf("  -delta <file>              Apply a delta file (added/removed POIs and roads) to a city loaded with -f\n");
+    printf("Server commands (arguments separated by tabs):\n");
+    printf("  location <name>, diameter, distance <name1> <name2>, roaddist <name1> <name2>, delta <file>\n");
 }
 
 /**
- * Calculate distance between two lat/lon points using Haversine formula
+ * Helper function to record the coordinates of the node just added,
+ * which is always in the last slot of graph->nodes.
+ * Returns 1 on success, 0 if memory allocation fails.
  */
-double calculateDistance(double lat1, double lon1, double lat2, double lon2) {
-    double lat1_rad;
-    double lat2_rad;
-    double dlat;
-    double dlon;
-    double a;
-    double c;
-    
-    // Convert to radians
-    lat1_rad = lat1 * M_PI / 180.0;
-    lat2_rad = lat2 * M_PI / 180.0;
-    dlat = (lat2 - lat1) * M_PI / 180.0;
-    dlon = (lon2 - lon1) * M_PI / 180.0;
-    
-    // Haversine formula
-    a = sin(dlat/2) * sin(dlat/2) + cos(lat1_rad) * cos(lat2_rad) * sin(dlon/2) * sin(dlon/2);
-    c = 2 * atan2(sqrt(a), sqrt(1-a));
-    
-    return EARTH_RADIUS * c;
+static int storeNodePoint(graph_t *graph, geo_store_t *coords, double lat, double lon) {
+    if (!resizeGeoStore(coords, graph->nodeCount)) {
+        return 0;
+    }
+    setGeoPoint(coords, graph->nodeCount - 1, lat, lon);
+    return 1;
 }
 
 /**
- * Load graph from file
+ * Load graph from file, validating each line as it is parsed.
+ * Road names are interned in roadNames, which owns them, so every
+ * segment of a street shares one string. Each node's coordinates are
+ * also stored in coords at its slot in graph->nodes.
+ * If stats is not NULL, the time spent in each phase is added to it.
+ * Returns NULL (after printing an error) if the file is invalid or any
+ * node, edge or record cannot be allocated.
  */
-graph_t* loadFileGraph(char *filename) {
-    FILE *file;
-    FILE *oldStdin;
-
+graph_t* loadFileGraph(char *filename, name_index_t *roadNames, geo_store_t *coords, run_stats_t *stats) {
+    map_file_t *map;
     graph_t *graph;
+    poi_record_t poi;
+    road_record_t road;
 
-    char line[MAX_LINE_LEN];
-    char id_str[MAX_LINE_LEN];
-    char name[MAX_LINE_LEN];
-    char from_id[MAX_LINE_LEN];
-    char to_id[MAX_LINE_LEN];
-    char road_name[MAX_LINE_LEN];
-    char *road_name_copy;
+    const char *road_name;
 
-    int validationResult;
+    int errorLine;
     int numPoi;
     int numRoads;
     int i;
-    int id;
-    int from;
-    int to;
+    double mark;
 
     poi_data_t *poi_data;
     poi_data_t *intersection;
+    node_t *fromNode;
     
-    double lat;
-    double lon;
-    double distance;
-    
-    file = fopen(filename, "r");
-    if (!file) {
+    mark = STATS_ON(stats) ? statsClock() : 0;
+    map = openMapFile(filename);
+    if (!map) {
         fprintf(stderr, "Error: Cannot open file %s\n", filename);
         return NULL;
     }
-
-    oldStdin = stdin;
-    stdin = file;
-    
-    validationResult = validate();
-    if (validationResult != 0) {
-        fprintf(stderr, "Error: Invalid file format at line %d\n", validationResult);
-        stdin = oldStdin;
-        fclose(file);
-        return NULL;
-    }
-    
-    fseek(file, 0, SEEK_SET);
     
-    graph = createGraph();
+    // Nodes, edges, POI records and names take about as much memory as the file
+    graph = createGraphWithArena(map->size < MAX_ARENA_SLAB ? map->size : MAX_ARENA_SLAB);
     if (!graph) {
-        stdin = oldStdin;
-        fclose(file);
+        closeMapFile(map);
         return NULL;
     }
     
-    if (fgets(line, MAX_LINE_LEN, file) == NULL) {
-        freeGraph(graph);
-        stdin = oldStdin;
-        fclose(file);
-        return NULL;
-    }
+    STATS_LAP(stats, STATS_OPEN, mark);
     
-    sscanf(line, "%d", &numPoi);
+    errorLine = readMapCount(map, &numPoi);
     
     // Read POIs
-    for (i = 0; i < numPoi; i++) {
-        if (fgets(line, MAX_LINE_LEN, file) == NULL) {
-            freeGraphWithData(graph);
-            stdin = oldStdin;
-            fclose(file);
-            return NULL;
+    for (i = 0; errorLine == 0 && i < numPoi; i++) {
+        errorLine = readMapPoi(map, &poi);
+        STATS_LAP(stats, STATS_READ, mark);
+        if (errorLine != 0) {
+            break;
         }
         
-        if (sscanf(line, "%[^\t]\t%[^\t]\t%lf\t%lf", id_str, name, &lat, &lon) != 4) {
+        // Duplicate IDs are skipped before anything is carved from the arena
+        if (getNode(graph, poi.id) != NULL) {
+            STATS_LAP(stats, STATS_NODES, mark);
             continue;
         }
         
-        poi_data = (poi_data_t*)malloc(sizeof(poi_data_t));
+        // The ID is new, so a node that cannot be added is out of memory
+        poi_data = (poi_data_t*)graphAlloc(graph, sizeof(poi_data_t));
         if (!poi_data) {
-            freeGraphWithData(graph);
-            stdin = oldStdin;
-            fclose(file);
-            return NULL;
+            errorLine = -1;
+            break;
         }
         
-        poi_data->name = strdup(name);
-        poi_data->latitude = lat;
-        poi_data->longitude = lon;
+        poi_data->name = graphStrndup(graph, poi.name, poi.nameLen);
+        poi_data->latitude = poi.latitude;
+        poi_data->longitude = poi.longitude;
         
-        id = atoi(id_str);
-        if (addNode(graph, id, poi_data) == NULL) {
-            free(poi_data->name);
-            free(poi_data);
+        if (poi_data->name == NULL || addNode(graph, poi.id, poi_data) == NULL ||
+            !storeNodePoint(graph, coords, poi.latitude, poi.longitude)) {
+            errorLine = -1;
+            break;
         }
+        STATS_LAP(stats, STATS_NODES, mark);
     }
     
     // Read road count
-    if (fgets(line, MAX_LINE_LEN, file) == NULL) {
-        freeGraphWithData(graph);
-        stdin = oldStdin;
-        fclose(file);
-        return NULL;
+    if (errorLine == 0) {
+        errorLine = readMapCount(map, &numRoads);
     }
     
-    sscanf(line, "%d", &numRoads);
-    
     // Read roads
-    for (i = 0; i < numRoads; i++) {
-        if (fgets(line, MAX_LINE_LEN, file) == NULL) {
-            freeGraphWithData(graph);
-            stdin = oldStdin;
-            fclose(file);
-            return NULL;
-        }
-        
-        if (sscanf(line, "%[^\t]\t%[^\t]\t%lf\t%lf\t%lf\t%[^\n]", from_id, to_id, &distance, &lat, &lon, road_name) != 6) {
-            continue;
+    for (i = 0; errorLine == 0 && i < numRoads; i++) {
+        errorLine = readMapRoad(map, &road);
+        STATS_LAP(stats, STATS_READ, mark);
+        if (errorLine != 0) {
+            break;
         }
         
-        if (isnan(distance)) {
-            distance = 0.0;
+        if (isnan(road.distance)) {
+            road.distance = 0.0;
         }
         
-        from = atoi(from_id);
-        to = atoi(to_id);
-        
-        // Add nodes that do not exist yet
-        if (getNode(graph, from) == NULL) {
-            intersection = (poi_data_t*)malloc(sizeof(poi_data_t));
-            if (intersection) {
-                intersection->name = NULL;
-                intersection->latitude = lat;
-                intersection->longitude = lon;
-                addNode(graph, from, intersection);
+        // Add nodes that do not exist yet, and give coordinates to
+        // intersections first added as the destination of an earlier road
+        fromNode = getNode(graph, road.fromId);
+        if (fromNode == NULL || fromNode->data == NULL) {
+            intersection = (poi_data_t*)graphAlloc(graph, sizeof(poi_data_t));
+            if (!intersection) {
+                errorLine = -1;
+                break;
+            }
+            intersection->name = NULL;
+            intersection->latitude = road.latitude;
+            intersection->longitude = road.longitude;
+            if (fromNode != NULL) {
+                fromNode->data = intersection;
+                if (!resizeGeoStore(coords, graph->nodeCount)) {
+                    errorLine = -1;
+                    break;
+                }
+                setGeoPoint(coords, getNodeSlot(graph, road.fromId), road.latitude, road.longitude);
+            }
+            else if (addNode(graph, road.fromId, intersection) == NULL ||
+                     !storeNodePoint(graph, coords, road.latitude, road.longitude)) {
+                errorLine = -1;
+                break;
             }
         }
         
-        if (getNode(graph, to) == NULL) {
-            addNode(graph, to, NULL);
+        // Nodes only seen as destinations have no coordinates yet
+        if (getNode(graph, road.toId) == NULL && addNode(graph, road.toId, NULL) == NULL) {
+            errorLine = -1;
+            break;
         }
+        STATS_LAP(stats, STATS_NODES, mark);
         
-        road_name_copy = strdup(road_name);
-        if (addEdge(graph, from, to, (float)distance, road_name_copy) == NULL) {
-            free(road_name_copy);
+        // Only intern the name once the edge is known to be new; both ends
+        // exist by now, so a failure to add it is out of memory too
+        if (getEdge(graph, road.fromId, road.toId) == NULL) {
+            road_name = internName(roadNames, road.name, road.nameLen);
+            if (road_name == NULL || addEdge(graph, road.fromId, road.toId, (float)road.distance, (void*)road_name) == NULL) {
+                errorLine = -1;
+                break;
+            }
         }
+        STATS_LAP(stats, STATS_EDGES, mark);
     }
     
-    stdin = oldStdin;
-    fclose(file);
+    closeMapFile(map);
+    
+    if (errorLine == 0 && !resizeGeoStore(coords, graph->nodeCount)) {
+        errorLine = -1;
+    }
+    if (errorLine != 0) {
+        if (errorLine > 0) {
+            fprintf(stderr, "Error: Invalid file format at line %d\n", errorLine);
+        }
+        else {
+            fprintf(stderr, "Error: Out of memory\n");
+        }
+        freeGraphWithData(graph);
+        return NULL;
+    }
     return graph;
 }
 
@@ -228,29 +264,22 @@ void freeGraphWithData(graph_t *graph) {
     int i;
     node_t *node;
     poi_data_t *poi;
-    edge_t *edge;
     
     if (graph == NULL) return;
     
-    // Free all custom data first
-    for (i = 0; i < graph->nodeCount; i++) {
-        node = graph->nodes[i];
-        if (node != NULL) {
-            if (node->data != NULL) {
+    // Road names are interned and belong to the road name index, so edge
+    // data is never freed here; each unique name is freed once with it.
+    // POI records carved from the arena are released with the graph.
+    if (graph->arena == NULL) {
+        for (i = 0; i < graph->nodeCount; i++) {
+            node = graph->nodes[i];
+            if (node != NULL && node->data != NULL) {
                 poi = (poi_data_t*)node->data;
                 if (poi->name != NULL) {
                     free(poi->name);
                 }
                 free(poi);
             }
-            
-            edge = node->edges;
-            while (edge != NULL) {
-                if (edge->data != NULL) {
-                    free(edge->data);
-                }
-                edge = edge->next;
-            }
         }
     }
     
@@ -258,326 +287,1699 @@ void freeGraphWithData(graph_t *graph) {
 }
 
 /**
- * Find a node by POI name
+ * Build the POI name index, keeping IDs in node order
  */
-node_t* findNodeByName(graph_t *graph, char *name) {
+name_index_t* buildNameIndex(graph_t *graph) {
     int i;
     node_t *node;
     poi_data_t *poi;
+    name_index_t *names;
+    
+    names = createNameIndex();
+    if (names == NULL) {
+        return NULL;
+    }
     
     for (i = 0; i < graph->nodeCount; i++) {
         node = graph->nodes[i];
         if (node != NULL && node->data != NULL) {
             poi = (poi_data_t*)node->data;
-            if (poi->name != NULL && strcmp(poi->name, name) == 0) {
-                return node;
+            if (poi->name != NULL && !addNameId(names, poi->name, node->id)) {
+                freeNameIndex(names);
+                return NULL;
             }
         }
     }
-    return NULL;
+    return names;
+}
+
+/**
+ * Find a node by POI name, returning the snapshot index of the first
+ * match in node order, or -1 if no POI has the name
+ */
+int findNodeByName(city_t *city, char *name) {
+    const int *ids;
+    int count;
+    
+    ids = findNameIds(city->names, name, &count);
+    if (ids == NULL) {
+        return -1;
+    }
+    return getFrozenIndex(city->frozen, ids[0]);
 }
 
 /**
  * Find and print location coordinates
  */
-void findLocation(graph_t *graph, char *locationName) {
-    node_t *node;
-    poi_data_t *poi;
+void findLocation(city_t *city, char *locationName) {
+    int idx;
     
-    node = findNodeByName(graph, locationName);
-    if (node != NULL) {
-        poi = (poi_data_t*)node->data;
-        printf("%.4f %.4f\n", poi->latitude, poi->longitude);
+    idx = findNodeByName(city, locationName);
+    if (idx != -1) {
+        fprintf(city->out, "%.4f %.4f\n", city->coords->lat[idx], city->coords->lon[idx]);
     } 
     else {
-        fprintf(stderr, "Error: Location '%s' not found\n", locationName);
+        fprintf(city->err, "Error: Location '%s' not found\n", locationName);
     }
 }
 
 /**
- * Find the diameter (maximum distance between any two POIs)
+ * Helper function to gather the coordinates of every named POI in
+ * snapshot order, with each one's dense index in items.
+ * Returns the number of POIs, or -1 if memory allocation fails.
  */
-void findDiameter(graph_t *graph) {
-    double maxDistance;
-    int node1_idx;
-    int node2_idx;
+static int collectPois(city_t *city, double **lats, double **lons, int **items) {
+    frozen_graph_t *frozen;
+    poi_data_t *poi;
+    int count;
     int i;
-    int j;
-
-    node_t *node1;
-    node_t *node2;
-
-    poi_data_t *poi1;
-    poi_data_t *poi2;
-
-    double dist;
     
-    maxDistance = 0;
-    node1_idx = -1;
-    node2_idx = -1;
+    frozen = city->frozen;
+    *lats = (double*)malloc(sizeof(double) * (frozen->nodeCount + 1));
+    *lons = (double*)malloc(sizeof(double) * (frozen->nodeCount + 1));
+    *items = (int*)malloc(sizeof(int) * (frozen->nodeCount + 1));
+    if (*lats == NULL || *lons == NULL || *items == NULL) {
+        free(*lats);
+        free(*lons);
+        free(*items);
+        return -1;
+    }
     
     // Only consider POI nodes
-    for (i = 0; i < graph->nodeCount; i++) {
-        node1 = graph->nodes[i];
-        if (node1 == NULL || node1->data == NULL) continue;
-        poi1 = (poi_data_t*)node1->data;
-        if (poi1->name == NULL) continue;
-        
-        for (j = i + 1; j < graph->nodeCount; j++) {
-            node2 = graph->nodes[j];
-            if (node2 == NULL || node2->data == NULL) continue;
-            poi2 = (poi_data_t*)node2->data;
-            if (poi2->name == NULL) continue;
-            
-            dist = calculateDistance(poi1->latitude, poi1->longitude, poi2->latitude, poi2->longitude);
-            if (dist > maxDistance) {
-                maxDistance = dist;
-                node1_idx = i;
-                node2_idx = j;
-            }
-        }
+    count = 0;
+    for (i = 0; i < frozen->nodeCount; i++) {
+        poi = (poi_data_t*)frozen->nodeData[i];
+        if (poi == NULL || poi->name == NULL) continue;
+        (*lats)[count] = city->coords->lat[i];
+        (*lons)[count] = city->coords->lon[i];
+        (*items)[count] = i;
+        count++;
+    }
+    return count;
+}
+
+/**
+ * Find the diameter (maximum distance between any two POIs).
+ * Uses the convex hull engine unless -exact asked for the O(n^2) scan;
+ * both give the same pair.
+ */
+void findDiameter(city_t *city) {
+    double *lats;
+    double *lons;
+    int *items;
+    int count;
+    int first;
+    int second;
+    int found;
+    double maxDistance;
+    
+    count = collectPois(city, &lats, &lons, &items);
+    if (count < 0) {
+        fprintf(city->err, "Error: Out of memory\n");
+        return;
+    }
+    
+    if (city->exactDiameter) {
+        found = findDiameterExact(lats, lons, count, &first, &second, &maxDistance);
+    }
+    else {
+        found = findDiameterHull(lats, lons, count, &first, &second, &maxDistance);
     }
     
-    if (node1_idx != -1 && node2_idx != -1) {
-        poi1 = (poi_data_t*)graph->nodes[node1_idx]->data;
-        poi2 = (poi_data_t*)graph->nodes[node2_idx]->data;
-        printf("%.4f %.4f %.4f %.4f %.2f\n", poi1->latitude, poi1->longitude, poi2->latitude, poi2->longitude, maxDistance);
+    if (found > 0) {
+        fprintf(city->out, "%.4f %.4f %.4f %.4f %.2f\n", lats[first], lons[first], lats[second], lons[second], maxDistance);
+    }
+    else if (found < 0) {
+        fprintf(city->err, "Error: Out of memory\n");
     }
+    else {
+        fprintf(city->err, "Error: Fewer than two locations\n");
+    }
+    
+    free(lats);
+    free(lons);
+    free(items);
 }
 
 /**
  * Calculate distance between two named locations
  */
-void distanceBetween(graph_t *graph, char *name1, char *name2) {
-    node_t *node1;
-    node_t *node2;
-    poi_data_t *poi1; 
-    poi_data_t *poi2;
+void distanceBetween(city_t *city, char *name1, char *name2) {
+    int idx1;
+    int idx2;
     double dist;
     
-    node1 = findNodeByName(graph, name1);
-    node2 = findNodeByName(graph, name2);
+    idx1 = findNodeByName(city, name1);
+    idx2 = findNodeByName(city, name2);
     
-    if (node1 == NULL || node2 == NULL) {
-        fprintf(stderr, "Error: One or both locations not found\n");
+    if (idx1 == -1 || idx2 == -1) {
+        fprintf(city->err, "Error: One or both locations not found\n");
         return;
     }
     
-    poi1 = (poi_data_t*)node1->data;
-    poi2 = (poi_data_t*)node2->data;
-    
-    dist = calculateDistance(poi1->latitude, poi1->longitude, poi2->latitude, poi2->longitude);
-    printf("%.3f\n", dist);
+    dist = geoStoreDistance(city->coords, idx1, idx2);
+    fprintf(city->out, "%.3f\n", dist);
 }
 
 /**
- * Dijkstra's algorithm implementation
+ * Calculate shortest road distance between two named locations,
+ * with A*, a bidirectional search or a contraction hierarchy instead of
+ * Dijkstra's algorithm when -astar, -bidir or -ch was given (a delta
+ * drops the hierarchy, so -ch falls back to Dijkstra after one)
  */
-double dijkstra(graph_t *graph, int startId, int endId) {
-    double *distances;
-    double minDist;
-    double alt;
-    double result;
+void roadDistance(city_t *city, char *name1, char *name2) {
+    int idx1;
+    int idx2;
 
-    int *visited;
-    int startIdx;
-    int endIdx;
-    int i;
-    int count;
-    int minIdx;
-    int neighborIdx;
-
-    node_t *currentNode;
-    edge_t *edge;  
+    double distance;
+    double started;
     
-    if (graph == NULL || graph->nodeCount == 0) {
-        return -1;
+    started = STATS_ON(city->stats) ? statsClock() : 0;
+    idx1 = findNodeByName(city, name1);
+    idx2 = findNodeByName(city, name2);
+    
+    if (idx1 == -1 || idx2 == -1) {
+        fprintf(city->err, "Error: One or both locations not found\n");
+        return;
     }
     
-    // Allocate arrays
-    distances = (double*)malloc(sizeof(double) * graph->nodeCount);
-    visited = (int*)calloc(graph->nodeCount, sizeof(int));
+    if (city->search == SEARCH_ASTAR) {
+        distance = astar(city->frozen, city->scratch, city->coords, city->astarScale, city->astarOffset, city->frozen->ids[idx1], city->frozen->ids[idx2]);
+    }
+    else if (city->search == SEARCH_BIDIRECTIONAL) {
+        distance = bidirectionalDijkstra(city->frozen, city->scratch, city->frozen->ids[idx1], city->frozen->ids[idx2]);
+    }
+    else if (city->search == SEARCH_CH && city->ch != NULL) {
+        distance = chDijkstra(city->frozen, city->ch, city->scratch, city->frozen->ids[idx1], city->frozen->ids[idx2]);
+    }
+    else {
+        distance = dijkstra(city->frozen, city->scratch, city->frozen->ids[idx1], city->frozen->ids[idx2]);
+    }
+    if (STATS_ON(city->stats)) {
+        recordQuery(city->stats, statsClock() - started, city->scratch->settled, city->scratch->relaxed, distance >= 0);
+    }
     
-    if (distances == NULL || visited == NULL) {
-        free(distances);
-        free(visited);
-        return -1;
+    if (distance < 0) {
+        fprintf(city->err, "Error: No path found between locations\n");
+    } 
+    else {
+        fprintf(city->out, "%.3f\n", distance);
     }
+}
+
+/**
+ * Print the shortest road route between two named locations: the total
+ * distance, the node IDs along it, then one line per street with the
+ * length driven on it. Consecutive edges with the same road name are
+ * merged; names are interned, so comparing pointers is enough.
+ * Always uses Dijkstra's algorithm, whatever -astar, -bidir or -ch say.
+ */
+void printRoute(city_t *city, char *name1, char *name2) {
+    int idx1;
+    int idx2;
+    int *edges;
+    int count;
+    int i;
+    double distance;
+    double length;
+    double started;
+    const char *street;
     
-    for (i = 0; i < graph->nodeCount; i++) {
-        distances[i] = DBL_MAX;
+    started = STATS_ON(city->stats) ? statsClock() : 0;
+    idx1 = findNodeByName(city, name1);
+    idx2 = findNodeByName(city, name2);
+    
+    if (idx1 == -1 || idx2 == -1) {
+        fprintf(city->err, "Error: One or both locations not found\n");
+        return;
     }
     
-    startIdx = -1;
-    for (i = 0; i < graph->nodeCount; i++) {
-        if (graph->nodes[i]->id == startId) {
-            startIdx = i;
-            distances[i] = 0;
-            break;
-        }
+    edges = (int*)malloc(sizeof(int) * (city->frozen->nodeCount + 1));
+    if (edges == NULL || !enableRoutePaths(city->scratch)) {
+        fprintf(city->err, "Error: Out of memory\n");
+        free(edges);
+        return;
     }
     
-    if (startIdx == -1) {
-        free(distances);
-        free(visited);
-        return -1;
+    distance = dijkstra(city->frozen, city->scratch, city->frozen->ids[idx1], city->frozen->ids[idx2]);
+    count = distance < 0 ? -1 : getRoutePath(city->frozen, city->scratch, idx2, edges);
+    if (STATS_ON(city->stats)) {
+        recordQuery(city->stats, statsClock() - started, city->scratch->settled, city->scratch->relaxed, count >= 0);
+    }
+    if (count < 0) {
+        fprintf(city->err, "Error: No path found between locations\n");
+        free(edges);
+        return;
     }
     
-    // Main Dijkstra loop
-    for (count = 0; count < graph->nodeCount; count++) {
-        minDist = DBL_MAX;
-        minIdx = -1;
-        
-        for (i = 0; i < graph->nodeCount; i++) {
-            if (!visited[i] && distances[i] < minDist) {
-                minDist = distances[i];
-                minIdx = i;
-            }
-        }
-        
-        if (minIdx == -1) break;
-        
-        visited[minIdx] = 1;
-        
-        if (graph->nodes[minIdx]->id == endId) {
-            break;
-        }
-        
-        currentNode = graph->nodes[minIdx];
-        
-        edge = currentNode->edges;
-        while (edge != NULL) {
-            neighborIdx = -1;
-            for (i = 0; i < graph->nodeCount; i++) {
-                if (graph->nodes[i] == edge->toNode) {
-                    neighborIdx = i;
-                    break;
-                }
-            }
-            
-            if (neighborIdx != -1 && !visited[neighborIdx]) {
-                alt = distances[minIdx] + edge->weight;
-                if (alt < distances[neighborIdx]) {
-                    distances[neighborIdx] = alt;
-                }
-            }
-            
-            edge = edge->next;
-        }
+    fprintf(city->out, "%.3f\n", distance);
+    fprintf(city->out, "%d", city->frozen->ids[idx1]);
+    for (i = 0; i < count; i++) {
+        fprintf(city->out, " %d", city->frozen->ids[city->frozen->colIndices[edges[i]]]);
     }
+    fputc('\n', city->out);
     
-    result = DBL_MAX;
-    for (i = 0; i < graph->nodeCount; i++) {
-        if (graph->nodes[i]->id == endId) {
-            result = distances[i];
-            break;
+    i = 0;
+    while (i < count) {
+        street = (const char*)city->frozen->edgeData[edges[i]];
+        length = 0;
+        for (; i < count && (const char*)city->frozen->edgeData[edges[i]] == street; i++) {
+            length += city->frozen->weights[edges[i]];
         }
+        fprintf(city->out, "%.3f %s\n", length, street != NULL && street[0] != '\0' ? street : "(unnamed)");
     }
     
-    free(distances);
-    free(visited);
+    free(edges);
+}
+
+/**
+ * Helper function to parse a coordinate or distance argument.
+ * Returns 1 if the whole string is a finite number within [min, max].
+ */
+static int parseNumber(char *text, double min, double max, double *value) {
+    char *end;
     
-    return (result == DBL_MAX) ? -1 : result;
+    *value = strtod(text, &end);
+    return end != text && *end == '\0' && isfinite(*value) && *value >= min && *value <= max;
 }
 
 /**
- * Calculate shortest road distance between two named locations
+ * Helper function to build the spatial index over named POIs on first use
  */
-void roadDistance(graph_t *graph, char *name1, char *name2) {
-    node_t *node1;
-    node_t *node2;
+static int ensureSpatialIndex(city_t *city) {
+    double *lats;
+    double *lons;
+    int *items;
+    int count;
+    
+    if (city->spatial != NULL) {
+        return 1;
+    }
+    
+    count = collectPois(city, &lats, &lons, &items);
+    if (count < 0) {
+        return 0;
+    }
+    city->spatial = createSpatialIndex(lats, lons, items, count);
+    
+    free(lats);
+    free(lons);
+    free(items);
+    return city->spatial != NULL;
+}
 
-    double distance;
+/**
+ * Helper function to print one spatial query hit
+ */
+static void printHit(city_t *city, int idx, double dist) {
+    poi_data_t *poi;
     
-    node1 = findNodeByName(graph, name1);
-    node2 = findNodeByName(graph, name2);
+    poi = (poi_data_t*)city->frozen->nodeData[idx];
+    fprintf(city->out, "%.3f %.4f %.4f %s\n", dist, city->coords->lat[idx], city->coords->lon[idx], poi->name);
+}
+
+/**
+ * Find and print the k POIs closest to a point, nearest first
+ */
+void nearestLocations(city_t *city, char *latText, char *lonText, int k) {
+    spatial_hit_t *hits;
+    double lat;
+    double lon;
+    int count;
+    int idx;
+    int i;
     
-    if (node1 == NULL || node2 == NULL) {
-        fprintf(stderr, "Error: One or both locations not found\n");
+    if (!parseNumber(latText, -90, 90, &lat) || !parseNumber(lonText, -180, 180, &lon)) {
+        fprintf(city->err, "Error: Invalid coordinates '%s' '%s'\n", latText, lonText);
+        return;
+    }
+    if (!ensureSpatialIndex(city)) {
+        fprintf(city->err, "Error: Out of memory\n");
         return;
     }
     
-    distance = dijkstra(graph, node1->id, node2->id);
+    if (k > city->spatial->count) {
+        k = city->spatial->count;
+    }
+    hits = (spatial_hit_t*)malloc(sizeof(spatial_hit_t) * (k + 1));
+    if (hits == NULL) {
+        fprintf(city->err, "Error: Out of memory\n");
+        return;
+    }
     
-    if (distance < 0) {
-        fprintf(stderr, "Error: No path found between locations\n");
-    } 
-    else {
-        printf("%.3f\n", distance);
+    count = findNearest(city->spatial, lat, lon, k, hits);
+    for (i = 0; i < count; i++) {
+        idx = hits[i].item;
+        printHit(city, idx, calculateDistance(lat, lon, city->coords->lat[idx], city->coords->lon[idx]));
     }
+    free(hits);
 }
 
 /**
- * Main function
+ * Find and print every POI within a radius of a point, nearest first
  */
-int main(int argc, char *argv[]) {
-    char *filename;
-    graph_t *graph;
+void locationsWithin(city_t *city, char *latText, char *lonText, char *metersText) {
+    spatial_hit_t *hits;
+    double lat;
+    double lon;
+    double meters;
+    double dist;
+    int count;
+    int idx;
     int i;
     
-    // Check for no arguments
-    if (argc == 1) {
-        printUsage(argv[0]);
-        return 0;
+    if (!parseNumber(latText, -90, 90, &lat) || !parseNumber(lonText, -180, 180, &lon)) {
+        fprintf(city->err, "Error: Invalid coordinates '%s' '%s'\n", latText, lonText);
+        return;
+    }
+    if (!parseNumber(metersText, 0, DBL_MAX, &meters)) {
+        fprintf(city->err, "Error: Invalid distance '%s'\n", metersText);
+        return;
+    }
+    if (!ensureSpatialIndex(city)) {
+        fprintf(city->err, "Error: Out of memory\n");
+        return;
     }
     
-    filename = NULL;
-    for (i = 1; i < argc - 1; i++) {
-        if (strcmp(argv[i], "-f") == 0) {
-            filename = argv[i + 1];
-            break;
+    hits = findWithin(city->spatial, lat, lon, meters, &count);
+    // The index widens the radius slightly, so cut off with the Haversine distance
+    for (i = 0; i < count; i++) {
+        idx = hits[i].item;
+        dist = calculateDistance(lat, lon, city->coords->lat[idx], city->coords->lon[idx]);
+        if (dist <= meters) {
+            printHit(city, idx, dist);
         }
     }
+    free(hits);
+}
+
+/**
+ * Print every node within a road distance of a named location, nearest
+ * first, one "id lat lon distance" line each, as the search settles it.
+ * Nodes without coordinates (roads that end at an ID no POI or road
+ * starts from) cannot be placed on a map and are left out.
+ */
+void reachableFrom(city_t *city, char *name, char *metersText) {
+    double meters;
+    int start;
+    int idx;
     
-    if (filename == NULL) {
-        fprintf(stderr, "Error: -f <filename> is required\n");
-        printUsage(argv[0]);
-        return 1;
+    start = findNodeByName(city, name);
+    if (start == -1) {
+        fprintf(city->err, "Error: Location '%s' not found\n", name);
+        return;
     }
-    
-    graph = loadFileGraph(filename);
-    if (graph == NULL) {
-        return 1;
+    if (!parseNumber(metersText, 0, DBL_MAX, &meters)) {
+        fprintf(city->err, "Error: Invalid distance '%s'\n", metersText);
+        return;
     }
     
-    // Process other parameters IN ORDER THEY APPEAR
-    for (i = 1; i < argc; i++) {
-        if (strcmp(argv[i], "-f") == 0) {
-            i++;
-        } 
-        else if (strcmp(argv[i], "-location") == 0) {
-            if (i + 1 < argc) {
-                findLocation(graph, argv[i + 1]);
-                i++;
-            } 
-            else {
-                fprintf(stderr, "Error: -location requires a location name\n");
-            }
-        } 
-        else if (strcmp(argv[i], "-diameter") == 0) {
-            findDiameter(graph);
-        } 
-        else if (strcmp(argv[i], "-distance") == 0) {
-            if (i + 2 < argc) {
-                distanceBetween(graph, argv[i + 1], argv[i + 2]);
-                i += 2;
-            } 
-            else {
-                fprintf(stderr, "Error: -distance requires two location names\n");
-            }
-        } 
-        else if (strcmp(argv[i], "-roaddist") == 0) {
-            if (i + 2 < argc) {
-                roadDistance(graph, argv[i + 1], argv[i + 2]);
-                i += 2;
-            } 
-            else {
-                fprintf(stderr, "Error: -roaddist requires two location names\n");
-            }
+    startReach(city->frozen, city->scratch, start);
+    while ((idx = nextReach(city->frozen, city->scratch, meters)) >= 0) {
+        if (hasGeoPoint(city->coords, idx)) {
+            fprintf(city->out, "%d %.6f %.6f %.3f\n", city->frozen->ids[idx], city->coords->lat[idx],
+                    city->coords->lon[idx], city->scratch->dist[idx]);
         }
     }
+    if (idx == -2) {
+        fprintf(city->err, "Error: Out of memory\n");
+    }
+}
+
+/**
+ * Load a city from a TSV file and build its snapshot and name index.
+ * If stats is not NULL, the city records into it and the load phases
+ * are timed.
+ * Returns 1 on success, 0 on failure (a message is printed).
+ */
+int loadCity(city_t *city, char *filename, run_stats_t *stats) {
+    double mark;
     
-    freeGraphWithData(graph);
+    memset(city, 0, sizeof(city_t));
     
-    return 0;
-}
\ No newline at end of file
+    city->roadNames = createNameIndex();
+    city->coords = createGeoStore(0);
+    city->graph = city->roadNames && city->coords ? loadFileGraph(filename, city->roadNames, city->coords, stats) : NULL;
+    if (city->graph == NULL) {
+        closeCity(city);
+        return 0;
+    }
+    city->stats = stats;
+    
+    // The graph is not modified after loading, so queries run on a CSR snapshot
+    mark = STATS_ON(stats) ? statsClock() : 0;
+    city->frozen = freezeGraph(city->graph);
+    STATS_LAP(stats, STATS_SNAPSHOT, mark);
+    city->names = buildNameIndex(city->graph);
+    STATS_LAP(stats, STATS_NAME_INDEX, mark);
+    if (city->frozen == NULL || city->names == NULL) {
+        fprintf(stderr, "Error: Out of memory\n");
+        closeCity(city);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Load a city from a graph file written by -compile.
+ * The snapshot and name index point into the mapped file, so there is
+ * no graph_t; queries only use city->frozen and city->names.
+ * If stats is not NULL, the city records into it and the whole load is
+ * timed as the open phase.
+ * Returns 1 on success, 0 on failure (a message is printed).
+ */
+int loadCityCache(city_t *city, char *filename, run_stats_t *stats) {
+    int i;
+    double mark;
+    
+    memset(city, 0, sizeof(city_t));
+    
+    mark = STATS_ON(stats) ? statsClock() : 0;
+    city->cache = openGraphCache(filename);
+    if (city->cache == NULL) {
+        return 0;
+    }
+    city->frozen = &city->cache->frozen;
+    city->names = city->cache->names;
+    
+    // Nodes without a record in the file keep NAN coordinates
+    city->coords = createGeoStore(city->frozen->nodeCount);
+    if (city->coords == NULL || !resizeGeoStore(city->coords, city->frozen->nodeCount)) {
+        fprintf(stderr, "Error: Out of memory\n");
+        closeCity(city);
+        return 0;
+    }
+    for (i = 0; i < city->frozen->nodeCount; i++) {
+        if (city->frozen->nodeData[i] != NULL) {
+            setGeoPoint(city->coords, i, city->cache->latitudes[i], city->cache->longitudes[i]);
+        }
+    }
+    STATS_LAP(stats, STATS_OPEN, mark);
+    city->stats = stats;
+    return 1;
+}
+
+/**
+ * Free everything loadCity() or loadCityCache() created, and the scratch
+ */
+void closeCity(city_t *city) {
+    freeRouteScratch(city->scratch);
+    freeContractionHierarchy(city->ch);
+    freeSpatialIndex(city->spatial);
+    freeGeoStore(city->coords);
+    if (city->cache != NULL) {
+        closeGraphCache(city->cache);
+    }
+    else {
+        freeNameIndex(city->names);
+        freeFrozenGraph(city->frozen);
+        freeGraphWithData(city->graph);
+        freeNameIndex(city->roadNames);
+    }
+    memset(city, 0, sizeof(city_t));
+}
+
+/**
+ * Map the contraction hierarchy saved next to the source file, or build
+ * it and save it there if it is missing or was built for other data.
+ * Returns 1 on success, 0 if it cannot be built.
+ */
+int loadHierarchy(city_t *city, char *sourceFile) {
+    size_t len;
+    char *chFile;
+    
+    len = strlen(sourceFile);
+    chFile = (char *)malloc(len + 4);
+    if (chFile == NULL) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return 0;
+    }
+    memcpy(chFile, sourceFile, len);
+    memcpy(chFile + len, ".ch", 4);
+    
+    city->ch = openContractionHierarchy(chFile, city->frozen);
+    if (city->ch == NULL) {
+        city->ch = buildContractionHierarchy(city->frozen);
+        if (city->ch == NULL) {
+            fprintf(stderr, "Error: Out of memory\n");
+            free(chFile);
+            return 0;
+        }
+        // Queries still work from memory if the directory is read-only
+        if (!writeContractionHierarchy(chFile, city->ch, city->frozen)) {
+            fprintf(stderr, "Warning: Cannot write file %s\n", chFile);
+        }
+    }
+    
+    free(chFile);
+    return 1;
+}
+
+/**
+ * Helper function to rebuild the snapshot, node coordinates and route
+ * scratch after nodes or edges were added or removed, with the reverse
+ * rows -bidir needs.
+ * Returns 1 on success, 0 if memory allocation fails (the city is unchanged).
+ */
+static int refreshSnapshot(city_t *city) {
+    frozen_graph_t *frozen;
+    geo_store_t *coords;
+    route_scratch_t *scratch;
+    poi_data_t *poi;
+    int count;
+    int i;
+    
+    // Only the snapshot refers to the graph by slot, so this is the place
+    // to reclaim the slots of removed nodes; the numbering is the same
+    compactGraph(city->graph);
+    frozen = freezeGraph(city->graph);
+    count = frozen != NULL ? frozen->nodeCount : 0;
+    coords = createGeoStore(count);
+    scratch = createRouteScratch(count, city->scratch->kind);
+    if (frozen == NULL || coords == NULL || scratch == NULL || !resizeGeoStore(coords, count) ||
+        (city->search == SEARCH_BIDIRECTIONAL && !addReverseRows(frozen))) {
+        freeFrozenGraph(frozen);
+        freeGeoStore(coords);
+        freeRouteScratch(scratch);
+        return 0;
+    }
+    
+    // Nodes only seen as a road's destination keep NAN coordinates
+    for (i = 0; i < count; i++) {
+        poi = (poi_data_t*)frozen->nodeData[i];
+        if (poi != NULL) {
+            setGeoPoint(coords, i, poi->latitude, poi->longitude);
+        }
+    }
+    
+    freeFrozenGraph(city->frozen);
+    freeGeoStore(city->coords);
+    freeRouteScratch(city->scratch);
+    city->frozen = frozen;
+    city->coords = coords;
+    city->scratch = scratch;
+    return 1;
+}
+
+/**
+ * Helper function to rebuild a snapshot that deltas left stale, and the
+ * A* scale computed from it, before the next command that reads it.
+ * Returns 1 if the snapshot is current, 0 if memory allocation fails
+ * (it stays stale).
+ */
+static int syncSnapshot(city_t *city) {
+    if (!city->stale) {
+        return 1;
+    }
+    if (!refreshSnapshot(city)) {
+        return 0;
+    }
+    city->stale = 0;
+    if (city->search == SEARCH_ASTAR) {
+        city->astarScale = astarScale(city->frozen, city->coords, &city->astarOffset);
+    }
+    return 1;
+}
+
+/**
+ * Apply a delta file to a city loaded with -f and bring everything
+ * derived from the graph up to date, then print how many changes were
+ * applied (or one error line).
+ * The POI name index is updated entry by entry. Closed and reweighted
+ * roads are patched into the snapshot in place; adding or removing
+ * nodes or roads only marks it stale, so it is rebuilt from the graph
+ * once before the next command that is not a delta, however many
+ * deltas came first. The spatial index is dropped if POIs changed (the next
+ * -nearest/-within rebuilds it) and the A* scale is recomputed. A
+ * contraction hierarchy is dropped rather than rebuilt, since building
+ * one takes far longer than a delta; -roaddist uses Dijkstra after that.
+ */
+void applyCityDelta(city_t *city, char *filename) {
+    delta_log_t log;
+    delta_change_t *change;
+    int result;
+    int applied;
+    int rebuild;
+    int poisChanged;
+    int ok;
+    int i;
+    
+    if (city->graph == NULL) {
+        fprintf(city->err, "Error: Deltas can only be applied to a city loaded with -f\n");
+        return;
+    }
+    
+    memset(&log, 0, sizeof(log));
+    result = applyDelta(city->graph, filename, city->roadNames, &log);
+    applied = log.count;
+    
+    rebuild = result == -2;
+    poisChanged = 0;
+    ok = 1;
+    for (i = 0; i < log.count; i++) {
+        change = &log.changes[i];
+        if (change->kind == DELTA_ADD_POI) {
+            ok = addNameId(city->names, change->name, change->fromId) && ok;
+        }
+        else if (change->kind == DELTA_REMOVE_POI && change->name != NULL) {
+            removeNameId(city->names, change->name, change->fromId);
+        }
+        if (change->kind == DELTA_ADD_POI || change->kind == DELTA_REMOVE_POI || change->kind == DELTA_ADD_ROAD) {
+            rebuild = 1;
+            poisChanged = poisChanged || change->kind != DELTA_ADD_ROAD;
+        }
+    }
+    
+    if (applied > 0 || result == -2) {
+        // A stale snapshot is rebuilt with these changes, so it is not patched
+        if (rebuild || city->stale) {
+            city->stale = 1;
+        }
+        else {
+            for (i = 0; i < log.count; i++) {
+                change = &log.changes[i];
+                setFrozenWeight(city->frozen, change->fromId, change->toId,
+                                change->kind == DELTA_REMOVE_ROAD ? INFINITY : (float)change->weight);
+            }
+            if (city->search == SEARCH_ASTAR) {
+                city->astarScale = astarScale(city->frozen, city->coords, &city->astarOffset);
+            }
+        }
+        if (poisChanged) {
+            freeSpatialIndex(city->spatial);
+            city->spatial = NULL;
+        }
+        freeContractionHierarchy(city->ch);
+        city->ch = NULL;
+    }
+    freeDeltaLog(&log);
+    
+    if (result == -1) {
+        fprintf(city->err, "Error: Cannot open file %s\n", filename);
+    }
+    else if (result == -2 || !ok) {
+        fprintf(city->err, "Error: Out of memory\n");
+    }
+    else if (result > 0) {
+        fprintf(city->err, "Error: Invalid delta at line %d of %s (%d earlier changes applied)\n", result, filename, applied);
+    }
+    else {
+        fprintf(city->out, "Applied %d changes\n", applied);
+    }
+}
+
+/**
+ * Run one -serve command and write exactly one result or error line.
+ * The command word ends at the first space or tab and its arguments
+ * are separated by tabs, so names may contain spaces.
+ */
+void runCommand(city_t *city, char *line) {
+    char *command;
+    char *args[MAX_COMMAND_ARGS + 1];
+    int argCount;
+    char *p;
+    size_t len;
+    
+    len = strlen(line);
+    if (len > 0 && line[len - 1] == '\r') {
+        line[len - 1] = '\0';
+    }
+    
+    command = line;
+    argCount = 0;
+    p = line + strcspn(line, " \t");
+    if (*p != '\0') {
+        *p = '\0';
+        p++;
+        // One extra slot so a command with too many arguments is rejected
+        while (argCount <= MAX_COMMAND_ARGS) {
+            args[argCount++] = p;
+            p = strchr(p, '\t');
+            if (p == NULL) {
+                break;
+            }
+            *p = '\0';
+            p++;
+        }
+    }
+    
+    if (strcmp(command, "delta") != 0 && !syncSnapshot(city)) {
+        fprintf(city->err, "Error: Out of memory\n");
+    }
+    else if (strcmp(command, "location") == 0) {
+        if (argCount == 1) {
+            findLocation(city, args[0]);
+        }
+        else {
+            fprintf(city->err, "Error: location requires a location name\n");
+        }
+    }
+    else if (strcmp(command, "diameter") == 0) {
+        if (argCount == 0) {
+            findDiameter(city);
+        }
+        else {
+            fprintf(city->err, "Error: diameter takes no arguments\n");
+        }
+    }
+    else if (strcmp(command, "distance") == 0) {
+        if (argCount == 2) {
+            distanceBetween(city, args[0], args[1]);
+        }
+        else {
+            fprintf(city->err, "Error: distance requires two tab-separated location names\n");
+        }
+    }
+    else if (strcmp(command, "roaddist") == 0) {
+        if (argCount == 2) {
+            roadDistance(city, args[0], args[1]);
+        }
+        else {
+            fprintf(city->err, "Error: roaddist requires two tab-separated location names\n");
+        }
+    }
+    else if (strcmp(command, "delta") == 0) {
+        if (argCount == 1) {
+            applyCityDelta(city, args[0]);
+        }
+        else {
+            fprintf(city->err, "Error: delta requires a delta file\n");
+        }
+    }
+    else {
+        fprintf(city->err, "Error: Unknown command '%s'\n", command);
+    }
+}
+
+/**
+ * Answer newline-delimited commands read from fd until end of input.
+ * Blank lines are ignored. Results are flushed once every complete line
+ * in the buffer has been answered, so a client pipelining many commands
+ * gets them back in a few writes instead of one per line.
+ * Returns 1 at end of input, 0 on a read or memory error.
+ */
+int serveStream(city_t *city, int fd) {
+    char *buf;
+    char *newBuf;
+    char *newline;
+    size_t space;
+    size_t used;
+    size_t start;
+    ssize_t n;
+    int ok;
+    
+    space = SERVE_BUFFER_SIZE;
+    used = 0;
+    ok = 1;
+    buf = (char*)malloc(space + 1);
+    if (buf == NULL) {
+        return 0;
+    }
+    
+    while (1) {
+        // A line longer than the buffer doubles it
+        if (used == space) {
+            newBuf = (char*)realloc(buf, space * 2 + 1);
+            if (newBuf == NULL) {
+                ok = 0;
+                break;
+            }
+            buf = newBuf;
+            space *= 2;
+        }
+        
+        n = read(fd, buf + used, space - used);
+        if (n < 0) {
+            if (errno == EINTR && !stopRequested) {
+                continue;
+            }
+            ok = stopRequested ? 1 : 0;
+            break;
+        }
+        if (n == 0) {
+            break;
+        }
+        used += (size_t)n;
+        
+        start = 0;
+        while ((newline = (char*)memchr(buf + start, '\n', used - start)) != NULL) {
+            *newline = '\0';
+            if (buf[start] != '\0' && strcmp(buf + start, "\r") != 0) {
+                runCommand(city, buf + start);
+            }
+            start = (size_t)(newline - buf) + 1;
+        }
+        memmove(buf, buf + start, used - start);
+        used -= start;
+        fflush(city->out);
+    }
+    
+    // The last command may not end with a newline
+    if (ok && used > 0) {
+        buf[used] = '\0';
+        runCommand(city, buf);
+    }
+    fflush(city->out);
+    free(buf);
+    return ok;
+}
+
+/**
+ * Signal handler that asks a socket server to stop
+ */
+static void requestStop(int sig) {
+    (void)sig;
+    stopRequested = 1;
+}
+
+/**
+ * Listen on a UNIX domain socket and serve one client at a time until
+ * SIGINT or SIGTERM. Each client's results and errors go back over its
+ * connection. The socket file is removed on exit.
+ * Returns 1 on a clean stop, 0 if the socket cannot be set up.
+ */
+int serveSocket(city_t *city, char *path) {
+    struct sockaddr_un addr;
+    struct sigaction action;
+    struct stat st;
+    FILE *out;
+    int listenFd;
+    int conn;
+    
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Error: Socket path too long: %s\n", path);
+        return 0;
+    }
+    
+    // Replace a socket left by an earlier run, but never another kind of file
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        unlink(path);
+    }
+    
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    
+    listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd == -1 || bind(listenFd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(listenFd, 16) != 0) {
+        fprintf(stderr, "Error: Cannot listen on %s: %s\n", path, strerror(errno));
+        if (listenFd != -1) {
+            close(listenFd);
+        }
+        return 0;
+    }
+    
+    // No SA_RESTART, so a signal interrupts accept() and read()
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = requestStop;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    // A client that disconnects early must not kill the server
+    signal(SIGPIPE, SIG_IGN);
+    
+    while (!stopRequested) {
+        conn = accept(listenFd, NULL, NULL);
+        if (conn == -1) {
+            if (errno != EINTR && errno != ECONNABORTED) {
+                fprintf(stderr, "Error: accept failed: %s\n", strerror(errno));
+                break;
+            }
+            continue;
+        }
+        
+        out = fdopen(dup(conn), "w");
+        if (out != NULL) {
+            city->out = out;
+            city->err = out;
+            serveStream(city, conn);
+            fclose(out);
+        }
+        close(conn);
+    }
+    
+    city->out = stdout;
+    city->err = stderr;
+    close(listenFd);
+    unlink(path);
+    return 1;
+}
+
+/**
+ * Helper function to give a -batch worker the next block of commands.
+ * Returns the block number, or -1 when every block has been claimed.
+ */
+static int claimBlock(batch_t *batch) {
+    int block;
+    
+    pthread_mutex_lock(&batch->lock);
+    block = batch->nextBlock < batch->blockCount ? batch->nextBlock++ : -1;
+    pthread_mutex_unlock(&batch->lock);
+    return block;
+}
+
+/**
+ * -batch worker. Queries only read the snapshot and name index, so each
+ * worker works on a copy of the city with its own route scratch and
+ * writes each block's results to a separate memory buffer. With -stats
+ * each worker also records into its own statistics, merged at the end.
+ */
+static void* batchWorker(void *arg) {
+    batch_t *batch;
+    city_t local;
+    FILE *out;
+    int block;
+    int end;
+    int i;
+    
+    batch = (batch_t*)arg;
+    local = *batch->city;
+    local.scratch = createRouteScratch(local.frozen->nodeCount, batch->heapKind);
+    local.stats = STATS_ON(batch->city->stats) ? createStats() : NULL;
+    if (local.scratch == NULL || (STATS_ON(batch->city->stats) && local.stats == NULL)) {
+        freeRouteScratch(local.scratch);
+        batch->failed = 1;
+        return NULL;
+    }
+    
+    while ((block = claimBlock(batch)) != -1) {
+        out = open_memstream(&batch->blockOutput[block], &batch->blockLength[block]);
+        if (out == NULL) {
+            batch->failed = 1;
+            break;
+        }
+        local.out = out;
+        local.err = out;
+        
+        end = (block + 1) * BATCH_BLOCK_SIZE;
+        if (end > batch->lineCount) {
+            end = batch->lineCount;
+        }
+        for (i = block * BATCH_BLOCK_SIZE; i < end; i++) {
+            runCommand(&local, batch->lines[i]);
+        }
+        fclose(out);
+    }
+    
+    if (STATS_ON(local.stats)) {
+        pthread_mutex_lock(&batch->lock);
+        mergeStats(batch->city->stats, local.stats);
+        pthread_mutex_unlock(&batch->lock);
+        freeStats(local.stats);
+    }
+    freeRouteScratch(local.scratch);
+    return NULL;
+}
+
+/**
+ * Helper function to read a whole file into one null-terminated buffer.
+ * Returns the buffer, or NULL if the file cannot be read.
+ */
+static char* readWholeFile(char *filename) {
+    FILE *file;
+    char *buf;
+    char *newBuf;
+    size_t space;
+    size_t used;
+    size_t n;
+    
+    file = fopen(filename, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+    
+    space = SERVE_BUFFER_SIZE;
+    used = 0;
+    buf = (char*)malloc(space + 1);
+    while (buf != NULL && (n = fread(buf + used, 1, space - used, file)) > 0) {
+        used += n;
+        if (used == space) {
+            newBuf = (char*)realloc(buf, space * 2 + 1);
+            if (newBuf == NULL) {
+                free(buf);
+                buf = NULL;
+                break;
+            }
+            buf = newBuf;
+            space *= 2;
+        }
+    }
+    if (buf != NULL) {
+        if (ferror(file)) {
+            free(buf);
+            buf = NULL;
+        }
+        else {
+            buf[used] = '\0';
+        }
+    }
+    fclose(file);
+    return buf;
+}
+
+/**
+ * Helper function to split a buffer from readWholeFile() into lines in
+ * place, skipping blank ones like -serve does.
+ * Returns the array of lines, or NULL if memory allocation fails.
+ */
+static char** splitLines(char *text, int *lineCount) {
+    char **lines;
+    char **newLines;
+    char *p;
+    char *newline;
+    int lineSpace;
+    
+    lineSpace = 1024;
+    *lineCount = 0;
+    lines = (char**)malloc(sizeof(char*) * lineSpace);
+    if (lines == NULL) {
+        return NULL;
+    }
+    for (p = text; *p != '\0'; p = newline + 1) {
+        newline = strchr(p, '\n');
+        if (newline == NULL) {
+            newline = p + strlen(p) - 1;
+        }
+        else {
+            *newline = '\0';
+        }
+        if (*p == '\0' || strcmp(p, "\r") == 0) {
+            continue;
+        }
+        if (*lineCount == lineSpace) {
+            lineSpace *= 2;
+            newLines = (char**)realloc(lines, sizeof(char*) * lineSpace);
+            if (newLines == NULL) {
+                free(lines);
+                return NULL;
+            }
+            lines = newLines;
+        }
+        lines[(*lineCount)++] = p;
+    }
+    return lines;
+}
+
+/**
+ * Helper function to run batch->lineCount commands from batch->lines on
+ * a pool of threads and print one line per command in input order.
+ * Blocks of BATCH_BLOCK_SIZE commands are claimed dynamically so slow
+ * and fast queries even out across workers; results are kept per block
+ * and written once every worker has finished.
+ * Returns 1 on success, 0 if memory allocation fails.
+ */
+static int runBatchLines(batch_t *batch, int threadCount) {
+    pthread_t *threads;
+    int started;
+    int i;
+    
+    batch->nextBlock = 0;
+    batch->blockCount = (batch->lineCount + BATCH_BLOCK_SIZE - 1) / BATCH_BLOCK_SIZE;
+    batch->blockOutput = (char**)calloc(batch->blockCount + 1, sizeof(char*));
+    batch->blockLength = (size_t*)calloc(batch->blockCount + 1, sizeof(size_t));
+    if (threadCount > batch->blockCount) {
+        threadCount = batch->blockCount > 0 ? batch->blockCount : 1;
+    }
+    threads = (pthread_t*)malloc(sizeof(pthread_t) * threadCount);
+    if (batch->blockOutput == NULL || batch->blockLength == NULL || threads == NULL) {
+        free(threads);
+        free(batch->blockOutput);
+        free(batch->blockLength);
+        return 0;
+    }
+    
+    // The calling thread is the first worker
+    started = 0;
+    for (i = 1; i < threadCount; i++) {
+        if (pthread_create(&threads[i], NULL, batchWorker, batch) != 0) {
+            break;
+        }
+        started++;
+    }
+    batchWorker(batch);
+    for (i = 1; i <= started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    
+    if (!batch->failed) {
+        for (i = 0; i < batch->blockCount; i++) {
+            fwrite(batch->blockOutput[i], 1, batch->blockLength[i], batch->city->out);
+        }
+    }
+    
+    for (i = 0; i < batch->blockCount; i++) {
+        free(batch->blockOutput[i]);
+    }
+    free(threads);
+    free(batch->blockOutput);
+    free(batch->blockLength);
+    return !batch->failed;
+}
+
+/**
+ * Helper function to check whether a command is "delta", which changes
+ * the city and so cannot run alongside other commands.
+ */
+static int isDeltaCommand(char *line) {
+    return strncmp(line, "delta", 5) == 0 && (line[5] == '\0' || line[5] == ' ' || line[5] == '\t');
+}
+
+/**
+ * Run every command in a file (one per line, as for -serve) on a pool
+ * of threads and print one line per command in input order.
+ * The commands between two delta commands run in parallel; each delta
+ * runs alone on the calling thread once everything before it is done,
+ * so every command sees the same city it would in -serve.
+ * Returns 1 on success, 0 on failure (a message is printed).
+ */
+int runBatch(city_t *city, char *filename, int threadCount, heap_kind_t heapKind) {
+    batch_t batch;
+    FILE *err;
+    char *text;
+    char **lines;
+    int lineCount;
+    int first;
+    int last;
+    int ok;
+    
+    text = readWholeFile(filename);
+    if (text == NULL) {
+        fprintf(stderr, "Error: Cannot open file %s\n", filename);
+        return 0;
+    }
+    
+    lines = splitLines(text, &lineCount);
+    if (lines == NULL) {
+        fprintf(stderr, "Error: Out of memory\n");
+        free(text);
+        return 0;
+    }
+    
+    memset(&batch, 0, sizeof(batch));
+    batch.city = city;
+    batch.heapKind = heapKind;
+    pthread_mutex_init(&batch.lock, NULL);
+    
+    ok = 1;
+    first = 0;
+    while (ok && first < lineCount) {
+        last = first;
+        while (last < lineCount && !isDeltaCommand(lines[last])) {
+            last++;
+        }
+        
+        batch.lines = lines + first;
+        batch.lineCount = last - first;
+        // Workers share the snapshot, so one stale from a delta is rebuilt first
+        ok = batch.lineCount == 0 || (syncSnapshot(city) && runBatchLines(&batch, threadCount));
+        // Like every other command, a delta answers with one line of output
+        if (ok && last < lineCount) {
+            err = city->err;
+            city->err = city->out;
+            runCommand(city, lines[last]);
+            city->err = err;
+        }
+        first = last + 1;
+    }
+    pthread_mutex_destroy(&batch.lock);
+    
+    if (!ok) {
+        fprintf(stderr, "Error: Out of memory\n");
+    }
+    free(lines);
+    free(text);
+    return ok;
+}
+
+/**
+ * Helper function to write one CSV field, quoting it if needed.
+ */
+static void writeCsvField(FILE *out, const char *text) {
+    const char *p;
+    
+    if (strpbrk(text, ",\"\r\n") == NULL) {
+        fputs(text, out);
+        return;
+    }
+    fputc('"', out);
+    for (p = text; *p != '\0'; p++) {
+        if (*p == '"') {
+            fputc('"', out);
+        }
+        fputc(*p, out);
+    }
+    fputc('"', out);
+}
+
+/**
+ * Helper function to read a file of location names, one per line, and
+ * look each one up.
+ * Returns the names (pointing into *text), with their dense indices in
+ * *indices, or NULL on failure (a message is printed).
+ */
+static char** readNameList(city_t *city, char *filename, char **text, int **indices, int *count) {
+    char **names;
+    size_t len;
+    int missing;
+    int i;
+    
+    *text = readWholeFile(filename);
+    if (*text == NULL) {
+        fprintf(city->err, "Error: Cannot open file %s\n", filename);
+        return NULL;
+    }
+    names = splitLines(*text, count);
+    *indices = names != NULL ? (int*)malloc(sizeof(int) * (*count + 1)) : NULL;
+    if (*indices == NULL) {
+        fprintf(city->err, "Error: Out of memory\n");
+        free(names);
+        free(*text);
+        return NULL;
+    }
+    
+    missing = 0;
+    for (i = 0; i < *count; i++) {
+        len = strlen(names[i]);
+        if (len > 0 && names[i][len - 1] == '\r') {
+            names[i][len - 1] = '\0';
+        }
+        (*indices)[i] = findNodeByName(city, names[i]);
+        if ((*indices)[i] == -1) {
+            fprintf(city->err, "Error: Location '%s' not found\n", names[i]);
+            missing = 1;
+        }
+    }
+    if (missing) {
+        free(names);
+        free(*indices);
+        free(*text);
+        return NULL;
+    }
+    return names;
+}
+
+/**
+ * Print the road distance from every name in one file to every name in
+ * another as CSV: a header row of targets, then one row per source with
+ * an empty cell where there is no path. Each row is one search that
+ * stops once all of its targets are settled, instead of one per pair.
+ */
+void distanceMatrix(city_t *city, char *sourceFile, char *targetFile) {
+    char *sourceText;
+    char *targetText;
+    char **sources;
+    char **targets;
+    int *sourceIdx;
+    int *targetIdx;
+    int sourceCount;
+    int targetCount;
+    double *row;
+    int i;
+    int j;
+    
+    sources = readNameList(city, sourceFile, &sourceText, &sourceIdx, &sourceCount);
+    if (sources == NULL) {
+        return;
+    }
+    targets = readNameList(city, targetFile, &targetText, &targetIdx, &targetCount);
+    if (targets == NULL) {
+        free(sources);
+        free(sourceIdx);
+        free(sourceText);
+        return;
+    }
+    
+    row = (double*)malloc(sizeof(double) * (targetCount + 1));
+    if (row == NULL) {
+        fprintf(city->err, "Error: Out of memory\n");
+    }
+    else {
+        for (j = 0; j < targetCount; j++) {
+            fputc(',', city->out);
+            writeCsvField(city->out, targets[j]);
+        }
+        fputc('\n', city->out);
+        
+        for (i = 0; i < sourceCount; i++) {
+            if (!dijkstraToMany(city->frozen, city->scratch, sourceIdx[i], targetIdx, targetCount, row)) {
+                fprintf(city->err, "Error: Out of memory\n");
+                break;
+            }
+            writeCsvField(city->out, sources[i]);
+            for (j = 0; j < targetCount; j++) {
+                fputc(',', city->out);
+                if (row[j] >= 0) {
+                    fprintf(city->out, "%.3f", row[j]);
+                }
+            }
+            fputc('\n', city->out);
+        }
+    }
+    
+    free(row);
+    free(sources);
+    free(sourceIdx);
+    free(sourceText);
+    free(targets);
+    free(targetIdx);
+    free(targetText);
+}
+
+// citybench links this file without main()
+#ifndef CITYDATA_NO_MAIN
+/**
+ * Main function
+ */
+int main(int argc, char *argv[]) {
+    char *filename;
+    char *graphFile;
+    char *compileFile;
+    char *outFile;
+    char *socketPath;
+    city_t city;
+    int threadCount;
+    int exactDiameter;
+    search_kind_t search;
+    int reportSettled;
+    int collectStats;
+    run_stats_t *stats;
+    heap_kind_t heapKind;
+    int loaded;
+    int i;
+    
+    // Check for no arguments
+    if (argc == 1) {
+        printUsage(argv[0]);
+        return 0;
+    }
+    
+    filename = NULL;
+    graphFile = NULL;
+    compileFile = NULL;
+    outFile = NULL;
+    socketPath = NULL;
+    exactDiameter = 0;
+    search = SEARCH_DIJKSTRA;
+    reportSettled = 0;
+    collectStats = 0;
+    stats = NULL;
+    threadCount = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threadCount < 1) {
+        threadCount = 1;
+    }
+    heapKind = HEAP_BINARY;
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-exact") == 0) {
+            exactDiameter = 1;
+        }
+        else if (strcmp(argv[i], "-astar") == 0 || strcmp(argv[i], "-bidir") == 0 || strcmp(argv[i], "-ch") == 0) {
+            if (search != SEARCH_DIJKSTRA) {
+                fprintf(stderr, "Error: Only one of -astar, -bidir and -ch can be given\n");
+                return 1;
+            }
+            if (strcmp(argv[i], "-astar") == 0) {
+                search = SEARCH_ASTAR;
+            }
+            else {
+                search = strcmp(argv[i], "-bidir") == 0 ? SEARCH_BIDIRECTIONAL : SEARCH_CH;
+            }
+        }
+        else if (strcmp(argv[i], "-settled") == 0) {
+            reportSettled = 1;
+        }
+        else if (strcmp(argv[i], "-stats") == 0) {
+            collectStats = 1;
+        }
+        else if (i == argc - 1) {
+            break;
+        }
+        else if (strcmp(argv[i], "-f") == 0) {
+            filename = argv[i + 1];
+            i++;
+        }
+        else if (strcmp(argv[i], "-g") == 0) {
+            graphFile = argv[i + 1];
+            i++;
+        }
+        else if (strcmp(argv[i], "-compile") == 0) {
+            compileFile = argv[i + 1];
+            i++;
+        }
+        else if (strcmp(argv[i], "-o") == 0) {
+            outFile = argv[i + 1];
+            i++;
+        }
+        else if (strcmp(argv[i], "-socket") == 0) {
+            socketPath = argv[i + 1];
+            i++;
+        }
+        else if (strcmp(argv[i], "-threads") == 0) {
+            threadCount = atoi(argv[i + 1]);
+            if (threadCount < 1) {
+                fprintf(stderr, "Error: -threads requires a positive number\n");
+                return 1;
+            }
+            i++;
+        }
+        else if (strcmp(argv[i], "-heap") == 0) {
+            if (strcmp(argv[i + 1], "radix") == 0) {
+                heapKind = HEAP_RADIX;
+            }
+            else if (strcmp(argv[i + 1], "binary") != 0) {
+                fprintf(stderr, "Error: Unknown heap '%s'\n", argv[i + 1]);
+                return 1;
+            }
+            i++;
+        }
+    }
+    
+    // Compile mode: parse the TSV once, write the graph file and exit
+    if (compileFile != NULL) {
+        if (outFile == NULL) {
+            fprintf(stderr, "Error: -compile requires -o <graphfile>\n");
+            printUsage(argv[0]);
+            return 1;
+        }
+        if (!loadCity(&city, compileFile, NULL)) {
+            return 1;
+        }
+        if (!writeGraphCache(outFile, city.frozen, city.names)) {
+            fprintf(stderr, "Error: Cannot write file %s\n", outFile);
+            closeCity(&city);
+            return 1;
+        }
+        closeCity(&city);
+        return 0;
+    }
+    
+    if (filename == NULL && graphFile == NULL) {
+        fprintf(stderr, "Error: -f <filename> or -g <graphfile> is required\n");
+        printUsage(argv[0]);
+        return 1;
+    }
+    
+    // Nothing is measured unless asked for, and nothing can be in a NO_STATS build
+    if (collectStats) {
+#ifdef NO_STATS
+        fprintf(stderr, "Warning: -stats is not available in this build (NO_STATS)\n");
+#else
+        stats = createStats();
+        if (stats == NULL) {
+            fprintf(stderr, "Error: Out of memory\n");
+            return 1;
+        }
+#endif
+    }
+    
+    loaded = graphFile != NULL ? loadCityCache(&city, graphFile, stats) : loadCity(&city, filename, stats);
+    if (!loaded) {
+        freeStats(stats);
+        return 1;
+    }
+    
+    city.scratch = createRouteScratch(city.frozen->nodeCount, heapKind);
+    if (city.scratch == NULL) {
+        fprintf(stderr, "Error: Out of memory\n");
+        freeStats(stats);
+        closeCity(&city);
+        return 1;
+    }
+    city.out = stdout;
+    city.err = stderr;
+    city.exactDiameter = exactDiameter;
+    // Checked once against every edge so the estimate never overshoots
+    city.search = search;
+    if (search == SEARCH_ASTAR) {
+        city.astarScale = astarScale(city.frozen, city.coords, &city.astarOffset);
+    }
+    // Built before any -batch workers start, which share the snapshot
+    if (search == SEARCH_BIDIRECTIONAL && !addReverseRows(city.frozen)) {
+        fprintf(stderr, "Error: Out of memory\n");
+        freeStats(stats);
+        closeCity(&city);
+        return 1;
+    }
+    // Saved next to the file it was built from, so later runs skip the build
+    if (search == SEARCH_CH && !loadHierarchy(&city, graphFile != NULL ? graphFile : filename)) {
+        freeStats(stats);
+        closeCity(&city);
+        return 1;
+    }
+    
+    // Process other parameters IN ORDER THEY APPEAR
+    for (i = 1; i < argc; i++) {
+        // Consecutive -delta options leave the snapshot stale until something reads it
+        if (strcmp(argv[i], "-delta") != 0 && !syncSnapshot(&city)) {
+            fprintf(stderr, "Error: Out of memory\n");
+            freeStats(stats);
+            closeCity(&city);
+            return 1;
+        }
+        if (strcmp(argv[i], "-f") == 0 || strcmp(argv[i], "-g") == 0 || strcmp(argv[i], "-heap") == 0 ||
+            strcmp(argv[i], "-compile") == 0 || strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "-socket") == 0 ||
+            strcmp(argv[i], "-threads") == 0) {
+            i++;
+        } 
+        else if (strcmp(argv[i], "-serve") == 0) {
+            // Output already written must not be interleaved with the server's
+            fflush(stdout);
+            if (socketPath != NULL) {
+                if (!serveSocket(&city, socketPath)) {
+                    freeStats(stats);
+                    closeCity(&city);
+                    return 1;
+                }
+            }
+            else {
+                // Errors are answers too, so each command gets one line on stdout
+                city.err = stdout;
+                serveStream(&city, STDIN_FILENO);
+                city.err = stderr;
+            }
+        } 
+        else if (strcmp(argv[i], "-batch") == 0) {
+            if (i + 1 < argc) {
+                fflush(stdout);
+                if (!runBatch(&city, argv[i + 1], threadCount, heapKind)) {
+                    freeStats(stats);
+                    closeCity(&city);
+                    return 1;
+                }
+                i++;
+            } 
+            else {
+                fprintf(stderr, "Error: -batch requires a query file\n");
+            }
+        } 
+        else if (strcmp(argv[i], "-nearest") == 0) {
+            if (i + 2 < argc) {
+                // k is optional, so only a plain positive number is taken as k
+                if (i + 3 < argc && argv[i + 3][0] != '\0' && strspn(argv[i + 3], "0123456789") == strlen(argv[i + 3]) &&
+                    atoi(argv[i + 3]) > 0) {
+                    nearestLocations(&city, argv[i + 1], argv[i + 2], atoi(argv[i + 3]));
+                    i += 3;
+                }
+                else {
+                    nearestLocations(&city, argv[i + 1], argv[i + 2], 1);
+                    i += 2;
+                }
+            } 
+            else {
+                fprintf(stderr, "Error: -nearest requires a latitude and longitude\n");
+            }
+        } 
+        else if (strcmp(argv[i], "-within") == 0) {
+            if (i + 3 < argc) {
+                locationsWithin(&city, argv[i + 1], argv[i + 2], argv[i + 3]);
+                i += 3;
+            } 
+            else {
+                fprintf(stderr, "Error: -within requires a latitude, longitude and distance\n");
+            }
+        } 
+        else if (strcmp(argv[i], "-location") == 0) {
+            if (i + 1 < argc) {
+                findLocation(&city, argv[i + 1]);
+                i++;
+            } 
+            else {
+                fprintf(stderr, "Error: -location requires a location name\n");
+            }
+        } 
+        else if (strcmp(argv[i], "-diameter") == 0) {
+            findDiameter(&city);
+        } 
+        else if (strcmp(argv[i], "-distance") == 0) {
+            if (i + 2 < argc) {
+                distanceBetween(&city, argv[i + 1], argv[i + 2]);
+                i += 2;
+            } 
+            else {
+                fprintf(stderr, "Error: -distance requires two location names\n");
+            }
+        } 
+        else if (strcmp(argv[i], "-roaddist") == 0) {
+            if (i + 2 < argc) {
+                roadDistance(&city, argv[i + 1], argv[i + 2]);
+                if (reportSettled) {
+                    fprintf(stderr, "Settled: %d nodes\n", city.scratch->settled);
+                }
+                i += 2;
+            } 
+            else {
+                fprintf(stderr, "Error: -roaddist requires two location names\n");
+            }
+        }
+        else if (strcmp(argv[i], "-route") == 0) {
+            if (i + 2 < argc) {
+                printRoute(&city, argv[i + 1], argv[i + 2]);
+                i += 2;
+            } 
+            else {
+                fprintf(stderr, "Error: -route requires two location names\n");
+            }
+        }
+        else if (strcmp(argv[i], "-reach") == 0) {
+            if (i + 2 < argc) {
+                reachableFrom(&city, argv[i + 1], argv[i + 2]);
+                i += 2;
+            } 
+            else {
+                fprintf(stderr, "Error: -reach requires a location name and a distance\n");
+            }
+        }
+        else if (strcmp(argv[i], "-delta") == 0) {
+            if (i + 1 < argc) {
+                applyCityDelta(&city, argv[i + 1]);
+                i++;
+            } 
+            else {
+                fprintf(stderr, "Error: -delta requires a delta file\n");
+            }
+        }
+        else if (strcmp(argv[i], "-matrix") == 0) {
+            if (i + 2 < argc) {
+                distanceMatrix(&city, argv[i + 1], argv[i + 2]);
+                i += 2;
+            } 
+            else {
+                fprintf(stderr, "Error: -matrix requires a sources file and a targets file\n");
+            }
+        }
+    }
+    
+    if (STATS_ON(stats)) {
+        // Only a graph loaded with -f has been searched with findNode()
+        if (city.graph != NULL) {
+            stats->findCalls = city.graph->findCalls;
+            stats->findProbes = city.graph->findProbes;
+        }
+        fflush(stdout);
+        printStats(stats, stderr);
+    }
+    freeStats(stats);
+    closeCity(&city);
+    
+    return 0;
+}
+#endif // CITYDATA_NO_MAIN
@@ -0,0 +1,70 @@
+#ifndef CITYDATA_H
+#define CITYDATA_H
+
+#include <stdio.h>
+#include "graph.h"
+#include "route.h"
+#include "names.h"
+#include "gcache.h"
+#include "spatial.h"
+#include "geo.h"
+#include "ch.h"
+#include "stats.h"
+#include "delta.h"
+
+// Search -roaddist runs
+typedef enum {
+    SEARCH_DIJKSTRA,
+    SEARCH_ASTAR,
+    SEARCH_BIDIRECTIONAL,
+    SEARCH_CH
+} search_kind_t;
+
+// Loaded graph together with the read-only structures queries run on.
+// stale is set when a delta added or removed nodes or roads, until the
+// snapshot, coords and scratch are rebuilt from the graph.
+typedef struct {
+    graph_t *graph;
+    frozen_graph_t *frozen;
+    route_scratch_t *scratch;
+    name_index_t *names;
+    name_index_t *roadNames;
+    graph_cache_t *cache;
+    spatial_index_t *spatial;
+    geo_store_t *coords;
+    int exactDiameter;
+    search_kind_t search;
+    double astarScale;
+    double astarOffset;
+    ch_graph_t *ch;
+    int stale;
+    run_stats_t *stats;
+    FILE *out;
+    FILE *err;
+} city_t;
+
+// Function prototypes
+void printUsage(char *programName);
+graph_t* loadFileGraph(char *filename, name_index_t *roadNames, geo_store_t *coords, run_stats_t *stats);
+void findLocation(city_t *city, char *locationName);
+void findDiameter(city_t *city);
+void distanceBetween(city_t *city, char *name1, char *name2);
+void roadDistance(city_t *city, char *name1, char *name2);
+void printRoute(city_t *city, char *name1, char *name2);
+void distanceMatrix(city_t *city, char *sourceFile, char *targetFile);
+void reachableFrom(city_t *city, char *name, char *metersText);
+void nearestLocations(city_t *city, char *latText, char *lonText, int k);
+void locationsWithin(city_t *city, char *latText, char *lonText, char *metersText);
+void freeGraphWithData(graph_t *graph);
+name_index_t* buildNameIndex(graph_t *graph);
+int findNodeByName(city_t *city, char *name);
+int loadCity(city_t *city, char *filename, run_stats_t *stats);
+int loadCityCache(city_t *city, char *filename, run_stats_t *stats);
+void closeCity(city_t *city);
+int loadHierarchy(city_t *city, char *sourceFile);
+void applyCityDelta(city_t *city, char *filename);
+void runCommand(city_t *city, char *line);
+int serveStream(city_t *city, int fd);
+int serveSocket(city_t *city, char *path);
+
+#endif // CITYDATA_H
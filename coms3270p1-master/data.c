@@ -3,8 +3,18 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <limits.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
 
 #define MAX_LINE_LEN 1024 // Maximum length for a line
+#define MAX_NUMBER_LEN 64 // Numbers longer than this are copied to the heap
+#define CHUNKS_PER_THREAD 8 // validateParallel() chunks per thread, so fast threads take more
+#define MIN_CHUNK_SIZE (1 << 20) // Smallest validateParallel() chunk in bytes
 
 /**
  * Helper function to check if a string contains only digits.
@@ -135,4 +145,733 @@ int validate(void) {
 
     // --- 5. ALL CHECKS PASSED ---
     return 0; // 0 indicates a valid file
-}
\ No newline at end of file
+}
+
+// --- Single-pass reader for memory-mapped files ---
+
+/**
+ * Helper function to load an open descriptor into a map_file_t: a
+ * regular file read from its start is mapped, anything else (e.g. a
+ * pipe) is read into one buffer. The descriptor is left open.
+ * @return Pointer to the file, or NULL if it cannot be read.
+ */
+static map_file_t *mapDescriptor(int fd) {
+    struct stat st;
+    map_file_t *map = (map_file_t *)calloc(1, sizeof(map_file_t));
+    if (map == NULL) {
+        return NULL;
+    }
+
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 && lseek(fd, 0, SEEK_CUR) == 0) {
+        void *addr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED) {
+            map->buf = (const char *)addr;
+            map->size = (size_t)st.st_size;
+            map->mapped = 1;
+            return map;
+        }
+    }
+
+    //Fall back to reading the whole file into one buffer
+    size_t space = 1 << 16;
+    char *buf = (char *)malloc(space);
+    ssize_t n;
+    while (buf != NULL && (n = read(fd, buf + map->size, space - map->size)) > 0) {
+        map->size += (size_t)n;
+        if (map->size == space) {
+            char *bigger = (char *)realloc(buf, space * 2);
+            if (bigger == NULL) {
+                free(buf);
+                buf = NULL;
+                break;
+            }
+            buf = bigger;
+            space *= 2;
+        }
+    }
+
+    if (buf == NULL) {
+        free(map);
+        return NULL;
+    }
+    map->buf = buf;
+    return map;
+}
+
+/**
+ * Opens a map data file for single-pass reading.
+ */
+map_file_t *openMapFile(const char *filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) {
+        return NULL;
+    }
+
+    map_file_t *map = mapDescriptor(fd);
+    close(fd);
+    return map;
+}
+
+/**
+ * Opens an already open descriptor (e.g. stdin) for single-pass reading.
+ */
+map_file_t *openMapStream(int fd) {
+    return mapDescriptor(fd);
+}
+
+/**
+ * Releases a file opened with openMapFile().
+ */
+void closeMapFile(map_file_t *map) {
+    if (map == NULL) {
+        return;
+    }
+
+    if (map->mapped) {
+        munmap((void *)map->buf, map->size);
+    }
+    else {
+        free((void *)map->buf);
+    }
+    free(map);
+}
+
+/**
+ * Helper function to return the next line the way fgets() would with a
+ * MAX_LINE_LEN buffer. The line is cut at the first '\0', since the
+ * sscanf() calls in validate() stop there.
+ * @return 1 if a line was read, 0 at end of file.
+ */
+static int nextLine(map_file_t *map, const char **start, const char **end) {
+    if (map->pos >= map->size) {
+        return 0;
+    }
+
+    const char *p = map->buf + map->pos;
+    size_t limit = map->size - map->pos;
+    if (limit > MAX_LINE_LEN - 1) {
+        limit = MAX_LINE_LEN - 1;
+    }
+
+    const char *newline = (const char *)memchr(p, '\n', limit);
+    size_t len = newline != NULL ? (size_t)(newline - p) + 1 : limit;
+    const char *nul = (const char *)memchr(p, '\0', len);
+
+    *start = p;
+    *end = nul != NULL ? nul : p + len;
+    map->pos += len;
+    map->lineNum++;
+    return 1;
+}
+
+/**
+ * Helper function to skip whitespace, which is what a tab in a
+ * scanf() format matches.
+ */
+static const char *skipSpace(const char *p, const char *end) {
+    while (p < end && isspace((unsigned char)*p)) {
+        p++;
+    }
+    return p;
+}
+
+/**
+ * Helper function to find the end of a field, i.e. the first stop
+ * character or the end of the line.
+ */
+static const char *fieldEnd(const char *p, const char *end, char stop) {
+    const char *found = (const char *)memchr(p, stop, (size_t)(end - p));
+    return found != NULL ? found : end;
+}
+
+/**
+ * Helper function to check for a word, ignoring case.
+ */
+static int matchWord(const char *p, const char *end, const char *word) {
+    size_t len = strlen(word);
+    if ((size_t)(end - p) < len) {
+        return 0;
+    }
+    for (size_t i = 0; i < len; i++) {
+        if (tolower((unsigned char)p[i]) != word[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Helper function to convert a number token with strtod().
+ * The token is copied because the file is not null-terminated.
+ * @return Number of characters strtod() consumed.
+ */
+static size_t convertNumber(const char *p, size_t len, double *value) {
+    char small[MAX_NUMBER_LEN];
+    char *copy = len < MAX_NUMBER_LEN ? small : (char *)malloc(len + 1);
+    char *endptr;
+
+    if (copy == NULL) {
+        return 0;
+    }
+    memcpy(copy, p, len);
+    copy[len] = '\0';
+    *value = strtod(copy, &endptr);
+    size_t used = (size_t)(endptr - copy);
+
+    if (copy != small) {
+        free(copy);
+    }
+    return used;
+}
+
+/**
+ * Helper function to scan a number the way "%lf" does.
+ * Like glibc, a dangling exponent ("1e", "1e+") is consumed but ignored.
+ * Plain decimals with at most 15 digits are converted directly (both the
+ * digits and the power of ten are exact, so one division rounds the same
+ * way strtod() does); anything else is handed to strtod().
+ * @return Pointer past the number, or NULL if there is no number.
+ */
+static const char *scanNumber(const char *p, const char *end, double *value) {
+    static const double pow10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15
+    };
+
+    p = skipSpace(p, end);
+    const char *start = p;
+    int negative = 0;
+
+    if (p < end && (*p == '+' || *p == '-')) {
+        negative = *p == '-';
+        p++;
+    }
+
+    if (matchWord(p, end, "inf")) {
+        p += matchWord(p, end, "infinity") ? 8 : 3;
+        *value = negative ? -INFINITY : INFINITY;
+        return p;
+    }
+    if (matchWord(p, end, "nan")) {
+        *value = negative ? -NAN : NAN;
+        return p + 3;
+    }
+    if (end - p >= 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+        size_t used = convertNumber(start, (size_t)(end - start), value);
+        return used == 0 ? NULL : start + used;
+    }
+
+    unsigned long long mantissa = 0;
+    int digits = 0;
+    int fracDigits = 0;
+    int exponent = 0;
+
+    while (p < end && isdigit((unsigned char)*p)) {
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (unsigned long long)(*p - '0');
+        }
+        digits++;
+        p++;
+    }
+    if (p < end && *p == '.') {
+        p++;
+        while (p < end && isdigit((unsigned char)*p)) {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (unsigned long long)(*p - '0');
+            }
+            digits++;
+            fracDigits++;
+            p++;
+        }
+    }
+    if (digits == 0) {
+        return NULL;
+    }
+
+    const char *numberEnd = p;
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        if (p < end && (*p == '+' || *p == '-')) {
+            p++;
+        }
+        while (p < end && isdigit((unsigned char)*p)) {
+            exponent = 1;
+            p++;
+        }
+        if (exponent) {
+            numberEnd = p;
+        }
+    }
+
+    if (!exponent && digits <= 15) {
+        *value = (double)mantissa / pow10[fracDigits];
+        if (negative) {
+            *value = -*value;
+        }
+    }
+    else {
+        convertNumber(start, (size_t)(numberEnd - start), value);
+    }
+    return p;
+}
+
+/**
+ * Helper function to check that a field contains only digits.
+ * (Rule c)
+ */
+static int fieldIsDigits(const char *p, const char *end) {
+    if (p == end) {
+        return 0;
+    }
+    for (; p < end; p++) {
+        if (!isdigit((unsigned char)*p)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Helper function to convert a digits-only ID field the way atoi() does.
+ */
+static int fieldToId(const char *p, const char *end) {
+    long value = 0;
+    for (; p < end; p++) {
+        int digit = *p - '0';
+        if (value > (LONG_MAX - digit) / 10) {
+            value = LONG_MAX;
+            break;
+        }
+        value = value * 10 + digit;
+    }
+    return (int)value;
+}
+
+/**
+ * Reads and validates the next line as a POI or road count.
+ */
+int readMapCount(map_file_t *map, int *count) {
+    const char *p;
+    const char *end;
+
+    if (!nextLine(map, &p, &end)) {
+        return map->lineNum + 1;
+    }
+
+    //Same as sscanf "%d": optional whitespace and sign, then digits
+    p = skipSpace(p, end);
+    int negative = 0;
+    if (p < end && (*p == '+' || *p == '-')) {
+        negative = *p == '-';
+        p++;
+    }
+    if (p == end || !isdigit((unsigned char)*p)) {
+        return map->lineNum;
+    }
+
+    long value = 0;
+    while (p < end && isdigit((unsigned char)*p)) {
+        int digit = *p - '0';
+        if (value > (LONG_MAX - digit) / 10) {
+            value = LONG_MAX;
+        }
+        else {
+            value = value * 10 + digit;
+        }
+        p++;
+    }
+    if (negative) {
+        value = value == LONG_MAX ? LONG_MIN : -value;
+    }
+
+    *count = (int)value;
+    if (*count <= 0) {
+        return map->lineNum; // Rule (d)
+    }
+    return 0;
+}
+
+/**
+ * Reads and validates the next line as a POI record.
+ */
+int readMapPoi(map_file_t *map, poi_record_t *poi) {
+    const char *p;
+    const char *end;
+
+    if (!nextLine(map, &p, &end)) {
+        return map->lineNum + 1; // File ended prematurely
+    }
+    int line_num = map->lineNum;
+
+    if (p == end || *p == '\n') {
+        return line_num; // Rule (a)
+    }
+
+    // "%[^\t]\t%[^\t]\t%lf\t%lf" (Rule e)
+    const char *id = p;
+    const char *idEnd = fieldEnd(p, end, '\t');
+    if (idEnd == id) {
+        return line_num;
+    }
+
+    p = skipSpace(idEnd, end);
+    const char *nameEnd = fieldEnd(p, end, '\t');
+    if (nameEnd == p) {
+        return line_num; // Rule (f)
+    }
+    poi->name = p;
+    poi->nameLen = (int)(nameEnd - p);
+
+    p = scanNumber(nameEnd, end, &poi->latitude);
+    if (p == NULL) {
+        return line_num;
+    }
+    p = scanNumber(p, end, &poi->longitude);
+    if (p == NULL) {
+        return line_num;
+    }
+
+    if (!fieldIsDigits(id, idEnd)) {
+        return line_num; // Rule (c)
+    }
+    if (poi->latitude < -90.0 || poi->latitude > 90.0) {
+        return line_num; // Errata rule (Latitude range)
+    }
+    if (poi->longitude < -180.0 || poi->longitude > 180.0) {
+        return line_num; // Errata rule (Longitude range)
+    }
+
+    poi->id = fieldToId(id, idEnd);
+    return 0;
+}
+
+/**
+ * Reads and validates the next line as a road record.
+ */
+int readMapRoad(map_file_t *map, road_record_t *road) {
+    const char *p;
+    const char *end;
+
+    if (!nextLine(map, &p, &end)) {
+        return map->lineNum + 1; // File ended prematurely
+    }
+    int line_num = map->lineNum;
+
+    if (p == end || *p == '\n') {
+        return line_num; // Rule (a)
+    }
+
+    // "%[^\t]\t%[^\t]\t%lf\t%lf\t%lf\t%[^\n]"
+    const char *from = p;
+    const char *fromEnd = fieldEnd(p, end, '\t');
+    if (fromEnd == from) {
+        return line_num;
+    }
+
+    const char *to = skipSpace(fromEnd, end);
+    const char *toEnd = fieldEnd(to, end, '\t');
+    if (toEnd == to) {
+        return line_num;
+    }
+
+    p = scanNumber(toEnd, end, &road->distance);
+    if (p == NULL) {
+        return line_num;
+    }
+    p = scanNumber(p, end, &road->latitude);
+    if (p == NULL) {
+        return line_num;
+    }
+    p = scanNumber(p, end, &road->longitude);
+    if (p == NULL) {
+        return line_num;
+    }
+
+    p = skipSpace(p, end);
+    const char *nameEnd = fieldEnd(p, end, '\n');
+    if (nameEnd == p) {
+        return line_num; // Rule (b)
+    }
+    road->name = p;
+    road->nameLen = (int)(nameEnd - p);
+
+    // Rule (c): Check if ID fields are all digits
+    if (!fieldIsDigits(from, fromEnd) || !fieldIsDigits(to, toEnd)) {
+        return line_num;
+    }
+
+    road->fromId = fieldToId(from, fromEnd);
+    road->toId = fieldToId(to, toEnd);
+    return 0;
+}
+
+// --- Parallel validation of memory-mapped files ---
+
+//Newline-aligned piece of a file, handled by one worker at a time
+typedef struct {
+    size_t start;
+    size_t end;
+    int firstLine;
+    int lineCount;
+} map_chunk_t;
+
+//Shared state of one validateParallel() run. Line numbers past the end
+//of the file can exceed an int, so the section bounds are longs.
+typedef struct {
+    const map_file_t *map;
+    map_chunk_t *chunks;
+    int chunkCount;
+    int nextChunk;
+    int counting;
+    long poiEnd;
+    long roadHeader;
+    long roadEnd;
+    int lowestError;
+    pthread_mutex_t lock;
+} chunk_job_t;
+
+/**
+ * Helper function to count the lines nextLine() would return between
+ * two offsets, the first of which starts a line: a line of n bytes
+ * (with its newline) takes ceil(n / 1023) of them, as with fgets().
+ */
+static int countLines(const char *buf, size_t start, size_t end) {
+    int count = 0;
+
+    while (start < end) {
+        const char *newline = (const char *)memchr(buf + start, '\n', end - start);
+        size_t len = newline != NULL ? (size_t)(newline - (buf + start)) + 1 : end - start;
+        count += (int)((len + MAX_LINE_LEN - 2) / (MAX_LINE_LEN - 1));
+        start += len;
+    }
+    return count;
+}
+
+/**
+ * Helper function to give a worker the next chunk. While validating,
+ * chunks that start past an error already found, or past the last line
+ * that needs checking, are skipped: they cannot hold the lowest error.
+ * Returns the chunk number, or -1 when none are left.
+ */
+static int claimChunk(chunk_job_t *job) {
+    int chunk = -1;
+
+    pthread_mutex_lock(&job->lock);
+    while (job->nextChunk < job->chunkCount) {
+        map_chunk_t *next = &job->chunks[job->nextChunk++];
+        if (job->counting || (next->firstLine < job->lowestError && next->firstLine <= job->roadEnd)) {
+            chunk = (int)(next - job->chunks);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&job->lock);
+    return chunk;
+}
+
+/**
+ * Helper function to validate the lines of one chunk with the same
+ * readers loadFileGraph() uses. The count lines are checked by
+ * validateParallel() itself, and skipped here.
+ * @return 0 if the chunk is valid, otherwise its first error line.
+ */
+static int validateChunk(chunk_job_t *job, map_chunk_t *chunk) {
+    map_file_t view = *job->map;
+    poi_record_t poi;
+    road_record_t road;
+    const char *p;
+    const char *end;
+    int error;
+
+    //A view of the chunk alone, numbered from its first line
+    view.pos = chunk->start;
+    view.size = chunk->end;
+    view.lineNum = chunk->firstLine - 1;
+
+    for (int i = 0; i < chunk->lineCount; i++) {
+        long line = (long)view.lineNum + 1;
+        if (line > job->roadEnd) {
+            break;
+        }
+
+        if (line >= 2 && line <= job->poiEnd) {
+            error = readMapPoi(&view, &poi);
+        }
+        else if (line > job->roadHeader) {
+            error = readMapRoad(&view, &road);
+        }
+        else {
+            nextLine(&view, &p, &end);
+            error = 0;
+        }
+        if (error != 0) {
+            return error;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Helper function run by every validateParallel() thread: counts or
+ * validates chunks until none are left.
+ */
+static void *chunkWorker(void *arg) {
+    chunk_job_t *job = (chunk_job_t *)arg;
+    int index;
+
+    while ((index = claimChunk(job)) != -1) {
+        map_chunk_t *chunk = &job->chunks[index];
+        if (job->counting) {
+            chunk->lineCount = countLines(job->map->buf, chunk->start, chunk->end);
+            continue;
+        }
+
+        int error = validateChunk(job, chunk);
+        if (error != 0) {
+            pthread_mutex_lock(&job->lock);
+            if (error < job->lowestError) {
+                job->lowestError = error;
+            }
+            pthread_mutex_unlock(&job->lock);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Helper function to run chunkWorker() on every chunk with up to
+ * threadCount threads, the calling thread being the first.
+ */
+static void runChunkWorkers(chunk_job_t *job, int threadCount) {
+    //Without memory for the thread handles the calling thread does it all
+    pthread_t *threads = (pthread_t *)malloc(sizeof(pthread_t) * threadCount);
+    int started = 0;
+
+    job->nextChunk = 0;
+    for (int i = 1; threads != NULL && i < threadCount && i < job->chunkCount; i++) {
+        if (pthread_create(&threads[i], NULL, chunkWorker, job) != 0) {
+            break;
+        }
+        started++;
+    }
+    chunkWorker(job);
+    for (int i = 1; i <= started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+}
+
+/**
+ * Helper function to split a file into newline-aligned chunks of
+ * about chunkSize bytes.
+ * @return The number of chunks.
+ */
+static int splitChunks(const map_file_t *map, size_t chunkSize, map_chunk_t *chunks) {
+    int count = 0;
+    size_t start = 0;
+
+    while (start < map->size) {
+        size_t end = map->size;
+        if (map->size - start > chunkSize) {
+            const char *newline = (const char *)memchr(map->buf + start + chunkSize, '\n', map->size - start - chunkSize);
+            if (newline != NULL) {
+                end = (size_t)(newline - map->buf) + 1;
+            }
+        }
+        chunks[count].start = start;
+        chunks[count].end = end;
+        count++;
+        start = end;
+    }
+    return count;
+}
+
+/**
+ * Validates a map data file with several threads.
+ */
+int validateParallel(map_file_t *map, int threadCount) {
+    chunk_job_t job;
+    int poiCount;
+    int roadCount;
+    int error;
+    long totalLines;
+    size_t chunkSize;
+
+    map->pos = 0;
+    map->lineNum = 0;
+    error = readMapCount(map, &poiCount);
+    if (error != 0) {
+        return error;
+    }
+
+    if (threadCount < 1) {
+        threadCount = 1;
+    }
+    chunkSize = map->size / ((size_t)threadCount * CHUNKS_PER_THREAD);
+    if (chunkSize < MIN_CHUNK_SIZE) {
+        chunkSize = MIN_CHUNK_SIZE;
+    }
+
+    memset(&job, 0, sizeof(job));
+    job.map = map;
+    job.chunks = (map_chunk_t *)malloc(sizeof(map_chunk_t) * (map->size / chunkSize + 1));
+    if (job.chunks == NULL) {
+        return -1;
+    }
+    job.chunkCount = splitChunks(map, chunkSize, job.chunks);
+    pthread_mutex_init(&job.lock, NULL);
+
+    //1. Count the lines of every chunk, then number them
+    job.counting = 1;
+    runChunkWorkers(&job, threadCount);
+    totalLines = 0;
+    for (int i = 0; i < job.chunkCount; i++) {
+        job.chunks[i].firstLine = (int)(totalLines + 1);
+        totalLines += job.chunks[i].lineCount;
+    }
+
+    //2. Find and read the road count line that follows the POIs
+    job.poiEnd = (long)poiCount + 1;
+    job.roadHeader = job.poiEnd + 1;
+    job.roadEnd = job.roadHeader;
+    job.lowestError = INT_MAX;
+    if (job.roadHeader > totalLines) {
+        //The file ends inside the POI section or before the road count
+        job.roadEnd = totalLines;
+        job.lowestError = (int)(totalLines + 1);
+    }
+    else {
+        int c = 0;
+        while (c + 1 < job.chunkCount && job.chunks[c + 1].firstLine <= job.roadHeader) {
+            c++;
+        }
+
+        map_file_t view = *map;
+        const char *p;
+        const char *end;
+        view.pos = job.chunks[c].start;
+        view.size = job.chunks[c].end;
+        view.lineNum = job.chunks[c].firstLine - 1;
+        while (view.lineNum < job.roadHeader - 1) {
+            nextLine(&view, &p, &end);
+        }
+
+        error = readMapCount(&view, &roadCount);
+        if (error != 0) {
+            job.lowestError = error;
+        }
+        else {
+            job.roadEnd = job.roadHeader + roadCount;
+            if (job.roadEnd > totalLines) {
+                job.lowestError = (int)(totalLines + 1);
+            }
+        }
+    }
+
+    //3. Validate every chunk up to the last road; the lowest error wins
+    job.counting = 0;
+    runChunkWorkers(&job, threadCount);
+
+    pthread_mutex_destroy(&job.lock);
+    free(job.chunks);
+    return job.lowestError == INT_MAX ? 0 : job.lowestError;
+}
@@ -1,6 +1,37 @@
 #ifndef DATA_H
 #define DATA_H
 
+#include <stddef.h>
+
+//A map data file held in memory and read one line at a time
+typedef struct {
+    const char *buf;
+    size_t size;
+    size_t pos;
+    int lineNum;
+    int mapped;
+} map_file_t;
+
+//Fields of one POI line; name points into the file and is not terminated
+typedef struct {
+    int id;
+    const char *name;
+    int nameLen;
+    double latitude;
+    double longitude;
+} poi_record_t;
+
+//Fields of one road line; name points into the file and is not terminated
+typedef struct {
+    int fromId;
+    int toId;
+    double distance;
+    double latitude;
+    double longitude;
+    const char *name;
+    int nameLen;
+} road_record_t;
+
 /**
  * Validates the structure and content of a map data file.
  *
@@ -15,4 +46,82 @@
  */
 int validate();
 
+/**
+ * Opens a map data file for single-pass reading.
+ *
+ * The file is mapped into memory with mmap(), or read into
+ * one buffer if it cannot be mapped (e.g. a pipe).
+ *
+ * @param filename The path to the data file.
+ * @return Pointer to the open file, or NULL if it cannot be read.
+ */
+map_file_t* openMapFile(const char *filename);
+
+/**
+ * Opens an already open descriptor, such as stdin, the same way.
+ *
+ * A regular file is mapped if it is read from its start; anything
+ * else is read into one buffer. The descriptor is not closed.
+ *
+ * @param fd The open descriptor.
+ * @return Pointer to the open file, or NULL if it cannot be read.
+ */
+map_file_t* openMapStream(int fd);
+
+/**
+ * Releases a file opened with openMapFile().
+ * Records read from the file are no longer valid afterwards.
+ * If the pointer is NULL, the function does nothing.
+ */
+void closeMapFile(map_file_t *map);
+
+/**
+ * Reads and validates the next line as a POI or road count.
+ *
+ * Lines are split and checked exactly as validate() does, so the
+ * three read functions report the same error line numbers:
+ * lines are at most 1023 characters (longer lines continue on the
+ * next line number, as with fgets()), a tab in the format matches
+ * any run of whitespace, and anything after the last field is ignored.
+ *
+ * @param map The open file.
+ * @param count Set to the count on success.
+ * @return 0 on success, otherwise the 1-based line number of the error.
+ */
+int readMapCount(map_file_t *map, int *count);
+
+/**
+ * Reads and validates the next line as a POI record.
+ * @param map The open file.
+ * @param poi Filled in on success.
+ * @return 0 on success, otherwise the 1-based line number of the error.
+ */
+int readMapPoi(map_file_t *map, poi_record_t *poi);
+
+/**
+ * Reads and validates the next line as a road record.
+ * @param map The open file.
+ * @param road Filled in on success.
+ * @return 0 on success, otherwise the 1-based line number of the error.
+ */
+int readMapRoad(map_file_t *map, road_record_t *road);
+
+/**
+ * Validates a whole map data file with several threads.
+ *
+ * The file is split into newline-aligned chunks. The threads first
+ * count the lines of each chunk, which numbers every line and locates
+ * the road count line after the POI section; they then check the POI
+ * and road lines of the chunks with readMapPoi() and readMapRoad().
+ * Chunks starting after an error already found are skipped, and the
+ * lowest error line is kept, so the result is the same as validate()
+ * for the same input whatever the number of threads.
+ *
+ * @param map The open file; its read position is reset to the start.
+ * @param threadCount Number of threads to use (at least 1).
+ * @return 0 if the file is valid, -1 if memory allocation fails,
+ * otherwise the 1-based line number of the first error.
+ */
+int validateParallel(map_file_t *map, int threadCount);
+
 #endif // DATA_H
\ No newline at end of file
@@ -0,0 +1,365 @@
+#include "delta.h"
+#include "testgraph.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include <math.h>
+
+#define MAX_DELTA_FIELDS 7
+
+//Name and number of fields (including the command) of each kind, in delta_kind_t order
+static const char *commandNames[] = {"add-poi", "remove-poi", "add-road", "remove-road", "reweight-road"};
+static const int commandFields[] = {5, 2, 7, 3, 4};
+
+/**
+ * Helper function to read a whole file into one null-terminated buffer.
+ * @return The buffer, or NULL if the file cannot be read.
+ */
+static char *readDeltaFile(const char *filename) {
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+
+    size_t size = 0;
+    size_t space = 4096;
+    char *text = (char *)malloc(space);
+    size_t n;
+    while (text != NULL && (n = fread(text + size, 1, space - size - 1, file)) > 0) {
+        size += n;
+        if (size == space - 1) {
+            char *bigger = (char *)realloc(text, space * 2);
+            if (bigger == NULL) {
+                free(text);
+                text = NULL;
+                break;
+            }
+            text = bigger;
+            space *= 2;
+        }
+    }
+    if (text != NULL && ferror(file)) {
+        free(text);
+        text = NULL;
+    }
+    fclose(file);
+
+    if (text != NULL) {
+        text[size] = '\0';
+    }
+    return text;
+}
+
+/**
+ * Helper function to parse a node ID: digits only, and small enough
+ * for an int.
+ * @return 1 on success, 0 otherwise.
+ */
+static int parseId(const char *field, int *id) {
+    long value = 0;
+
+    if (field[0] == '\0') {
+        return 0;
+    }
+    for (const char *p = field; *p != '\0'; p++) {
+        if (!isdigit((unsigned char)*p)) {
+            return 0;
+        }
+        value = value * 10 + (*p - '0');
+        if (value > INT_MAX) {
+            return 0;
+        }
+    }
+    *id = (int)value;
+    return 1;
+}
+
+/**
+ * Helper function to parse a whole field as a finite number within [min, max].
+ * @return 1 on success, 0 otherwise.
+ */
+static int parseValue(const char *field, double min, double max, double *value) {
+    char *end;
+
+    *value = strtod(field, &end);
+    return end != field && *end == '\0' && isfinite(*value) && *value >= min && *value <= max;
+}
+
+/**
+ * Helper function to parse the destination of a road change and, unless
+ * the road is being removed, its length.
+ * @return 1 on success, 0 if a field is invalid.
+ */
+static int parseRoadEnd(char **fields, delta_change_t *change) {
+    if (!parseId(fields[2], &change->toId)) {
+        return 0;
+    }
+    return change->kind == DELTA_REMOVE_ROAD || parseValue(fields[3], 0.0, HUGE_VAL, &change->weight);
+}
+
+/**
+ * Helper function to parse one line of a delta file. The line is split
+ * in place, and names point into it.
+ * @return 1 if the line holds a change, 0 if it is blank or a comment,
+ * -1 if it is malformed.
+ */
+static int parseChange(char *line, delta_change_t *change) {
+    char *fields[MAX_DELTA_FIELDS + 1];
+    int count = 0;
+    int kind;
+    size_t len = strlen(line);
+
+    if (len > 0 && line[len - 1] == '\r') {
+        line[--len] = '\0';
+    }
+    if (len == 0 || line[0] == '#') {
+        return 0;
+    }
+
+    //One extra slot so a line with too many fields is rejected
+    char *p = line;
+    while (count <= MAX_DELTA_FIELDS) {
+        fields[count++] = p;
+        p = strchr(p, '\t');
+        if (p == NULL) {
+            break;
+        }
+        *p++ = '\0';
+    }
+
+    for (kind = 0; kind <= DELTA_REWEIGHT_ROAD; kind++) {
+        if (strcmp(fields[0], commandNames[kind]) == 0) {
+            break;
+        }
+    }
+    if (kind > DELTA_REWEIGHT_ROAD || count != commandFields[kind]) {
+        return -1;
+    }
+
+    memset(change, 0, sizeof(delta_change_t));
+    change->kind = (delta_kind_t)kind;
+    if (!parseId(fields[1], &change->fromId)) {
+        return -1;
+    }
+
+    switch (change->kind) {
+        case DELTA_ADD_POI:
+            change->name = fields[2];
+            if (!parseValue(fields[3], -90.0, 90.0, &change->latitude) ||
+                !parseValue(fields[4], -180.0, 180.0, &change->longitude)) {
+                return -1;
+            }
+            break;
+        case DELTA_REMOVE_POI:
+            break;
+        case DELTA_ADD_ROAD:
+            change->name = fields[6];
+            if (!parseValue(fields[4], -90.0, 90.0, &change->latitude) ||
+                !parseValue(fields[5], -180.0, 180.0, &change->longitude) || !parseRoadEnd(fields, change)) {
+                return -1;
+            }
+            break;
+        case DELTA_REMOVE_ROAD:
+        case DELTA_REWEIGHT_ROAD:
+            if (!parseRoadEnd(fields, change)) {
+                return -1;
+            }
+            break;
+    }
+
+    if (change->name != NULL && change->name[0] == '\0') {
+        return -1;
+    }
+    return 1;
+}
+
+/**
+ * Helper function to allocate a POI record for a node.
+ * @return The record, or NULL if memory allocation fails.
+ */
+static poi_data_t *newPoiData(graph_t *graph, const char *name, double latitude, double longitude) {
+    poi_data_t *poi = (poi_data_t *)graphAlloc(graph, sizeof(poi_data_t));
+    if (poi == NULL) {
+        return NULL;
+    }
+
+    poi->name = NULL;
+    if (name != NULL) {
+        poi->name = graphStrndup(graph, name, strlen(name));
+        if (poi->name == NULL) {
+            return NULL;
+        }
+    }
+    poi->latitude = latitude;
+    poi->longitude = longitude;
+    return poi;
+}
+
+/**
+ * Helper function to make one change to the graph. On success, the
+ * change's name and data point at what the graph now holds.
+ * @return 1 on success, 0 if the change does not fit the graph, -2 if
+ * memory allocation fails.
+ */
+static int makeChange(graph_t *graph, name_index_t *roadNames, delta_change_t *change) {
+    node_t *node;
+    edge_t *edge;
+    poi_data_t *poi;
+
+    switch (change->kind) {
+        case DELTA_ADD_POI:
+            if (getNode(graph, change->fromId) != NULL) {
+                return 0;
+            }
+            poi = newPoiData(graph, change->name, change->latitude, change->longitude);
+            if (poi == NULL || addNode(graph, change->fromId, poi) == NULL) {
+                return -2;
+            }
+            change->name = poi->name;
+            change->data = poi;
+            return 1;
+
+        case DELTA_REMOVE_POI:
+            node = getNode(graph, change->fromId);
+            if (node == NULL) {
+                return 0;
+            }
+            change->data = node->data;
+            change->name = node->data != NULL ? ((poi_data_t *)node->data)->name : NULL;
+            removeNode(graph, change->fromId);
+            return 1;
+
+        case DELTA_ADD_ROAD:
+            if (getEdge(graph, change->fromId, change->toId) != NULL) {
+                return 0;
+            }
+            //Nodes are added as loadFileGraph() adds them for a road line
+            node = getNode(graph, change->fromId);
+            if (node == NULL || node->data == NULL) {
+                poi = newPoiData(graph, NULL, change->latitude, change->longitude);
+                if (poi == NULL) {
+                    return -2;
+                }
+                if (node != NULL) {
+                    node->data = poi;
+                }
+                else if (addNode(graph, change->fromId, poi) == NULL) {
+                    return -2;
+                }
+            }
+            if (getNode(graph, change->toId) == NULL && addNode(graph, change->toId, NULL) == NULL) {
+                return -2;
+            }
+            if (roadNames != NULL) {
+                change->name = internName(roadNames, change->name, (int)strlen(change->name));
+            }
+            else {
+                change->name = graphStrndup(graph, change->name, strlen(change->name));
+            }
+            if (change->name == NULL ||
+                addEdge(graph, change->fromId, change->toId, (float)change->weight, (void *)change->name) == NULL) {
+                return -2;
+            }
+            return 1;
+
+        case DELTA_REMOVE_ROAD:
+            return removeEdge(graph, change->fromId, change->toId);
+
+        case DELTA_REWEIGHT_ROAD:
+            edge = getEdge(graph, change->fromId, change->toId);
+            if (edge == NULL) {
+                return 0;
+            }
+            edge->weight = (float)change->weight;
+            return 1;
+    }
+    return 0;
+}
+
+/**
+ * Helper function to append a change to a log, doubling it when full.
+ * @return 1 on success, 0 if memory allocation fails.
+ */
+static int logChange(delta_log_t *log, const delta_change_t *change) {
+    if (log->count == log->space) {
+        int space = log->space > 0 ? log->space * 2 : 16;
+        delta_change_t *bigger = (delta_change_t *)realloc(log->changes, sizeof(delta_change_t) * space);
+        if (bigger == NULL) {
+            return 0;
+        }
+        log->changes = bigger;
+        log->space = space;
+    }
+    log->changes[log->count++] = *change;
+    return 1;
+}
+
+/**
+ * Applies the changes in a delta file to a graph.
+ */
+int applyDelta(graph_t *graph, const char *filename, name_index_t *roadNames, delta_log_t *log) {
+    delta_log_t parsed = {NULL, 0, 0};
+    delta_change_t change;
+    int lineNum = 0;
+    int result = 0;
+
+    if (graph == NULL) {
+        return -1;
+    }
+    char *text = readDeltaFile(filename);
+    if (text == NULL) {
+        return -1;
+    }
+
+    //Parse every line first, so a malformed file changes nothing
+    char *line = text;
+    while (line != NULL && *line != '\0') {
+        char *next = strchr(line, '\n');
+        if (next != NULL) {
+            *next++ = '\0';
+        }
+        lineNum++;
+
+        int status = parseChange(line, &change);
+        if (status == -1) {
+            result = lineNum;
+            break;
+        }
+        change.line = lineNum;
+        if (status == 1 && !logChange(&parsed, &change)) {
+            result = -2;
+            break;
+        }
+        line = next;
+    }
+
+    //Then apply them in order, stopping at the first that does not fit
+    for (int i = 0; result == 0 && i < parsed.count; i++) {
+        int status = makeChange(graph, roadNames, &parsed.changes[i]);
+        if (status == 1 && log != NULL && !logChange(log, &parsed.changes[i])) {
+            status = -2;
+        }
+        if (status != 1) {
+            result = status == 0 ? parsed.changes[i].line : status;
+        }
+    }
+
+    free(parsed.changes);
+    free(text);
+    return result;
+}
+
+/**
+ * Frees the changes recorded in a log and empties it.
+ */
+void freeDeltaLog(delta_log_t *log) {
+    if (log == NULL) {
+        return;
+    }
+    free(log->changes);
+    log->changes = NULL;
+    log->count = 0;
+    log->space = 0;
+}
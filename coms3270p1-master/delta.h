@@ -0,0 +1,71 @@
+#ifndef DELTA_H
+#define DELTA_H
+
+#include "graph.h"
+#include "names.h"
+
+//Kinds of change in a delta file
+typedef enum {
+    DELTA_ADD_POI,
+    DELTA_REMOVE_POI,
+    DELTA_ADD_ROAD,
+    DELTA_REMOVE_ROAD,
+    DELTA_REWEIGHT_ROAD
+} delta_kind_t;
+
+//One line of a delta file. For POI changes fromId is the node; name is
+//the POI or road name (NULL for removals and reweights until applied).
+typedef struct {
+    delta_kind_t kind;
+    int line;
+    int fromId;
+    int toId;
+    double weight;
+    double latitude;
+    double longitude;
+    const char *name;
+    void *data;
+} delta_change_t;
+
+//Changes applyDelta() made, in file order, so the caller can update
+//anything derived from the graph
+typedef struct {
+    delta_change_t *changes;
+    int count;
+    int space;
+} delta_log_t;
+
+/**
+* Applies the changes in a delta file to a graph.
+* @param graph Pointer to the graph.
+* @param filename Path of the delta file.
+* @param roadNames Index road names are interned in, as loadFileGraph()
+* does, or NULL to copy each one with graphStrndup().
+* @param log If not NULL, receives every change applied (it must be
+* empty or filled by an earlier call; free it with freeDeltaLog()).
+* @return 0 on success, the line number of the first bad line, -1 if the
+* file cannot be read, or -2 if memory allocation fails.
+* The file has one change per line, with tab-separated fields:
+*   add-poi <id> <name> <lat> <lon>
+*   remove-poi <id>
+*   add-road <from> <to> <meters> <lat> <lon> <name>
+*   remove-road <from> <to>
+*   reweight-road <from> <to> <meters>
+* Blank lines and lines starting with '#' are ignored. add-road adds the
+* nodes it needs like a road line of a data file (the coordinates are
+* those of the from node); remove-poi removes any node and its roads.
+* Every line is parsed before anything changes, so a malformed file
+* changes nothing. A change that does not fit the graph (a POI or road
+* that already exists, or one that does not) stops the run at its line,
+* with the earlier changes applied and logged. POI records are allocated
+* with graphAlloc(); log entries for removed nodes keep their data
+* pointer, which the caller frees if the graph has no arena.
+**/
+int applyDelta(graph_t* graph, const char* filename, name_index_t* roadNames, delta_log_t* log);
+/**
+* Frees the changes recorded in a log and empties it.
+* If the pointer is NULL, the function does nothing.
+**/
+void freeDeltaLog(delta_log_t* log);
+
+#endif // DELTA_H
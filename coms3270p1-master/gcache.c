@@ -0,0 +1,436 @@
+#include "gcache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define BYTE_ORDER_TAG 0x01020304u
+#define NAME_NONE -1
+#define NODE_NO_DATA -2
+
+// Section numbers in gcache_header_t.offsets
+enum {
+    SEC_IDS,
+    SEC_NODE_NAMES,
+    SEC_LATITUDES,
+    SEC_LONGITUDES,
+    SEC_ROW_OFFSETS,
+    SEC_COL_INDICES,
+    SEC_WEIGHTS,
+    SEC_EDGE_NAMES,
+    SEC_INDEX,
+    SEC_NAME_BUCKETS,
+    SEC_NAME_ENTRIES,
+    SEC_NAME_IDS,
+    SEC_POOL
+};
+
+/**
+ * Helper function to compute the 64-bit FNV-1a checksum of a buffer.
+ */
+static uint64_t checksum(const char *buf, size_t len) {
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)buf[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+/**
+ * Helper function to round a file offset up to 8 bytes.
+ */
+static uint64_t align8(uint64_t offset) {
+    return (offset + 7) & ~(uint64_t)7;
+}
+
+/**
+ * Helper function to fill in the section sizes and offsets of a header.
+ * @return The total file size.
+ */
+static uint64_t layoutSections(gcache_header_t *header, uint64_t sizes[GCACHE_SECTIONS]) {
+    uint64_t n = (uint64_t)header->nodeCount;
+    uint64_t m = (uint64_t)header->edgeCount;
+
+    sizes[SEC_IDS] = n * sizeof(int32_t);
+    sizes[SEC_NODE_NAMES] = n * sizeof(int32_t);
+    sizes[SEC_LATITUDES] = n * sizeof(double);
+    sizes[SEC_LONGITUDES] = n * sizeof(double);
+    sizes[SEC_ROW_OFFSETS] = (n + 1) * sizeof(int32_t);
+    sizes[SEC_COL_INDICES] = m * sizeof(int32_t);
+    sizes[SEC_WEIGHTS] = m * sizeof(float);
+    sizes[SEC_EDGE_NAMES] = m * sizeof(int32_t);
+    sizes[SEC_INDEX] = (uint64_t)header->indexSpace * sizeof(int32_t);
+    sizes[SEC_NAME_BUCKETS] = (uint64_t)header->nameBucketSpace * sizeof(int32_t);
+    sizes[SEC_NAME_ENTRIES] = (uint64_t)header->nameCount * sizeof(gcache_name_t);
+    sizes[SEC_NAME_IDS] = (uint64_t)header->nameIdCount * sizeof(int32_t);
+    sizes[SEC_POOL] = header->poolSize;
+
+    uint64_t offset = align8(sizeof(gcache_header_t));
+    for (int i = 0; i < GCACHE_SECTIONS; i++) {
+        header->offsets[i] = offset;
+        offset = align8(offset + sizes[i]);
+    }
+    return offset;
+}
+
+/**
+ * Writes a snapshot and its name index to a compiled graph file.
+ */
+int writeGraphCache(const char *filename, frozen_graph_t *frozen, name_index_t *names) {
+    gcache_header_t header;
+    uint64_t sizes[GCACHE_SECTIONS];
+    name_index_t *pool;
+    int32_t *poolOffsets = NULL;
+    char *buf = NULL;
+    int ok = 0;
+
+    if (frozen == NULL || names == NULL) {
+        return 0;
+    }
+
+    //Every distinct string goes into the pool once
+    pool = createNameIndex();
+    if (pool == NULL) {
+        return 0;
+    }
+    for (int i = 0; i < frozen->nodeCount; i++) {
+        poi_data_t *poi = (poi_data_t *)frozen->nodeData[i];
+        if (poi != NULL && poi->name != NULL && internName(pool, poi->name, (int)strlen(poi->name)) == NULL) {
+            goto done;
+        }
+    }
+    for (int e = 0; e < frozen->edgeCount; e++) {
+        const char *road = (const char *)frozen->edgeData[e];
+        if (road != NULL && internName(pool, road, (int)strlen(road)) == NULL) {
+            goto done;
+        }
+    }
+
+    poolOffsets = (int32_t *)malloc(sizeof(int32_t) * (pool->entryCount + 1));
+    if (poolOffsets == NULL) {
+        goto done;
+    }
+    uint64_t poolSize = 0;
+    for (int i = 0; i < pool->entryCount; i++) {
+        poolOffsets[i] = (int32_t)poolSize;
+        poolSize += (uint64_t)pool->entries[i].length + 1;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, GCACHE_MAGIC, sizeof(header.magic));
+    header.version = GCACHE_VERSION;
+    header.byteOrder = BYTE_ORDER_TAG;
+    header.nodeCount = frozen->nodeCount;
+    header.edgeCount = frozen->edgeCount;
+    header.indexSpace = frozen->indexSpace;
+    header.nameCount = names->entryCount;
+    header.nameBucketSpace = names->bucketSpace;
+    for (int i = 0; i < names->entryCount; i++) {
+        header.nameIdCount += names->entries[i].idCount;
+    }
+    header.poolSize = poolSize;
+    header.fileSize = layoutSections(&header, sizes);
+
+    buf = (char *)calloc(1, header.fileSize);
+    if (buf == NULL) {
+        goto done;
+    }
+
+    int32_t *nodeNames = (int32_t *)(buf + header.offsets[SEC_NODE_NAMES]);
+    double *lats = (double *)(buf + header.offsets[SEC_LATITUDES]);
+    double *lons = (double *)(buf + header.offsets[SEC_LONGITUDES]);
+    for (int i = 0; i < frozen->nodeCount; i++) {
+        poi_data_t *poi = (poi_data_t *)frozen->nodeData[i];
+        nodeNames[i] = NODE_NO_DATA;
+        if (poi != NULL) {
+            nodeNames[i] = NAME_NONE;
+            if (poi->name != NULL) {
+                nodeNames[i] = poolOffsets[getNameEntry(pool, poi->name, (int)strlen(poi->name))];
+            }
+            lats[i] = poi->latitude;
+            lons[i] = poi->longitude;
+        }
+    }
+
+    int32_t *edgeNames = (int32_t *)(buf + header.offsets[SEC_EDGE_NAMES]);
+    for (int e = 0; e < frozen->edgeCount; e++) {
+        const char *road = (const char *)frozen->edgeData[e];
+        edgeNames[e] = road == NULL ? NAME_NONE : poolOffsets[getNameEntry(pool, road, (int)strlen(road))];
+    }
+
+    memcpy(buf + header.offsets[SEC_IDS], frozen->ids, sizes[SEC_IDS]);
+    memcpy(buf + header.offsets[SEC_ROW_OFFSETS], frozen->rowOffsets, sizes[SEC_ROW_OFFSETS]);
+    memcpy(buf + header.offsets[SEC_COL_INDICES], frozen->colIndices, sizes[SEC_COL_INDICES]);
+    memcpy(buf + header.offsets[SEC_WEIGHTS], frozen->weights, sizes[SEC_WEIGHTS]);
+    memcpy(buf + header.offsets[SEC_INDEX], frozen->index, sizes[SEC_INDEX]);
+    memcpy(buf + header.offsets[SEC_NAME_BUCKETS], names->buckets, sizes[SEC_NAME_BUCKETS]);
+
+    gcache_name_t *entries = (gcache_name_t *)(buf + header.offsets[SEC_NAME_ENTRIES]);
+    int32_t *ids = (int32_t *)(buf + header.offsets[SEC_NAME_IDS]);
+    int32_t idStart = 0;
+    for (int i = 0; i < names->entryCount; i++) {
+        name_entry_t *entry = &names->entries[i];
+        entries[i].textOffset = poolOffsets[getNameEntry(pool, entry->text, entry->length)];
+        entries[i].length = entry->length;
+        entries[i].hash = entry->hash;
+        entries[i].idStart = idStart;
+        entries[i].idCount = entry->idCount;
+        memcpy(ids + idStart, entry->ids, sizeof(int32_t) * entry->idCount);
+        idStart += entry->idCount;
+    }
+
+    char *text = buf + header.offsets[SEC_POOL];
+    for (int i = 0; i < pool->entryCount; i++) {
+        memcpy(text + poolOffsets[i], pool->entries[i].text, pool->entries[i].length + 1);
+    }
+
+    header.checksum = checksum(buf + sizeof(header), header.fileSize - sizeof(header));
+    memcpy(buf, &header, sizeof(header));
+
+    //Write beside the target and rename, so a run opening it with -g never maps half a file
+    size_t len = strlen(filename);
+    char *tmpName = (char *)malloc(len + 5);
+    if (tmpName != NULL) {
+        memcpy(tmpName, filename, len);
+        memcpy(tmpName + len, ".tmp", 5);
+        FILE *file = fopen(tmpName, "wb");
+        if (file != NULL) {
+            ok = fwrite(buf, 1, header.fileSize, file) == header.fileSize;
+            ok = fclose(file) == 0 && ok;
+            ok = ok && rename(tmpName, filename) == 0;
+            if (!ok) {
+                remove(tmpName);
+            }
+        }
+        free(tmpName);
+    }
+
+done:
+    free(buf);
+    free(poolOffsets);
+    freeNameIndex(pool);
+    return ok;
+}
+
+/**
+ * Helper function to check the header against the mapped file.
+ * @return NULL if the header is valid, otherwise a description of the problem.
+ */
+static const char *checkHeader(const gcache_header_t *header, size_t size) {
+    gcache_header_t expected;
+    uint64_t sizes[GCACHE_SECTIONS];
+
+    if (memcmp(header->magic, GCACHE_MAGIC, sizeof(header->magic)) != 0) {
+        return "not a compiled graph file";
+    }
+    if (header->byteOrder != BYTE_ORDER_TAG) {
+        return "compiled on a machine with a different byte order";
+    }
+    if (header->version != GCACHE_VERSION) {
+        return "unsupported version";
+    }
+    if (header->fileSize != size) {
+        return "file is truncated";
+    }
+    if (header->nodeCount < 0 || header->edgeCount < 0 || header->nameCount < 0 ||
+        header->nameIdCount < 0 || header->indexSpace <= 0 || header->nameBucketSpace <= 0 ||
+        (header->indexSpace & (header->indexSpace - 1)) != 0 ||
+        (header->nameBucketSpace & (header->nameBucketSpace - 1)) != 0) {
+        return "corrupt header";
+    }
+
+    //The sections must be exactly where this version puts them
+    expected = *header;
+    if (layoutSections(&expected, sizes) != size ||
+        memcmp(expected.offsets, header->offsets, sizeof(expected.offsets)) != 0) {
+        return "corrupt section table";
+    }
+    return NULL;
+}
+
+/**
+ * Maps a compiled graph file.
+ */
+graph_cache_t *openGraphCache(const char *filename) {
+    struct stat st;
+    const char *problem = NULL;
+
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) {
+        fprintf(stderr, "Error: Cannot open file %s\n", filename);
+        return NULL;
+    }
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(gcache_header_t)) {
+        close(fd);
+        fprintf(stderr, "Error: %s is not a compiled graph file\n", filename);
+        return NULL;
+    }
+
+    void *addr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        fprintf(stderr, "Error: Cannot map file %s\n", filename);
+        return NULL;
+    }
+
+    graph_cache_t *cache = (graph_cache_t *)calloc(1, sizeof(graph_cache_t));
+    if (cache == NULL) {
+        munmap(addr, (size_t)st.st_size);
+        return NULL;
+    }
+    cache->base = (const char *)addr;
+    cache->size = (size_t)st.st_size;
+
+    const gcache_header_t *header = (const gcache_header_t *)cache->base;
+    problem = checkHeader(header, cache->size);
+    if (problem == NULL &&
+        checksum(cache->base + sizeof(*header), cache->size - sizeof(*header)) != header->checksum) {
+        problem = "checksum mismatch";
+    }
+    if (problem != NULL) {
+        fprintf(stderr, "Error: %s: %s\n", filename, problem);
+        closeGraphCache(cache);
+        return NULL;
+    }
+
+    int n = header->nodeCount;
+    int m = header->edgeCount;
+    const char *base = cache->base;
+    const char *pool = base + header->offsets[SEC_POOL];
+    uint64_t poolSize = header->poolSize;
+
+    frozen_graph_t *frozen = &cache->frozen;
+    frozen->nodeCount = n;
+    frozen->edgeCount = m;
+    frozen->ids = (int *)(base + header->offsets[SEC_IDS]);
+    frozen->rowOffsets = (int *)(base + header->offsets[SEC_ROW_OFFSETS]);
+    frozen->colIndices = (int *)(base + header->offsets[SEC_COL_INDICES]);
+    frozen->weights = (float *)(base + header->offsets[SEC_WEIGHTS]);
+    frozen->index = (int *)(base + header->offsets[SEC_INDEX]);
+    frozen->indexSpace = header->indexSpace;
+    cache->latitudes = (const double *)(base + header->offsets[SEC_LATITUDES]);
+    cache->longitudes = (const double *)(base + header->offsets[SEC_LONGITUDES]);
+
+    //Guard against files that pass the checksum but would index out of range
+    if (frozen->rowOffsets[0] != 0 || frozen->rowOffsets[n] != m || (poolSize > 0 && pool[poolSize - 1] != '\0')) {
+        problem = "corrupt adjacency";
+    }
+    for (int i = 0; problem == NULL && i < n; i++) {
+        if (frozen->rowOffsets[i] > frozen->rowOffsets[i + 1]) {
+            problem = "corrupt adjacency";
+        }
+    }
+    for (int e = 0; problem == NULL && e < m; e++) {
+        if (frozen->colIndices[e] < 0 || frozen->colIndices[e] >= n) {
+            problem = "corrupt adjacency";
+        }
+    }
+    for (int i = 0; problem == NULL && i < header->indexSpace; i++) {
+        if (frozen->index[i] < -1 || frozen->index[i] >= n) {
+            problem = "corrupt index";
+        }
+    }
+    if (problem != NULL) {
+        fprintf(stderr, "Error: %s: %s\n", filename, problem);
+        closeGraphCache(cache);
+        return NULL;
+    }
+
+    //Node and edge data point into the string pool; no string is copied
+    cache->records = (poi_data_t *)malloc(sizeof(poi_data_t) * (n + 1));
+    frozen->nodeData = (void **)malloc(sizeof(void *) * (n + 1));
+    frozen->edgeData = (void **)malloc(sizeof(void *) * (m + 1));
+    cache->names = (name_index_t *)calloc(1, sizeof(name_index_t));
+    if (cache->records == NULL || frozen->nodeData == NULL || frozen->edgeData == NULL || cache->names == NULL) {
+        closeGraphCache(cache);
+        return NULL;
+    }
+
+    const int32_t *nodeNames = (const int32_t *)(base + header->offsets[SEC_NODE_NAMES]);
+    for (int i = 0; i < n; i++) {
+        int32_t ref = nodeNames[i];
+        if (ref < NODE_NO_DATA || (ref >= 0 && (uint64_t)ref >= poolSize)) {
+            fprintf(stderr, "Error: %s: corrupt node table\n", filename);
+            closeGraphCache(cache);
+            return NULL;
+        }
+        if (ref == NODE_NO_DATA) {
+            frozen->nodeData[i] = NULL;
+            continue;
+        }
+        cache->records[i].name = ref == NAME_NONE ? NULL : (char *)(pool + ref);
+        cache->records[i].latitude = cache->latitudes[i];
+        cache->records[i].longitude = cache->longitudes[i];
+        frozen->nodeData[i] = &cache->records[i];
+    }
+
+    const int32_t *edgeNames = (const int32_t *)(base + header->offsets[SEC_EDGE_NAMES]);
+    for (int e = 0; e < m; e++) {
+        int valid = edgeNames[e] >= 0 && (uint64_t)edgeNames[e] < poolSize;
+        frozen->edgeData[e] = valid ? (void *)(pool + edgeNames[e]) : NULL;
+    }
+
+    //The POI name index borrows its buckets, texts and ID lists from the mapping
+    name_index_t *names = cache->names;
+    const gcache_name_t *entries = (const gcache_name_t *)(base + header->offsets[SEC_NAME_ENTRIES]);
+    int32_t *nameIds = (int32_t *)(base + header->offsets[SEC_NAME_IDS]);
+    names->borrowed = 1;
+    names->buckets = (int *)(base + header->offsets[SEC_NAME_BUCKETS]);
+    names->bucketSpace = header->nameBucketSpace;
+    names->entries = (name_entry_t *)malloc(sizeof(name_entry_t) * (header->nameCount + 1));
+    if (names->entries == NULL) {
+        closeGraphCache(cache);
+        return NULL;
+    }
+    for (int i = 0; i < header->nameCount; i++) {
+        const gcache_name_t *stored = &entries[i];
+        if (stored->textOffset < 0 || stored->length < 0 ||
+            (uint64_t)stored->textOffset + (uint64_t)stored->length >= poolSize ||
+            stored->idStart < 0 || stored->idCount < 0 ||
+            (int64_t)stored->idStart + stored->idCount > header->nameIdCount) {
+            fprintf(stderr, "Error: %s: corrupt name table\n", filename);
+            closeGraphCache(cache);
+            return NULL;
+        }
+        names->entries[i].text = (char *)(pool + stored->textOffset);
+        names->entries[i].length = stored->length;
+        names->entries[i].hash = stored->hash;
+        names->entries[i].ids = nameIds + stored->idStart;
+        names->entries[i].idCount = stored->idCount;
+        names->entries[i].idSpace = 0;
+    }
+    names->entryCount = header->nameCount;
+    names->entrySpace = header->nameCount;
+    for (int i = 0; i < names->bucketSpace; i++) {
+        if (names->buckets[i] < -1 || names->buckets[i] >= names->entryCount) {
+            fprintf(stderr, "Error: %s: corrupt name table\n", filename);
+            closeGraphCache(cache);
+            return NULL;
+        }
+    }
+
+    return cache;
+}
+
+/**
+ * Unmaps a compiled graph file.
+ */
+void closeGraphCache(graph_cache_t *cache) {
+    if (cache == NULL) {
+        return;
+    }
+
+    freeNameIndex(cache->names);
+    free(cache->records);
+    free(cache->frozen.nodeData);
+    free(cache->frozen.edgeData);
+    free(cache->frozen.revOffsets);
+    free(cache->frozen.revColIndices);
+    free(cache->frozen.revWeights);
+    munmap((void *)cache->base, cache->size);
+    free(cache);
+}
@@ -0,0 +1,83 @@
+#ifndef GCACHE_H
+#define GCACHE_H
+
+#include <stdint.h>
+#include "graph.h"
+#include "names.h"
+#include "testgraph.h"
+
+#define GCACHE_MAGIC "CITYGRPH"
+#define GCACHE_VERSION 1
+#define GCACHE_SECTIONS 13
+
+//Fixed-size header at the start of a compiled graph file
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t checksum;
+    uint64_t fileSize;
+    int32_t nodeCount;
+    int32_t edgeCount;
+    int32_t indexSpace;
+    int32_t nameCount;
+    int32_t nameBucketSpace;
+    int32_t nameIdCount;
+    uint64_t poolSize;
+    uint64_t offsets[GCACHE_SECTIONS];
+} gcache_header_t;
+
+//One POI name entry as stored in the file
+typedef struct {
+    int32_t textOffset;
+    int32_t length;
+    uint32_t hash;
+    int32_t idStart;
+    int32_t idCount;
+} gcache_name_t;
+
+//A compiled graph file mapped into memory
+typedef struct {
+    const char *base;
+    size_t size;
+    frozen_graph_t frozen;
+    name_index_t *names;
+    poi_data_t *records;
+    const double *latitudes;
+    const double *longitudes;
+} graph_cache_t;
+
+/**
+* Writes a snapshot and its POI name index to a compiled graph file.
+* @param filename Path of the file to create.
+* @param frozen Snapshot whose nodeData are poi_data_t records (or NULL)
+* and whose edgeData are road name strings (or NULL).
+* @param names POI name index for the snapshot.
+* @return 1 on success, 0 on failure.
+* The file holds a versioned header with a 64-bit FNV-1a checksum of
+* everything after it, followed by 8-byte aligned sections: the node
+* table (IDs, name offsets, latitudes, longitudes), the CSR arrays,
+* the ID hash index, the POI name hash table and a string pool in which
+* every distinct POI and road name is stored once.
+* It is written to <filename>.tmp and renamed into place, so an existing
+* file is only replaced once the new one is complete.
+**/
+int writeGraphCache(const char* filename, frozen_graph_t* frozen, name_index_t* names);
+/**
+* Maps a compiled graph file and checks its header and checksum.
+* @param filename Path of the file.
+* @return Pointer to the cache, or NULL if the file cannot be read
+* or is not a valid graph file of this version (a message is printed).
+* cache->frozen and cache->names point into the mapping and can be
+* queried like the structures built from a TSV file. The only memory
+* allocated is one record array and one pointer array for the nodes,
+* one pointer array for the edges and the name entry array.
+**/
+graph_cache_t* openGraphCache(const char* filename);
+/**
+* Unmaps a compiled graph file and frees the arrays built for it.
+* If the pointer is NULL, the function does nothing.
+**/
+void closeGraphCache(graph_cache_t* cache);
+
+#endif // GCACHE_H
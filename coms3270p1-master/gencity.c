@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include "geo.h"
+
+// Nodes, POIs and roads in data/Ames.tsv; a scale of k generates about k times each
+#define AMES_NODES 11359
+#define AMES_POIS 1700
+// Grid origin and spacing between intersections
+#define ORIGIN_LAT 42.0
+#define ORIGIN_LON -93.7
+#define BLOCK_METERS 60.0
+// Every AVENUE_EVERY-th column has a north-south road; every row has an east-west one
+#define AVENUE_EVERY 3
+// Every DUPLICATE_EVERY-th POI is called "POI", as many are in Ames; the rest are "Place 1", "Place 2", ...
+#define DUPLICATE_EVERY 5
+
+// Size and layout of the generated city
+typedef struct {
+    long width;
+    long height;
+    long poiStride;
+    double latStep;
+    double lonStep;
+} city_layout_t;
+
+// Function prototypes
+void printUsage(char *programName);
+void planCity(city_layout_t *layout, long scale);
+void nodePoint(const city_layout_t *layout, long node, double *lat, double *lon);
+long writePois(FILE *out, const city_layout_t *layout);
+long writeRoads(FILE *out, const city_layout_t *layout);
+
+/**
+ * Print usage statement
+ */
+void printUsage(char *programName) {
+    printf("Usage: %s <scale>\n", programName);
+    printf("Writes a valid city data file about <scale> times the size of Ames.tsv to stdout.\n");
+    printf("The same scale always produces the same file.\n");
+}
+
+/**
+ * Helper function to hash a node and a salt into 64 random-looking bits
+ * (splitmix64), so values depend only on their inputs and never on the
+ * order they are generated in.
+ */
+static uint64_t mix(uint64_t node, uint64_t salt) {
+    uint64_t z = node * 0x9e3779b97f4a7c15ull + salt * 0xbf58476d1ce4e5b9ull + 0x94d049bb133111ebull;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+/**
+ * Helper function to turn a hash into a number in [0, 1).
+ */
+static double unit(uint64_t hash) {
+    return (double)(hash >> 11) / 9007199254740992.0;
+}
+
+/**
+ * Lay out a square grid of about scale * AMES_NODES intersections,
+ * with about scale * AMES_POIS of them named
+ */
+void planCity(city_layout_t *layout, long scale) {
+    long nodes;
+
+    nodes = scale * AMES_NODES;
+    layout->width = (long)ceil(sqrt((double)nodes));
+    layout->height = (nodes + layout->width - 1) / layout->width;
+    layout->poiStride = (layout->width * layout->height) / (scale * AMES_POIS);
+    if (layout->poiStride < 1) {
+        layout->poiStride = 1;
+    }
+    layout->latStep = BLOCK_METERS / (EARTH_RADIUS * M_PI / 180.0);
+    layout->lonStep = layout->latStep / cos(ORIGIN_LAT * M_PI / 180.0);
+}
+
+/**
+ * Coordinates of a node: its grid position moved up to a fifth of a block
+ */
+void nodePoint(const city_layout_t *layout, long node, double *lat, double *lon) {
+    long x;
+    long y;
+
+    x = node % layout->width;
+    y = node / layout->width;
+    *lat = ORIGIN_LAT + (y + 0.4 * unit(mix(node, 1)) - 0.2) * layout->latStep;
+    *lon = ORIGIN_LON + (x + 0.4 * unit(mix(node, 2)) - 0.2) * layout->lonStep;
+}
+
+/**
+ * Write the POI lines, or only count them if out is NULL
+ * Returns the number of POIs.
+ */
+long writePois(FILE *out, const city_layout_t *layout) {
+    long count;
+    long node;
+    double lat;
+    double lon;
+
+    count = 0;
+    for (node = 0; node < layout->width * layout->height; node += layout->poiStride) {
+        if (out != NULL) {
+            nodePoint(layout, node, &lat, &lon);
+            if (count % DUPLICATE_EVERY == DUPLICATE_EVERY - 1) {
+                fprintf(out, "%ld\tPOI\t%.9f\t%.9f\n", node + 1, lat, lon);
+            }
+            else {
+                fprintf(out, "%ld\tPlace %ld\t%.9f\t%.9f\n", node + 1, count - count / DUPLICATE_EVERY + 1, lat, lon);
+            }
+        }
+        count++;
+    }
+    return count;
+}
+
+/**
+ * Helper function to write one road segment in both directions.
+ * The length is the straight line stretched by up to 10% and rounded
+ * up to centimeters, so it is never shorter than the straight line.
+ */
+static void writeSegment(FILE *out, const city_layout_t *layout, long from, long to, const char *kind, long number) {
+    double lat1;
+    double lon1;
+    double lat2;
+    double lon2;
+    double length;
+
+    nodePoint(layout, from, &lat1, &lon1);
+    nodePoint(layout, to, &lat2, &lon2);
+    length = calculateDistance(lat1, lon1, lat2, lon2) * (1.0 + 0.1 * unit(mix(from, to)));
+    length = ceil(length * 100.0) / 100.0;
+    fprintf(out, "%ld\t%ld\t%.2f\t%.9f\t%.9f\t%s %ld\n", from + 1, to + 1, length, lat1, lon1, kind, number);
+    fprintf(out, "%ld\t%ld\t%.2f\t%.9f\t%.9f\t%s %ld\n", to + 1, from + 1, length, lat2, lon2, kind, number);
+}
+
+/**
+ * Write the road lines, or only count them if out is NULL: every row
+ * is a two-way street and every AVENUE_EVERY-th column a two-way avenue,
+ * so the whole grid is connected.
+ * Returns the number of roads.
+ */
+long writeRoads(FILE *out, const city_layout_t *layout) {
+    long count;
+    long node;
+    long x;
+    long y;
+
+    count = 0;
+    for (y = 0; y < layout->height; y++) {
+        for (x = 0; x < layout->width; x++) {
+            node = y * layout->width + x;
+            if (x + 1 < layout->width) {
+                if (out != NULL) {
+                    writeSegment(out, layout, node, node + 1, "Street", y + 1);
+                }
+                count += 2;
+            }
+            if (x % AVENUE_EVERY == 0 && y + 1 < layout->height) {
+                if (out != NULL) {
+                    writeSegment(out, layout, node, node + layout->width, "Avenue", x / AVENUE_EVERY + 1);
+                }
+                count += 2;
+            }
+        }
+    }
+    return count;
+}
+
+/**
+ * Main function
+ */
+int main(int argc, char *argv[]) {
+    city_layout_t layout;
+    long scale;
+    char *end;
+
+    if (argc != 2) {
+        printUsage(argv[0]);
+        return argc == 1 ? 0 : 1;
+    }
+
+    scale = strtol(argv[1], &end, 10);
+    if (end == argv[1] || *end != '\0' || scale < 1 || scale > 10000) {
+        fprintf(stderr, "Error: Invalid scale '%s'\n", argv[1]);
+        return 1;
+    }
+
+    // Counts come first in the file, so count each section before writing it
+    planCity(&layout, scale);
+    printf("%ld\n", writePois(NULL, &layout));
+    writePois(stdout, &layout);
+    printf("%ld\n", writeRoads(NULL, &layout));
+    writeRoads(stdout, &layout);
+
+    if (fflush(stdout) != 0 || ferror(stdout)) {
+        fprintf(stderr, "Error: Cannot write output\n");
+        return 1;
+    }
+    return 0;
+}
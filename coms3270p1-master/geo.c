@@ -0,0 +1,623 @@
+#include "geo.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// Relative slack for rounding when comparing projected and exact distances
+#define BOUND_SLACK 1e-6
+// Adding and subtracting 1.5 * 2^52 rounds a small double to an integer
+#define ROUND_MAGIC 6755399441055744.0
+// Slots a coordinate store starts with
+#define GEO_STORE_INITIAL_SPACE 100
+
+// Taylor coefficients of sin(x)/x in x^2; on [-pi/2, pi/2] the first
+// term left out is below 2e-18
+static const double SIN_COEFFS[] = {
+    1.0, -0.16666666666666666, 0.008333333333333333, -0.0001984126984126984,
+    2.7557319223985893e-06, -2.505210838544172e-08, 1.6059043836821613e-10,
+    -7.647163731819816e-13, 2.8114572543455206e-15, -8.22063524662433e-18,
+    1.9572941063391263e-20
+};
+#define SIN_TERMS 11
+
+// Taylor coefficients of cos(x) in x^2, same interval, error below 1e-19
+static const double COS_COEFFS[] = {
+    1.0, -0.5, 0.041666666666666664, -0.001388888888888889, 2.48015873015873e-05,
+    -2.755731922398589e-07, 2.08767569878681e-09, -1.1470745597729725e-11,
+    4.779477332387385e-14, -1.5619206968586225e-16, 4.110317623312165e-19,
+    -8.896791392450574e-22
+};
+#define COS_TERMS 12
+
+// Taylor coefficients of asin(x)/x in x^2; for x in [0, 1/2] the terms
+// left out add up to less than 1e-17
+static const double ASIN_COEFFS[] = {
+    1.0, 0.16666666666666666, 0.075, 0.044642857142857144, 0.030381944444444444,
+    0.022372159090909092, 0.017352764423076924, 0.01396484375, 0.011551800896139705,
+    0.009761609529194078, 0.008390335809616815, 0.0073125258735988454,
+    0.006447210311889649, 0.005740037670841924, 0.005153309682319905,
+    0.004660143486915096, 0.004240907093679363, 0.003880964558837669,
+    0.0035692053938259347, 0.003297059503473485, 0.0030578216492580306,
+    0.002846178401108942, 0.00265787063820729, 0.0024894486782468836,
+    0.002338091892111975, 0.0022014739737101384, 0.0020776610325181676
+};
+#define ASIN_TERMS 27
+
+//One-to-many distance kernel
+typedef void (*haversine_kernel_t)(double lat0, double lon0, const double *lats, const double *lons, double *out, int n);
+
+//A point projected onto the local plane, in meters
+typedef struct {
+    double x;
+    double y;
+    int pos;
+} plane_point_t;
+
+/**
+ * Calculates distance between two lat/lon points using Haversine formula.
+ */
+double calculateDistance(double lat1, double lon1, double lat2, double lon2) {
+    double lat1_rad;
+    double lat2_rad;
+    double dlat;
+    double dlon;
+    double a;
+    double c;
+
+    // Convert to radians
+    lat1_rad = lat1 * M_PI / 180.0;
+    lat2_rad = lat2 * M_PI / 180.0;
+    dlat = (lat2 - lat1) * M_PI / 180.0;
+    dlon = (lon2 - lon1) * M_PI / 180.0;
+
+    // Haversine formula
+    a = sin(dlat/2) * sin(dlat/2) + cos(lat1_rad) * cos(lat2_rad) * sin(dlon/2) * sin(dlon/2);
+    c = 2 * atan2(sqrt(a), sqrt(1-a));
+
+    return EARTH_RADIUS * c;
+}
+
+/**
+ * Creates an empty coordinate store.
+ */
+geo_store_t *createGeoStore(int space) {
+    geo_store_t *store = (geo_store_t *)calloc(1, sizeof(geo_store_t));
+    if (store == NULL) {
+        return NULL;
+    }
+    if (!resizeGeoStore(store, space > 0 ? space : GEO_STORE_INITIAL_SPACE)) {
+        freeGeoStore(store);
+        return NULL;
+    }
+    store->count = 0;
+    return store;
+}
+
+/**
+ * Frees the coordinate store.
+ */
+void freeGeoStore(geo_store_t *store) {
+    if (store == NULL) {
+        return;
+    }
+
+    free(store->lat);
+    free(store->lon);
+    free(store->latRad);
+    free(store->lonRad);
+    free(store->cosLat);
+    free(store);
+}
+
+/**
+ * Helper function to grow one array of the store to newSpace entries.
+ */
+static int growColumn(double **column, int newSpace) {
+    double *grown = (double *)realloc(*column, sizeof(double) * newSpace);
+    if (grown == NULL) {
+        return 0;
+    }
+    *column = grown;
+    return 1;
+}
+
+/**
+ * Grows the store to hold count slots.
+ */
+int resizeGeoStore(geo_store_t *store, int count) {
+    if (count <= store->count) {
+        return 1;
+    }
+
+    if (count > store->space) {
+        int newSpace = store->space > 0 ? store->space : GEO_STORE_INITIAL_SPACE;
+        while (newSpace < count) {
+            newSpace *= 2;
+        }
+        //A failed realloc leaves the old array, so the store stays usable
+        if (!growColumn(&store->lat, newSpace) || !growColumn(&store->lon, newSpace) ||
+            !growColumn(&store->latRad, newSpace) || !growColumn(&store->lonRad, newSpace) ||
+            !growColumn(&store->cosLat, newSpace)) {
+            return 0;
+        }
+        store->space = newSpace;
+    }
+
+    for (int i = store->count; i < count; i++) {
+        store->lat[i] = NAN;
+        store->lon[i] = NAN;
+        store->latRad[i] = NAN;
+        store->lonRad[i] = NAN;
+        store->cosLat[i] = NAN;
+    }
+    store->count = count;
+    return 1;
+}
+
+/**
+ * Sets the coordinates of one slot and its derived values.
+ */
+void setGeoPoint(geo_store_t *store, int slot, double lat, double lon) {
+    store->lat[slot] = lat;
+    store->lon[slot] = lon;
+    //Same expressions as calculateDistance() so geoStoreDistance() matches it
+    store->latRad[slot] = lat * M_PI / 180.0;
+    store->lonRad[slot] = lon * M_PI / 180.0;
+    store->cosLat[slot] = cos(store->latRad[slot]);
+}
+
+/**
+ * Checks whether a slot has coordinates.
+ */
+int hasGeoPoint(const geo_store_t *store, int slot) {
+    return slot >= 0 && slot < store->count && !isnan(store->lat[slot]);
+}
+
+/**
+ * Calculates the great-circle distance between two slots.
+ */
+double geoStoreDistance(const geo_store_t *store, int a, int b) {
+    double dlat = (store->lat[b] - store->lat[a]) * M_PI / 180.0;
+    double dlon = (store->lon[b] - store->lon[a]) * M_PI / 180.0;
+    double h = sin(dlat/2) * sin(dlat/2) + store->cosLat[a] * store->cosLat[b] * sin(dlon/2) * sin(dlon/2);
+    return EARTH_RADIUS * (2 * atan2(sqrt(h), sqrt(1-h)));
+}
+
+/**
+ * Helper function to fill out[] with calculateDistance() one point at a time.
+ */
+static void haversineScalar(double lat0, double lon0, const double *lats, const double *lons, double *out, int n) {
+    for (int i = 0; i < n; i++) {
+        out[i] = calculateDistance(lat0, lon0, lats[i], lons[i]);
+    }
+}
+
+#if defined(__x86_64__)
+
+// --- SSE2 kernel, 2 points at a time (every x86-64 CPU has SSE2) ---
+
+/**
+ * Helper function to evaluate a polynomial in z with Horner's rule.
+ */
+static inline __m128d sse2Horner(__m128d z, const double *coeffs, int terms) {
+    __m128d sum = _mm_set1_pd(coeffs[terms - 1]);
+    for (int k = terms - 2; k >= 0; k--) {
+        sum = _mm_add_pd(_mm_mul_pd(sum, z), _mm_set1_pd(coeffs[k]));
+    }
+    return sum;
+}
+
+/**
+ * Helper function to compute the central angle for two lanes from
+ * a = sin^2(dlat/2) + cos(lat1)cos(lat2)sin^2(dlon/2), as 2*asin(sqrt(a)).
+ * Above sin(angle/2) = 1/2, asin(x) = pi/2 - 2*asin(sqrt((1 - x)/2))
+ * keeps the polynomial on [0, 1/2]; 1 - x is taken as (1 - a)/(1 + x)
+ * so it is no less accurate than the sqrt(1 - a) of calculateDistance().
+ */
+static inline __m128d sse2Angle(__m128d a) {
+    __m128d one = _mm_set1_pd(1.0);
+    a = _mm_min_pd(_mm_max_pd(a, _mm_setzero_pd()), one);
+    __m128d x = _mm_sqrt_pd(a);
+    __m128d small = _mm_cmple_pd(x, _mm_set1_pd(0.5));
+    __m128d folded = _mm_sqrt_pd(_mm_div_pd(_mm_sub_pd(one, a), _mm_mul_pd(_mm_add_pd(one, x), _mm_set1_pd(2.0))));
+    __m128d u = _mm_or_pd(_mm_and_pd(small, x), _mm_andnot_pd(small, folded));
+    __m128d p = _mm_mul_pd(u, sse2Horner(_mm_mul_pd(u, u), ASIN_COEFFS, ASIN_TERMS));
+    __m128d big = _mm_sub_pd(_mm_set1_pd(M_PI / 2), _mm_add_pd(p, p));
+    __m128d half = _mm_or_pd(_mm_and_pd(small, p), _mm_andnot_pd(small, big));
+    return _mm_add_pd(half, half);
+}
+
+/**
+ * Helper function for the SSE2 kernel.
+ */
+static void haversineSse2(double lat0, double lon0, const double *lats, const double *lons, double *out, int n) {
+    __m128d toRad = _mm_set1_pd(M_PI);
+    __m128d deg = _mm_set1_pd(180.0);
+    __m128d vlat0 = _mm_set1_pd(lat0);
+    __m128d vlon0 = _mm_set1_pd(lon0);
+    __m128d cos0 = _mm_set1_pd(cos(lat0 * M_PI / 180.0));
+    __m128d half = _mm_set1_pd(0.5);
+    __m128d pi = _mm_set1_pd(M_PI);
+    __m128d invPi = _mm_set1_pd(1.0 / M_PI);
+    __m128d magic = _mm_set1_pd(ROUND_MAGIC);
+    __m128d radius = _mm_set1_pd(EARTH_RADIUS);
+    int i = 0;
+
+    for (; i + 2 <= n; i += 2) {
+        __m128d lat = _mm_loadu_pd(lats + i);
+        __m128d lon = _mm_loadu_pd(lons + i);
+        __m128d latRad = _mm_div_pd(_mm_mul_pd(lat, toRad), deg);
+        __m128d h1 = _mm_mul_pd(_mm_div_pd(_mm_mul_pd(_mm_sub_pd(lat, vlat0), toRad), deg), half);
+        __m128d h2 = _mm_mul_pd(_mm_div_pd(_mm_mul_pd(_mm_sub_pd(lon, vlon0), toRad), deg), half);
+
+        //sin^2 has period pi, so bring dlon/2 into [-pi/2, pi/2]
+        __m128d k = _mm_sub_pd(_mm_add_pd(_mm_mul_pd(h2, invPi), magic), magic);
+        h2 = _mm_sub_pd(h2, _mm_mul_pd(k, pi));
+
+        __m128d s1 = _mm_mul_pd(h1, sse2Horner(_mm_mul_pd(h1, h1), SIN_COEFFS, SIN_TERMS));
+        __m128d s2 = _mm_mul_pd(h2, sse2Horner(_mm_mul_pd(h2, h2), SIN_COEFFS, SIN_TERMS));
+        __m128d c = sse2Horner(_mm_mul_pd(latRad, latRad), COS_COEFFS, COS_TERMS);
+        __m128d a = _mm_add_pd(_mm_mul_pd(s1, s1), _mm_mul_pd(_mm_mul_pd(cos0, c), _mm_mul_pd(s2, s2)));
+        _mm_storeu_pd(out + i, _mm_mul_pd(radius, sse2Angle(a)));
+    }
+    haversineScalar(lat0, lon0, lats + i, lons + i, out + i, n - i);
+}
+
+// --- AVX2 + FMA kernel, 4 points at a time ---
+
+/**
+ * Helper function to evaluate a polynomial in z with Horner's rule.
+ */
+__attribute__((target("avx2,fma")))
+static inline __m256d avx2Horner(__m256d z, const double *coeffs, int terms) {
+    __m256d sum = _mm256_set1_pd(coeffs[terms - 1]);
+    for (int k = terms - 2; k >= 0; k--) {
+        sum = _mm256_fmadd_pd(sum, z, _mm256_set1_pd(coeffs[k]));
+    }
+    return sum;
+}
+
+/**
+ * Helper function to compute the central angle for four lanes (see sse2Angle()).
+ */
+__attribute__((target("avx2,fma")))
+static inline __m256d avx2Angle(__m256d a) {
+    __m256d one = _mm256_set1_pd(1.0);
+    a = _mm256_min_pd(_mm256_max_pd(a, _mm256_setzero_pd()), one);
+    __m256d x = _mm256_sqrt_pd(a);
+    __m256d small = _mm256_cmp_pd(x, _mm256_set1_pd(0.5), _CMP_LE_OQ);
+    __m256d folded = _mm256_sqrt_pd(_mm256_div_pd(_mm256_sub_pd(one, a), _mm256_mul_pd(_mm256_add_pd(one, x), _mm256_set1_pd(2.0))));
+    __m256d u = _mm256_blendv_pd(folded, x, small);
+    __m256d p = _mm256_mul_pd(u, avx2Horner(_mm256_mul_pd(u, u), ASIN_COEFFS, ASIN_TERMS));
+    __m256d big = _mm256_fnmadd_pd(_mm256_set1_pd(2.0), p, _mm256_set1_pd(M_PI / 2));
+    __m256d half = _mm256_blendv_pd(big, p, small);
+    return _mm256_add_pd(half, half);
+}
+
+/**
+ * Helper function for the AVX2 kernel.
+ */
+__attribute__((target("avx2,fma")))
+static void haversineAvx2(double lat0, double lon0, const double *lats, const double *lons, double *out, int n) {
+    __m256d toRad = _mm256_set1_pd(M_PI);
+    __m256d deg = _mm256_set1_pd(180.0);
+    __m256d vlat0 = _mm256_set1_pd(lat0);
+    __m256d vlon0 = _mm256_set1_pd(lon0);
+    __m256d cos0 = _mm256_set1_pd(cos(lat0 * M_PI / 180.0));
+    __m256d half = _mm256_set1_pd(0.5);
+    __m256d pi = _mm256_set1_pd(M_PI);
+    __m256d invPi = _mm256_set1_pd(1.0 / M_PI);
+    __m256d radius = _mm256_set1_pd(EARTH_RADIUS);
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m256d lat = _mm256_loadu_pd(lats + i);
+        __m256d lon = _mm256_loadu_pd(lons + i);
+        __m256d latRad = _mm256_div_pd(_mm256_mul_pd(lat, toRad), deg);
+        __m256d h1 = _mm256_mul_pd(_mm256_div_pd(_mm256_mul_pd(_mm256_sub_pd(lat, vlat0), toRad), deg), half);
+        __m256d h2 = _mm256_mul_pd(_mm256_div_pd(_mm256_mul_pd(_mm256_sub_pd(lon, vlon0), toRad), deg), half);
+
+        //sin^2 has period pi, so bring dlon/2 into [-pi/2, pi/2]
+        __m256d k = _mm256_round_pd(_mm256_mul_pd(h2, invPi), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        h2 = _mm256_fnmadd_pd(k, pi, h2);
+
+        __m256d s1 = _mm256_mul_pd(h1, avx2Horner(_mm256_mul_pd(h1, h1), SIN_COEFFS, SIN_TERMS));
+        __m256d s2 = _mm256_mul_pd(h2, avx2Horner(_mm256_mul_pd(h2, h2), SIN_COEFFS, SIN_TERMS));
+        __m256d c = avx2Horner(_mm256_mul_pd(latRad, latRad), COS_COEFFS, COS_TERMS);
+        __m256d a = _mm256_fmadd_pd(s1, s1, _mm256_mul_pd(_mm256_mul_pd(cos0, c), _mm256_mul_pd(s2, s2)));
+        _mm256_storeu_pd(out + i, _mm256_mul_pd(radius, avx2Angle(a)));
+    }
+    haversineScalar(lat0, lon0, lats + i, lons + i, out + i, n - i);
+}
+
+#endif
+
+static haversine_kernel_t haversineKernel = NULL;
+static const char *haversineName = "scalar";
+
+/**
+ * Chooses the haversineBatch() kernel.
+ */
+int selectHaversineKernel(const char *name) {
+    int automatic = strcmp(name, "auto") == 0;
+
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if ((automatic || strcmp(name, "avx2") == 0) &&
+        __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        haversineKernel = haversineAvx2;
+        haversineName = "avx2";
+        return 1;
+    }
+    if (automatic || strcmp(name, "sse2") == 0) {
+        haversineKernel = haversineSse2;
+        haversineName = "sse2";
+        return 1;
+    }
+#endif
+    if (automatic || strcmp(name, "scalar") == 0) {
+        haversineKernel = haversineScalar;
+        haversineName = "scalar";
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Retrieves the name of the kernel in use.
+ */
+const char *haversineKernelName() {
+    if (haversineKernel == NULL) {
+        selectHaversineKernel("auto");
+    }
+    return haversineName;
+}
+
+/**
+ * Calculates the great-circle distance from one point to many.
+ */
+void haversineBatch(double lat0, double lon0, const double *lats, const double *lons, double *out, int n) {
+    if (haversineKernel == NULL) {
+        selectHaversineKernel("auto");
+    }
+    haversineKernel(lat0, lon0, lats, lons, out, n);
+}
+
+/**
+ * Helper function to compare every pair of points in order.
+ * Each row is computed with haversineBatch(); a pair is rechecked with
+ * calculateDistance() only if its batch distance is close enough to the
+ * best so far that the exact value might beat it, so the result is
+ * exactly that of calling calculateDistance() on every pair.
+ * @param order Position to report for each point, or NULL for 0..count-1.
+ */
+static int scanPairs(const double *lats, const double *lons, const int *order, int count,
+                     int *first, int *second, double *maxDistance) {
+    double best = 0;
+    int found = 0;
+
+    double *row = (double *)malloc(sizeof(double) * (count + 1));
+    if (row == NULL) {
+        return -1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        int rest = count - i - 1;
+        haversineBatch(lats[i], lons[i], lats + i + 1, lons + i + 1, row, rest);
+        for (int k = 0; k < rest; k++) {
+            if (row[k] < best * (1.0 - 2 * HAVERSINE_BATCH_ERROR) - 2 * HAVERSINE_BATCH_ABS_ERROR) {
+                continue;
+            }
+            int j = i + 1 + k;
+            double dist = calculateDistance(lats[i], lons[i], lats[j], lons[j]);
+            if (dist > best) {
+                best = dist;
+                *first = order ? order[i] : i;
+                *second = order ? order[j] : j;
+                found = 1;
+            }
+        }
+    }
+
+    free(row);
+    *maxDistance = best;
+    return found;
+}
+
+/**
+ * Finds the two points farthest apart by comparing every pair.
+ */
+int findDiameterExact(const double *lats, const double *lons, int count, int *first, int *second, double *maxDistance) {
+    return scanPairs(lats, lons, NULL, count, first, second, maxDistance);
+}
+
+/**
+ * Helper function to order projected points by x, then y.
+ */
+static int comparePlanePoints(const void *a, const void *b) {
+    const plane_point_t *p = (const plane_point_t *)a;
+    const plane_point_t *q = (const plane_point_t *)b;
+    if (p->x != q->x) {
+        return p->x < q->x ? -1 : 1;
+    }
+    if (p->y != q->y) {
+        return p->y < q->y ? -1 : 1;
+    }
+    return p->pos - q->pos;
+}
+
+/**
+ * Helper function to get twice the signed area of triangle (o, a, b);
+ * positive when the turn o -> a -> b is counter-clockwise.
+ */
+static double cross(const plane_point_t *o, const plane_point_t *a, const plane_point_t *b) {
+    return (a->x - o->x) * (b->y - o->y) - (a->y - o->y) * (b->x - o->x);
+}
+
+/**
+ * Helper function to build the convex hull with Andrew's monotone chain.
+ * @param points The points, sorted by comparePlanePoints().
+ * @param hull Array of at least count + 1 entries that receives the hull
+ * counter-clockwise, without collinear points.
+ * @return Number of hull vertices.
+ */
+static int convexHull(const plane_point_t *points, int count, plane_point_t *hull) {
+    int size = 0;
+
+    if (count < 3) {
+        for (int i = 0; i < count; i++) {
+            hull[size++] = points[i];
+        }
+        return size;
+    }
+
+    for (int i = 0; i < count; i++) {
+        while (size >= 2 && cross(&hull[size - 2], &hull[size - 1], &points[i]) <= 0) {
+            size--;
+        }
+        hull[size++] = points[i];
+    }
+    int lower = size + 1;
+    for (int i = count - 2; i >= 0; i--) {
+        while (size >= lower && cross(&hull[size - 2], &hull[size - 1], &points[i]) <= 0) {
+            size--;
+        }
+        hull[size++] = points[i];
+    }
+    return size - 1;
+}
+
+/**
+ * Finds the two points farthest apart using a convex hull.
+ */
+int findDiameterHull(const double *lats, const double *lons, int count, int *first, int *second, double *maxDistance) {
+    if (count < 2) {
+        *maxDistance = 0;
+        return 0;
+    }
+
+    //A point with a non-finite coordinate is NaN away from every other,
+    //so it is never part of the diameter; it would also break the sort
+    int finite = 0;
+    double latMin = INFINITY;
+    double latMax = -INFINITY;
+    double lonMin = INFINITY;
+    double lonMax = -INFINITY;
+    for (int i = 0; i < count; i++) {
+        if (!isfinite(lats[i]) || !isfinite(lons[i])) {
+            continue;
+        }
+        finite++;
+        if (lats[i] < latMin) latMin = lats[i];
+        if (lats[i] > latMax) latMax = lats[i];
+        if (lons[i] < lonMin) lonMin = lons[i];
+        if (lons[i] > lonMax) lonMax = lons[i];
+    }
+    if (finite < 2) {
+        *maxDistance = 0;
+        return 0;
+    }
+
+    //Project around the middle of the bounding box (equirectangular)
+    double lat0 = (latMin + latMax) / 2 * M_PI / 180.0;
+    double lon0 = (lonMin + lonMax) / 2 * M_PI / 180.0;
+    double cos0 = cos(lat0);
+
+    //A straight line on the plane maps to a path on the sphere at most
+    //cos(lat)/cos(lat0) times longer, and the geodesic is shorter still
+    double cosMax = (latMin <= 0 && latMax >= 0) ? 1.0 : fmax(cos(latMin * M_PI / 180.0), cos(latMax * M_PI / 180.0));
+    if (cos0 < 1e-9) {
+        return findDiameterExact(lats, lons, count, first, second, maxDistance);
+    }
+    double stretch = fmax(1.0, cosMax / cos0) * (1.0 + BOUND_SLACK);
+
+    plane_point_t *points = (plane_point_t *)malloc(sizeof(plane_point_t) * finite);
+    plane_point_t *hull = (plane_point_t *)malloc(sizeof(plane_point_t) * (finite + 1));
+    int *keep = (int *)malloc(sizeof(int) * count);
+    unsigned char *reaches = (unsigned char *)calloc(count, sizeof(unsigned char));
+    if (points == NULL || hull == NULL || keep == NULL || reaches == NULL) {
+        free(points);
+        free(hull);
+        free(keep);
+        free(reaches);
+        return -1;
+    }
+
+    int n = 0;
+    for (int i = 0; i < count; i++) {
+        if (!isfinite(lats[i]) || !isfinite(lons[i])) {
+            continue;
+        }
+        points[n].x = EARTH_RADIUS * cos0 * (lons[i] * M_PI / 180.0 - lon0);
+        points[n].y = EARTH_RADIUS * (lats[i] * M_PI / 180.0 - lat0);
+        points[n].pos = i;
+        n++;
+    }
+    qsort(points, n, sizeof(plane_point_t), comparePlanePoints);
+    int h = convexHull(points, n, hull);
+
+    //Rotating calipers: for each hull edge, advance to the vertex farthest
+    //from it; every antipodal pair is checked with the exact distance
+    double lowerBound = 0;
+    int j = 1 % h;
+    for (int i = 0; i < h && h > 1; i++) {
+        int next = (i + 1) % h;
+        while (cross(&hull[i], &hull[next], &hull[(j + 1) % h]) > cross(&hull[i], &hull[next], &hull[j])) {
+            j = (j + 1) % h;
+        }
+        int candidates[2] = {i, next};
+        for (int c = 0; c < 2; c++) {
+            const plane_point_t *p = &hull[candidates[c]];
+            double dist = calculateDistance(lats[p->pos], lons[p->pos], lats[hull[j].pos], lons[hull[j].pos]);
+            if (dist > lowerBound) {
+                lowerBound = dist;
+            }
+        }
+    }
+
+    //The farthest point from any point is a hull vertex, so this bounds
+    //every pair the point is part of
+    for (int i = 0; i < n; i++) {
+        double farthest = 0;
+        for (int v = 0; v < h; v++) {
+            double dx = points[i].x - hull[v].x;
+            double dy = points[i].y - hull[v].y;
+            double d = dx * dx + dy * dy;
+            if (d > farthest) {
+                farthest = d;
+            }
+        }
+        if (sqrt(farthest) * stretch >= lowerBound * (1.0 - BOUND_SLACK)) {
+            reaches[points[i].pos] = 1;
+        }
+    }
+
+    //Positions in input order, so ties are broken as in findDiameterExact()
+    int kept = 0;
+    for (int i = 0; i < count; i++) {
+        if (reaches[i]) {
+            keep[kept++] = i;
+        }
+    }
+    int found = -1;
+    double *keptLats = (double *)malloc(sizeof(double) * (kept + 1));
+    double *keptLons = (double *)malloc(sizeof(double) * (kept + 1));
+    if (keptLats != NULL && keptLons != NULL) {
+        for (int i = 0; i < kept; i++) {
+            keptLats[i] = lats[keep[i]];
+            keptLons[i] = lons[keep[i]];
+        }
+        found = scanPairs(keptLats, keptLons, keep, kept, first, second, maxDistance);
+    }
+    free(keptLats);
+    free(keptLons);
+
+    free(points);
+    free(hull);
+    free(keep);
+    free(reaches);
+    return found;
+}
@@ -0,0 +1,144 @@
+#ifndef GEO_H
+#define GEO_H
+
+// Earth radius in meters for Haversine formula
+#define EARTH_RADIUS 6371000.0
+// Largest difference between haversineBatch() and calculateDistance():
+// relative, and absolute in meters (see haversineBatch())
+#define HAVERSINE_BATCH_ERROR 1e-12
+#define HAVERSINE_BATCH_ABS_ERROR 1.0
+
+//Coordinates of every node, one array per field, indexed by node slot
+//(the position in graph->nodes, which is also the snapshot's dense index).
+//Slots of nodes without coordinates hold NAN.
+typedef struct {
+    int count;
+    int space;
+    double *lat;
+    double *lon;
+    double *latRad;
+    double *lonRad;
+    double *cosLat;
+} geo_store_t;
+
+/**
+* Calculates the great-circle distance between two points.
+* @param lat1 Latitude of the first point in degrees.
+* @param lon1 Longitude of the first point in degrees.
+* @param lat2 Latitude of the second point in degrees.
+* @param lon2 Longitude of the second point in degrees.
+* @return Distance in meters (Haversine formula).
+**/
+double calculateDistance(double lat1, double lon1, double lat2, double lon2);
+/**
+* Calculates the great-circle distance from one point to many.
+* @param lat0 Latitude of the origin in degrees.
+* @param lon0 Longitude of the origin in degrees.
+* @param lats Latitudes of the other points in degrees.
+* @param lons Longitudes of the other points in degrees.
+* @param out Array of n entries that receives the distances in meters.
+* @param n Number of points.
+* Same formula as calculateDistance(), but sin, cos and asin are
+* evaluated with polynomials on 4 (AVX2 + FMA) or 2 (SSE2) points at a
+* time. The kernel is picked at run time from what the CPU supports,
+* with calculateDistance() as the fallback. Each result is within
+* HAVERSINE_BATCH_ERROR (relative) of calculateDistance() (measured
+* below 1e-13), or within HAVERSINE_BATCH_ABS_ERROR meters for points
+* less than 20 km from antipodal, where the formula itself is
+* ill-conditioned (measured below 0.4 m). Callers that must reproduce
+* calculateDistance() exactly (e.g. to break ties) should recompute the
+* few distances that matter with it.
+**/
+void haversineBatch(double lat0, double lon0, const double* lats, const double* lons, double* out, int n);
+/**
+* Chooses the haversineBatch() kernel, for tests and benchmarks.
+* @param name "avx2", "sse2", "scalar", or "auto" for the best available.
+* @return 1 if the kernel is available on this CPU and was selected, 0 otherwise.
+**/
+int selectHaversineKernel(const char* name);
+/**
+* Retrieves the name of the kernel haversineBatch() is using.
+**/
+const char* haversineKernelName();
+/**
+* Creates an empty coordinate store.
+* @param space Number of slots to allocate up front (0 picks a default).
+* @return Pointer to the store, or NULL if memory allocation fails.
+**/
+geo_store_t* createGeoStore(int space);
+/**
+* Frees the coordinate store.
+* If the pointer is NULL, the function does nothing.
+**/
+void freeGeoStore(geo_store_t* store);
+/**
+* Grows the store to hold count slots, doubling its arrays as needed.
+* @param store Pointer to the store.
+* @param count New number of slots; new slots have no coordinates (NAN).
+* @return 1 on success, 0 if memory allocation fails.
+* Shrinking is not supported; a smaller count leaves the store as it is.
+**/
+int resizeGeoStore(geo_store_t* store, int count);
+/**
+* Sets the coordinates of one slot and its derived values.
+* @param store Pointer to the store.
+* @param slot Slot to set, less than store->count.
+* @param lat Latitude in degrees.
+* @param lon Longitude in degrees.
+**/
+void setGeoPoint(geo_store_t* store, int slot, double lat, double lon);
+/**
+* Checks whether a slot has coordinates.
+* @return 1 if it does, 0 if not or if the slot is out of range.
+**/
+int hasGeoPoint(const geo_store_t* store, int slot);
+/**
+* Calculates the great-circle distance between two slots.
+* @param store Pointer to the store.
+* @param a First slot.
+* @param b Second slot.
+* @return Distance in meters, bit-identical to calculateDistance() on the
+* same coordinates but without recomputing the cosines, or NAN if either
+* slot has no coordinates.
+**/
+double geoStoreDistance(const geo_store_t* store, int a, int b);
+/**
+* Finds the two points farthest apart by comparing every pair.
+* @param lats Latitudes in degrees.
+* @param lons Longitudes in degrees.
+* @param count Number of points.
+* @param first Set to the position of the first point of the pair.
+* @param second Set to the position of the second point (first < second).
+* @param maxDistance Set to their calculateDistance().
+* @return 1 if some pair is more than 0 meters apart, 0 if not,
+* or -1 if memory allocation fails.
+* Of several pairs at the maximum distance, the first in (first, second)
+* order is returned. O(n^2), with each row computed by haversineBatch()
+* and only pairs that could beat the current best rechecked with
+* calculateDistance(), so the result is the same as a scalar scan.
+**/
+int findDiameterExact(const double* lats, const double* lons, int count, int* first, int* second, double* maxDistance);
+/**
+* Finds the two points farthest apart, with the same result as
+* findDiameterExact() but usually in O(n log n).
+* @param lats Latitudes in degrees.
+* @param lons Longitudes in degrees.
+* @param count Number of points.
+* @param first Set to the position of the first point of the pair.
+* @param second Set to the position of the second point (first < second).
+* @param maxDistance Set to their calculateDistance().
+* @return 1 if some pair is more than 0 meters apart, 0 if not,
+* or -1 if memory allocation fails.
+* The points are projected onto a local plane and their convex hull is
+* taken. Rotating calipers visit every antipodal pair of hull vertices
+* and the largest Haversine distance among them is a lower bound on the
+* answer. Every point whose farthest hull vertex, scaled by the worst
+* stretch of the projection, cannot reach that bound is dropped, and the
+* remaining points are compared pairwise exactly. Points spread over so
+* much of the globe that the bound is useless simply leave more points.
+* Points with a NaN or infinite coordinate are left out first: their
+* distances are NaN, so findDiameterExact() never picks them either.
+**/
+int findDiameterHull(const double* lats, const double* lons, int count, int* first, int* second, double* maxDistance);
+
+#endif // GEO_H
@@ -1,22 +1,153 @@
 #include "graph.h"
+#include "stats.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #define INITIAL_CAPACITY 100
 
+#define INDEX_EMPTY -1
+
 /**
- * Helper function to retrieve a node by its ID.
+ * Helper function to hash a node ID into the index table.
+ * The table size is always a power of two, so the mask picks the bucket.
  */
-node_t *findNode(graph_t *graph, int id) {
-    if (graph == NULL) {
-        return NULL;
+static int hashId(int id, int mask) {
+    unsigned int h = (unsigned int)id;
+    h ^= h >> 16;
+    h *= 0x45d9f3bu;
+    h ^= h >> 16;
+    return (int)(h & (unsigned int)mask);
+}
+
+/**
+ * Helper function to find the index bucket holding an ID.
+ * Not counted for -stats, so removing nodes and freezing the graph do
+ * not show up as findNode lookups.
+ * @return The bucket position, or -1 if the ID is not indexed.
+ */
+static int findBucket(graph_t *graph, int id) {
+    int mask = graph->indexSpace - 1;
+    int pos = hashId(id, mask);
+
+    while (graph->index[pos] != INDEX_EMPTY) {
+        if (graph->nodes[graph->index[pos]]->id == id) {
+            return pos;
+        }
+        pos = (pos + 1) & mask;
+    }
+    return -1;
+}
+
+/**
+ * Helper function to record the slot of a node in the index.
+ * The caller guarantees the ID is not already present.
+ */
+static void indexInsert(graph_t *graph, int id, int slot) {
+    int mask = graph->indexSpace - 1;
+    int pos = hashId(id, mask);
+
+    while (graph->index[pos] != INDEX_EMPTY) {
+        pos = (pos + 1) & mask;
+    }
+    graph->index[pos] = slot;
+}
+
+/**
+ * Helper function to empty a bucket in the index.
+ * Uses backward-shift deletion so that no tombstones are left behind
+ * and later probes for other IDs still find their entries.
+ */
+static void indexDelete(graph_t *graph, int pos) {
+    int mask = graph->indexSpace - 1;
+    int next = (pos + 1) & mask;
+
+    while (graph->index[next] != INDEX_EMPTY) {
+        int home = hashId(graph->nodes[graph->index[next]]->id, mask);
+
+        //Move the entry back if its home bucket is not between pos and next
+        if (((next - home) & mask) >= ((next - pos) & mask)) {
+            graph->index[pos] = graph->index[next];
+            pos = next;
+        }
+        next = (next + 1) & mask;
+    }
+    graph->index[pos] = INDEX_EMPTY;
+}
+
+/**
+ * Helper function to empty the index and re-insert every node currently
+ * in the graph at its slot.
+ */
+static void fillIndex(graph_t *graph) {
+    for (int i = 0; i < graph->indexSpace; i++) {
+        graph->index[i] = INDEX_EMPTY;
     }
     for (int i = 0; i < graph->nodeCount; i++) {
-        if (graph->nodes[i] != NULL && graph->nodes[i]->id == id) {
-            return graph->nodes[i];
+        if (graph->nodes[i] != NULL) {
+            indexInsert(graph, graph->nodes[i]->id, i);
         }
     }
-    return NULL;
+}
+
+/**
+ * Helper function to reallocate the index for a given node capacity
+ * and re-insert every node currently in the graph.
+ * @return 1 on success, 0 if memory allocation fails.
+ */
+static int rebuildIndex(graph_t *graph, int nodeSpace) {
+    int space = 1;
+    while (space < nodeSpace * 2) {
+        space *= 2;
+    }
+
+    int *newIndex = (int *)malloc(sizeof(int) * space);
+    if (newIndex == NULL) {
+        return 0;
+    }
+
+    free(graph->index);
+    graph->index = newIndex;
+    graph->indexSpace = space;
+    fillIndex(graph);
+    return 1;
+}
+
+/**
+ * Helper function to retrieve the array slot of a node by its ID.
+ * This is the lookup behind findNode() and getNodeSlot(), so it is the
+ * one counted for citydata -stats.
+ * @return The slot, or -1 if not found.
+ */
+static int findSlot(graph_t *graph, int id) {
+    if (graph == NULL) {
+        return -1;
+    }
+    int mask = graph->indexSpace - 1;
+    int pos = hashId(id, mask);
+
+    //Every bucket looked at is a probe
+    STAT_ADD(graph->findCalls, 1);
+    while (graph->index[pos] != INDEX_EMPTY) {
+        STAT_ADD(graph->findProbes, 1);
+        if (graph->nodes[graph->index[pos]]->id == id) {
+            return graph->index[pos];
+        }
+        pos = (pos + 1) & mask;
+    }
+    STAT_ADD(graph->findProbes, 1);
+    return -1;
+}
+
+/**
+ * Helper function to retrieve a node by its ID.
+ */
+node_t *findNode(graph_t *graph, int id) {
+    int slot = findSlot(graph, id);
+    if (slot == -1) {
+        return NULL;
+    }
+    return graph->nodes[slot];
 }
 
 /**
@@ -29,6 +160,7 @@ graph_t *createGraph() {
     }
 
     graph->nodeCount = 0;
+    graph->removedCount = 0;
     graph->edgeCount = 0;
     graph->nodeSpace = INITIAL_CAPACITY;
 
@@ -38,9 +170,74 @@ graph_t *createGraph() {
         return NULL;
     }
 
+    graph->index = NULL;
+    graph->arena = NULL;
+    graph->reverseEdges = 0;
+    graph->findCalls = 0;
+    graph->findProbes = 0;
+    if (!rebuildIndex(graph, graph->nodeSpace)) {
+        free(graph->nodes);
+        free(graph);
+        return NULL;
+    }
+
     return graph;
 }
 
+/**
+ * Creates a new graph backed by an arena.
+ */
+graph_t *createGraphWithArena(size_t sizeHint) {
+    graph_t *graph = createGraph();
+    if (graph == NULL) {
+        return NULL;
+    }
+
+    graph->arena = createArena(sizeHint);
+    if (graph->arena == NULL) {
+        freeGraph(graph);
+        return NULL;
+    }
+
+    return graph;
+}
+
+/**
+ * Allocates memory that lives as long as the graph.
+ */
+void *graphAlloc(graph_t *graph, size_t size) {
+    if (graph == NULL) {
+        return NULL;
+    }
+    if (graph->arena != NULL) {
+        return arenaAlloc(graph->arena, size);
+    }
+    return malloc(size);
+}
+
+/**
+ * Copies a string with graphAlloc().
+ */
+char *graphStrndup(graph_t *graph, const char *str, size_t len) {
+    if (graph == NULL) {
+        return NULL;
+    }
+    if (graph->arena != NULL) {
+        return arenaStrndup(graph->arena, str, len);
+    }
+    return strndup(str, len);
+}
+
+/**
+ * Helper function to release a node or edge, which is a no-op
+ * for memory carved from the arena.
+ */
+static void releaseMemory(graph_t *graph, void *ptr) {
+    if (graph->arena == NULL) {
+        free(ptr);
+    }
+}
+
 /**
  * Frees the memory used by the graph.
  */
@@ -49,8 +246,8 @@ void freeGraph(graph_t *graph) {
         return;
     }
 
-    //Loop through every node
-    for (int i = 0; i < graph->nodeCount; i++) {
+    //Loop through every node (the arena holds them all otherwise)
+    for (int i = 0; graph->arena == NULL && i < graph->nodeCount; i++) {
         node_t *node = graph->nodes[i];
         if (node != NULL) {
             edge_t *edge = node->edges;
@@ -65,6 +262,8 @@ void freeGraph(graph_t *graph) {
     }
 
     free(graph->nodes);
+    free(graph->index);
+    freeArena(graph->arena);
 
     free(graph);
 }
@@ -90,11 +289,16 @@ node_t *addNode(graph_t *graph, int id, void *data) {
             return NULL;
         }
         graph->nodes = newNodes;
+
+        //Grow the index with the array so it stays at most half full
+        if (!rebuildIndex(graph, newSpace)) {
+            return NULL;
+        }
         graph->nodeSpace = newSpace;
     }
 
     //Create the new node
-    node_t *newNode = (node_t *)malloc(sizeof(node_t));
+    node_t *newNode = (node_t *)graphAlloc(graph, sizeof(node_t));
     if (newNode == NULL) {
         return NULL;
     }
@@ -102,8 +306,10 @@ node_t *addNode(graph_t *graph, int id, void *data) {
     newNode->id = id;
     newNode->data = data;
     newNode->edges = NULL;
+    newNode->inEdges = NULL;
 
     graph->nodes[graph->nodeCount] = newNode;
+    indexInsert(graph, id, graph->nodeCount);
     graph->nodeCount++;
 
     return newNode;
@@ -116,6 +322,13 @@ node_t *getNode(graph_t *graph, int id) {
     return findNode(graph, id);
 }
 
+/**
+ * Retrieves the slot of a node in graph->nodes by its ID.
+ */
+int getNodeSlot(graph_t *graph, int id) {
+    return findSlot(graph, id);
+}
+
 /**
  * Retrieves an edge from the graph by its from and to node IDs.
  */
@@ -156,7 +369,7 @@ edge_t *addEdge(graph_t *graph, int fromId, int toId, float weight, void *data)
     }
 
     //Create the new edge
-    edge_t *newEdge = (edge_t *)malloc(sizeof(edge_t));
+    edge_t *newEdge = (edge_t *)graphAlloc(graph, sizeof(edge_t));
     if (newEdge == NULL) {
         return NULL;
     }
@@ -168,83 +381,228 @@ edge_t *addEdge(graph_t *graph, int fromId, int toId, float weight, void *data)
     newEdge->next = fromNode->edges; 
     fromNode->edges = newEdge; 
 
+    newEdge->fromNode = fromNode;
+    newEdge->nextIn = NULL;
+    if (graph->reverseEdges) {
+        newEdge->nextIn = toNode->inEdges;
+        toNode->inEdges = newEdge;
+    }
+
     graph->edgeCount++;
 
     return newEdge;
 }
 
 /**
- * Removes a node from the graph.
+ * Helper function to unlink an edge from its destination's incoming list.
  */
-int removeNode(graph_t *graph, int id) {
+static void unlinkInEdge(edge_t *edge) {
+    edge_t **link = &edge->toNode->inEdges;
+    while (*link != NULL && *link != edge) {
+        link = &(*link)->nextIn;
+    }
+    if (*link != NULL) {
+        *link = edge->nextIn;
+    }
+}
+
+/**
+ * Helper function to unlink an edge from its source's outgoing list.
+ */
+static void unlinkOutEdge(edge_t *edge) {
+    edge_t **link = &edge->fromNode->edges;
+    while (*link != NULL && *link != edge) {
+        link = &(*link)->next;
+    }
+    if (*link != NULL) {
+        *link = edge->next;
+    }
+}
+
+/**
+ * Helper function to build every node's incoming list from the
+ * outgoing lists, in O(V + E).
+ */
+static void linkInEdges(graph_t *graph) {
+    for (int i = 0; i < graph->nodeCount; i++) {
+        if (graph->nodes[i] != NULL) {
+            graph->nodes[i]->inEdges = NULL;
+        }
+    }
+    for (int i = 0; i < graph->nodeCount; i++) {
+        if (graph->nodes[i] == NULL) {
+            continue;
+        }
+        for (edge_t *edge = graph->nodes[i]->edges; edge != NULL; edge = edge->next) {
+            edge->fromNode = graph->nodes[i];
+            edge->nextIn = edge->toNode->inEdges;
+            edge->toNode->inEdges = edge;
+        }
+    }
+}
+
+/**
+ * Starts keeping a list of incoming edges for every node.
+ */
+int enableReverseEdges(graph_t *graph) {
     if (graph == NULL) {
         return 0;
     }
+    if (graph->reverseEdges) {
+        return 1;
+    }
 
-    //Find the node and its index
-    int nodeIndex = -1;
-    node_t *nodeToRemove = NULL;
-    for (int i = 0; i < graph->nodeCount; i++) {
-        if (graph->nodes[i]->id == id) {
-            nodeIndex = i;
-            nodeToRemove = graph->nodes[i];
-            break;
+    linkInEdges(graph);
+    graph->reverseEdges = 1;
+    return 1;
+}
+
+/**
+ * Helper function to remove the edges pointing to a node by walking
+ * its incoming list. Self-loops are left for the outgoing pass.
+ */
+static void removeInEdges(graph_t *graph, node_t *node) {
+    edge_t *edge = node->inEdges;
+    while (edge != NULL) {
+        edge_t *next = edge->nextIn;
+        if (edge->fromNode != node) {
+            unlinkOutEdge(edge);
+            releaseMemory(graph, edge);
+            graph->edgeCount--;
         }
+        edge = next;
     }
+    node->inEdges = NULL;
+}
 
-    if (nodeToRemove == NULL) {
+/**
+ * Removes a node from the graph.
+ */
+int removeNode(graph_t *graph, int id) {
+    if (graph == NULL) {
+        return 0;
+    }
+
+    //Find the node and its index
+    int bucket = findBucket(graph, id);
+    if (bucket == -1) {
         return 0; 
     }
+    int nodeIndex = graph->index[bucket];
+    node_t *nodeToRemove = graph->nodes[nodeIndex];
+
+    //Remove all incoming edges pointing to this node in O(in-degree). The
+    //first removal builds the incoming lists, which costs one pass over
+    //the edges, the same as scanning every adjacency list once
+    enableReverseEdges(graph);
+    removeInEdges(graph, nodeToRemove);
 
     //Remove all outgoing edges from this node
     edge_t *outEdge = nodeToRemove->edges;
     while (outEdge != NULL) {
         edge_t *next = outEdge->next;
-        free(outEdge);
+        if (outEdge->toNode != nodeToRemove) {
+            unlinkInEdge(outEdge);
+        }
+        releaseMemory(graph, outEdge);
         graph->edgeCount--;
         outEdge = next;
     }
     nodeToRemove->edges = NULL;
 
-    //Remove all incoming edges pointing to this node
+    releaseMemory(graph, nodeToRemove);
+    indexDelete(graph, bucket);
+
+    //Leave the slot empty so no other node moves; compactGraph() reclaims it
+    graph->nodes[nodeIndex] = NULL;
+    graph->removedCount++;
+
+    return 1;
+}
+
+/**
+ * Removes many nodes from the graph in one pass over the edges.
+ */
+int removeNodes(graph_t *graph, const int *ids, int count) {
+    if (graph == NULL || ids == NULL) {
+        return 0;
+    }
+
+    //Take the nodes out of the index first; a node is then being removed
+    //exactly when its ID is no longer found, and repeated IDs count once
+    int removed = 0;
+    for (int i = 0; i < count; i++) {
+        int bucket = findBucket(graph, ids[i]);
+        if (bucket != -1) {
+            indexDelete(graph, bucket);
+            removed++;
+        }
+    }
+    if (removed == 0) {
+        return 0;
+    }
+
+    //Drop every edge that leaves or enters a removed node
     for (int i = 0; i < graph->nodeCount; i++) {
-        if (i == nodeIndex) {
+        node_t *node = graph->nodes[i];
+        if (node == NULL) {
             continue;
         }
-        
-        node_t *otherNode = graph->nodes[i];
-        edge_t *current = otherNode->edges;
-        edge_t *prev = NULL;
-
-        while (current != NULL) {
-            if (current->toNode == nodeToRemove) {
-                edge_t *next = current->next;
-                if (prev == NULL) {
-                    otherNode->edges = next;
-                } 
-                else {
-                    prev->next = next;
-                }
-                free(current);
+
+        int gone = findBucket(graph, node->id) == -1;
+        edge_t **link = &node->edges;
+        while (*link != NULL) {
+            edge_t *edge = *link;
+            if (gone || findBucket(graph, edge->toNode->id) == -1) {
+                *link = edge->next;
+                releaseMemory(graph, edge);
                 graph->edgeCount--;
-                current = next; 
-            } 
+            }
             else {
-                prev = current;
-                current = current->next;
+                link = &edge->next;
             }
         }
     }
 
-    free(nodeToRemove);
+    //Then free the nodes, which no edge points to any more
+    for (int i = 0; i < graph->nodeCount; i++) {
+        node_t *node = graph->nodes[i];
+        if (node != NULL && findBucket(graph, node->id) == -1) {
+            releaseMemory(graph, node);
+            graph->nodes[i] = NULL;
+            graph->removedCount++;
+        }
+    }
 
-    for (int i = nodeIndex; i < graph->nodeCount - 1; i++) {
-        graph->nodes[i] = graph->nodes[i + 1];
+    if (graph->reverseEdges) {
+        linkInEdges(graph);
     }
-    graph->nodes[graph->nodeCount - 1] = NULL;
-    graph->nodeCount--;
+    return removed;
+}
 
-    return 1;
+/**
+ * Moves the remaining nodes down over the slots of removed ones.
+ */
+int compactGraph(graph_t *graph) {
+    if (graph == NULL || graph->removedCount == 0) {
+        return 0;
+    }
+
+    int live = 0;
+    for (int i = 0; i < graph->nodeCount; i++) {
+        if (graph->nodes[i] != NULL) {
+            graph->nodes[live++] = graph->nodes[i];
+        }
+    }
+    int reclaimed = graph->nodeCount - live;
+    for (int i = live; i < graph->nodeCount; i++) {
+        graph->nodes[i] = NULL;
+    }
+    graph->nodeCount = live;
+    graph->removedCount = 0;
+
+    fillIndex(graph);
+    return reclaimed;
 }
 
 /**
@@ -272,8 +630,11 @@ int removeEdge(graph_t *graph, int fromId, int toId) {
             else {
                 prev->next = current->next;
             }
+            if (graph->reverseEdges) {
+                unlinkInEdge(current);
+            }
             
-            free(current);
+            releaseMemory(graph, current);
             graph->edgeCount--;
             return 1;
         }
@@ -318,4 +679,195 @@ void printGraph(graph_t *graph) {
             }
         }
     }
-}
\ No newline at end of file
+}
+
+/**
+ * Builds a read-only CSR snapshot of the graph.
+ */
+frozen_graph_t *freezeGraph(graph_t *graph) {
+    if (graph == NULL) {
+        return NULL;
+    }
+
+    frozen_graph_t *frozen = (frozen_graph_t *)calloc(1, sizeof(frozen_graph_t));
+    if (frozen == NULL) {
+        return NULL;
+    }
+
+    //Nodes are numbered in slot order, skipping the slots of removed nodes;
+    //the graph itself is left as it is
+    int n = graph->nodeCount - graph->removedCount;
+    int m = graph->edgeCount;
+    frozen->nodeCount = n;
+    frozen->edgeCount = m;
+    frozen->indexSpace = graph->indexSpace;
+
+    //Allocate at least one element so an empty graph still gets valid arrays
+    frozen->ids = (int *)malloc(sizeof(int) * (n + 1));
+    frozen->nodeData = (void **)malloc(sizeof(void *) * (n + 1));
+    frozen->rowOffsets = (int *)malloc(sizeof(int) * (n + 1));
+    frozen->colIndices = (int *)malloc(sizeof(int) * (m + 1));
+    frozen->weights = (float *)malloc(sizeof(float) * (m + 1));
+    frozen->edgeData = (void **)malloc(sizeof(void *) * (m + 1));
+    frozen->index = (int *)malloc(sizeof(int) * graph->indexSpace);
+    int *dense = (int *)malloc(sizeof(int) * (graph->nodeCount + 1));
+
+    if (frozen->ids == NULL || frozen->nodeData == NULL || frozen->rowOffsets == NULL ||
+        frozen->colIndices == NULL || frozen->weights == NULL || frozen->edgeData == NULL ||
+        frozen->index == NULL || dense == NULL) {
+        free(dense);
+        freeFrozenGraph(frozen);
+        return NULL;
+    }
+
+    int d = 0;
+    for (int i = 0; i < graph->nodeCount; i++) {
+        dense[i] = graph->nodes[i] != NULL ? d++ : -1;
+    }
+
+    //Same table and buckets as the graph index, holding dense indices instead of slots
+    for (int i = 0; i < graph->indexSpace; i++) {
+        frozen->index[i] = graph->index[i] == INDEX_EMPTY ? INDEX_EMPTY : dense[graph->index[i]];
+    }
+
+    int e = 0;
+    for (int i = 0; i < graph->nodeCount; i++) {
+        node_t *node = graph->nodes[i];
+        if (node == NULL) {
+            continue;
+        }
+        frozen->ids[dense[i]] = node->id;
+        frozen->nodeData[dense[i]] = node->data;
+        frozen->rowOffsets[dense[i]] = e;
+
+        edge_t *edge = node->edges;
+        while (edge != NULL) {
+            frozen->colIndices[e] = dense[graph->index[findBucket(graph, edge->toNode->id)]];
+            frozen->weights[e] = edge->weight;
+            frozen->edgeData[e] = edge->data;
+            e++;
+            edge = edge->next;
+        }
+    }
+    free(dense);
+    frozen->rowOffsets[n] = e;
+
+    return frozen;
+}
+
+/**
+ * Frees a snapshot created by freezeGraph().
+ */
+void freeFrozenGraph(frozen_graph_t *frozen) {
+    if (frozen == NULL) {
+        return;
+    }
+
+    free(frozen->ids);
+    free(frozen->nodeData);
+    free(frozen->rowOffsets);
+    free(frozen->colIndices);
+    free(frozen->weights);
+    free(frozen->edgeData);
+    free(frozen->index);
+    free(frozen->revOffsets);
+    free(frozen->revColIndices);
+    free(frozen->revWeights);
+    free(frozen);
+}
+
+/**
+ * Retrieves the dense index of a node in a snapshot by its ID.
+ */
+int getFrozenIndex(frozen_graph_t *frozen, int id) {
+    if (frozen == NULL) {
+        return -1;
+    }
+
+    int mask = frozen->indexSpace - 1;
+    int pos = hashId(id, mask);
+
+    while (frozen->index[pos] != INDEX_EMPTY) {
+        if (frozen->ids[frozen->index[pos]] == id) {
+            return frozen->index[pos];
+        }
+        pos = (pos + 1) & mask;
+    }
+    return -1;
+}
+
+/**
+ * Adds the incoming edges of every node to a snapshot.
+ */
+int addReverseRows(frozen_graph_t *frozen) {
+    if (frozen == NULL) {
+        return 0;
+    }
+    if (frozen->revOffsets != NULL) {
+        return 1;
+    }
+
+    int n = frozen->nodeCount;
+    int m = frozen->edgeCount;
+    int *offsets = (int *)calloc(n + 2, sizeof(int));
+    int *cols = (int *)malloc(sizeof(int) * (m + 1));
+    float *weights = (float *)malloc(sizeof(float) * (m + 1));
+    if (offsets == NULL || cols == NULL || weights == NULL) {
+        free(offsets);
+        free(cols);
+        free(weights);
+        return 0;
+    }
+
+    //Count the incoming edges of each node, shifted by one so the prefix
+    //sum leaves each row's start in offsets[i + 1]
+    for (int e = 0; e < m; e++) {
+        offsets[frozen->colIndices[e] + 2]++;
+    }
+    for (int i = 2; i <= n + 1; i++) {
+        offsets[i] += offsets[i - 1];
+    }
+
+    //Sources are visited in order, so each row ends up sorted by source
+    for (int i = 0; i < n; i++) {
+        for (int e = frozen->rowOffsets[i]; e < frozen->rowOffsets[i + 1]; e++) {
+            int pos = offsets[frozen->colIndices[e] + 1]++;
+            cols[pos] = i;
+            weights[pos] = frozen->weights[e];
+        }
+    }
+
+    frozen->revOffsets = offsets;
+    frozen->revColIndices = cols;
+    frozen->revWeights = weights;
+    return 1;
+}
+
+/**
+ * Changes the weight of one edge of a snapshot in place.
+ */
+int setFrozenWeight(frozen_graph_t *frozen, int fromId, int toId, float weight) {
+    int from = getFrozenIndex(frozen, fromId);
+    int to = getFrozenIndex(frozen, toId);
+    if (from == -1 || to == -1) {
+        return 0;
+    }
+
+    int found = 0;
+    for (int e = frozen->rowOffsets[from]; e < frozen->rowOffsets[from + 1]; e++) {
+        if (frozen->colIndices[e] == to) {
+            frozen->weights[e] = weight;
+            found = 1;
+            break;
+        }
+    }
+    if (found && frozen->revOffsets != NULL) {
+        for (int e = frozen->revOffsets[to]; e < frozen->revOffsets[to + 1]; e++) {
+            if (frozen->revColIndices[e] == from) {
+                frozen->revWeights[e] = weight;
+                break;
+            }
+        }
+    }
+    return found;
+}
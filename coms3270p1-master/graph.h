@@ -2,6 +2,7 @@
 #define GRAPH_H
 
 #include <stddef.h>
+#include "arena.h"
 
 /// Forward declarations
 typedef struct edge edge_t;
@@ -13,6 +14,8 @@ struct edge {
     float weight;
     void *data;
     edge_t *next;
+    node_t *fromNode;
+    edge_t *nextIn;
 };
 
 //Represents a single node in the graph
@@ -20,16 +23,42 @@ struct node {
     int id;
     void *data;
     edge_t *edges;
+    edge_t *inEdges;
 };
 
-//Represents the entire graph
+//Represents the entire graph. nodes[0..nodeCount-1] are the slots in use;
+//removedCount of them are NULL after removeNode() until compactGraph()
 typedef struct {
     node_t **nodes;
     int nodeCount;
+    int removedCount;
     int edgeCount;
     int nodeSpace;
+    int *index;
+    int indexSpace;
+    arena_t *arena;
+    int reverseEdges;
+    long findCalls;
+    long findProbes;
 } graph_t;
 
+//Read-only compressed-sparse-row snapshot of a graph
+typedef struct {
+    int nodeCount;
+    int edgeCount;
+    int *ids;
+    void **nodeData;
+    int *rowOffsets;
+    int *colIndices;
+    float *weights;
+    void **edgeData;
+    int *index;
+    int indexSpace;
+    int *revOffsets;
+    int *revColIndices;
+    float *revWeights;
+} frozen_graph_t;
+
 // --- Function Prototypes ---
 
 /**
@@ -44,11 +73,41 @@ typedef struct {
 * it behaves like an ArrayList in Java, where if the list is
 * full, the list of node pointers is expanded to double its size
 * and then a new node pointer is added.
+* Alongside the array the graph keeps an open-addressing hash index
+* (linear probing) from node id to its slot in the nodes array, so
+* lookups by id do not scan the array. The index is kept at least
+* twice the size of the array and is rebuilt whenever the array grows.
 **/
 graph_t* createGraph();
 /**
+* Creates a new graph whose nodes and edges are carved from an arena.
+* @param sizeHint Size in bytes of each arena slab (0 picks a default).
+* @return Pointer to the graph, or NULL if memory allocation fails.
+* The graph behaves exactly like one from createGraph(), except that
+* nodes, edges and anything allocated with graphAlloc() or graphStrndup()
+* are not freed one by one: removed nodes and edges keep their memory
+* until freeGraph() releases all of the slabs at once.
+**/
+graph_t* createGraphWithArena(size_t sizeHint);
+/**
+* Allocates memory for node or edge data that lives as long as the graph.
+* @param graph Pointer to the graph.
+* @param size Number of bytes.
+* @return Pointer to the memory, or NULL on failure.
+* With an arena the memory comes from it and is freed by freeGraph().
+* Without one it comes from malloc() and must be freed by the caller.
+**/
+void* graphAlloc(graph_t* graph, size_t size);
+/**
+* Copies the first len characters of a string with graphAlloc().
+* @return Pointer to the null-terminated copy, or NULL on failure.
+**/
+char* graphStrndup(graph_t* graph, const char* str, size_t len);
+/**
 * Frees the memory used by the graph.
 * All nodes and edges in the graph are also freed.
+* For a graph with an arena, the arena is freed in one step,
+* including all data allocated with graphAlloc() and graphStrndup().
 * If the graph pointer is NULL, the function does nothing.
 **/
 void freeGraph(graph_t* graph);
@@ -82,6 +141,16 @@ data);
 * **/
 node_t* getNode(graph_t* graph, int id);
 /**
+* Retrieves the slot of a node in graph->nodes by its ID.
+* @param graph Pointer to the graph.
+* @param id ID of the node.
+* @return The slot, or -1 if not found.
+* Slots stay the same until compactGraph() reclaims the slots of removed
+* nodes. While no node has been removed since, a node's slot is also the
+* dense index freezeGraph() gives it.
+* **/
+int getNodeSlot(graph_t* graph, int id);
+/**
 * Retrieves an edge from the graph by its source and destination node IDs.
 * @param graph Pointer to the graph.
 * @param fromId ID of the source node.
@@ -94,9 +163,37 @@ edge_t* getEdge(graph_t* graph, int fromId, int toId);
 * @param graph Pointer to the graph.
 * @param id ID of the node to remove.
 * @return 1 if the node was removed successfully, 0 if not found.
+* The node's edges in both directions are removed with it, in O(degree):
+* the first removal calls enableReverseEdges() so incoming edges can be
+* found without scanning the graph. The node's slot in graph->nodes is
+* left NULL rather than filled by moving later nodes down, so no other
+* node changes slot; compactGraph() reclaims the empty slots.
+* The node's data is not freed.
 **/
 int removeNode(graph_t* graph, int id);
 /**
+* Removes many nodes from the graph at once.
+* @param graph Pointer to the graph.
+* @param ids IDs of the nodes to remove (unknown and repeated IDs are skipped).
+* @param count Number of IDs.
+* @return The number of nodes removed.
+* Every edge that leaves or enters a removed node is dropped in a single
+* pass over all edges, so removing k nodes costs O(V + E + k) instead of
+* k separate removals. Slots are left NULL as by removeNode(), and the
+* nodes' data is not freed. No memory is allocated.
+**/
+int removeNodes(graph_t* graph, const int* ids, int count);
+/**
+* Reclaims the slots of removed nodes.
+* @param graph Pointer to the graph.
+* @return The number of slots reclaimed.
+* The remaining nodes move down over the empty slots in one linear pass,
+* keeping their order, and the index is rebuilt, so the result is the
+* same as if the removed nodes had never been added. Node pointers stay
+* valid; slots from getNodeSlot() do not.
+**/
+int compactGraph(graph_t* graph);
+/**
 * Removes an edge from the graph.
 * @param graph Pointer to the graph.
 * @param fromId ID of the source node.
@@ -105,6 +202,19 @@ int removeNode(graph_t* graph, int id);
 **/
 int removeEdge(graph_t* graph, int fromId, int toId);
 /**
+* Starts keeping a list of incoming edges for every node.
+* @param graph Pointer to the graph.
+* @return 1 on success (or if the lists are already kept), 0 if graph is NULL.
+* Each node's inEdges list links the edges that point to it through their
+* nextIn field, and every edge records its source in fromNode. The lists
+* are built once from the existing edges in O(V + E); from then on
+* addEdge(), removeEdge(), removeNode() and removeNodes() keep them up to
+* date. removeNode() calls this itself, so removing a node only touches
+* the edges of its neighbors instead of scanning every adjacency list in
+* the graph. No memory is allocated.
+**/
+int enableReverseEdges(graph_t* graph);
+/**
 * Prints the entire graph to the console.
 * @param graph Pointer to the graph.
 * The function prints each node and its outgoing edges in a readable format.
@@ -122,4 +232,59 @@ int removeEdge(graph_t* graph, int fromId, int toId);
 **/
 void printGraph(graph_t* graph);
 
+/**
+* Builds a read-only compressed-sparse-row (CSR) snapshot of the graph.
+* @param graph Pointer to the graph.
+* @return Pointer to the snapshot, or NULL on failure.
+* Nodes get dense indices in slot order, skipping the slots of removed
+* nodes, so the snapshot is the same as if they had never been added; the
+* graph is not changed (compactGraph() reclaims those slots). Without
+* removed nodes a node's dense index is its slot in graph->nodes.
+* The outgoing edges of the node with dense index i are stored in
+* positions rowOffsets[i] to rowOffsets[i + 1] - 1 of colIndices (the
+* dense index of the destination), weights and edgeData, in the same order
+* as the node's adjacency list. ids and nodeData hold each node's ID and data.
+* The node and edge data pointers are shared with the graph, not copied.
+* The snapshot does not follow later changes to the graph and
+* must be rebuilt if the graph is modified.
+**/
+frozen_graph_t* freezeGraph(graph_t* graph);
+/**
+* Frees a snapshot created by freezeGraph().
+* The graph it was built from and the shared data are not touched.
+* If the pointer is NULL, the function does nothing.
+**/
+void freeFrozenGraph(frozen_graph_t* frozen);
+/**
+* Retrieves the dense index of a node in a snapshot by its ID.
+* @param frozen Pointer to the snapshot.
+* @param id ID of the node.
+* @return The dense index, or -1 if not found.
+**/
+int getFrozenIndex(frozen_graph_t* frozen, int id);
+/**
+* Adds the incoming edges of every node to a snapshot.
+* @param frozen Pointer to the snapshot.
+* @return 1 on success (or if they were already added), 0 if memory allocation fails.
+* The incoming edges of the node with dense index i are stored in
+* positions revOffsets[i] to revOffsets[i + 1] - 1 of revColIndices (the
+* dense index of the source) and revWeights, ordered by source. They are
+* derived from the outgoing rows, so this works for any snapshot,
+* including one mapped from a compiled graph file. The arrays are NULL
+* until this is called and are freed with the snapshot.
+**/
+int addReverseRows(frozen_graph_t* frozen);
+/**
+* Changes the weight of one edge of a snapshot in place.
+* @param frozen Pointer to a snapshot from freezeGraph() (one mapped from
+* a compiled graph file is read-only).
+* @param fromId ID of the source node.
+* @param toId ID of the destination node.
+* @param weight The new weight. INFINITY closes the edge: no search
+* ever relaxes it, so it acts as removed without moving any rows.
+* @return 1 on success, 0 if the edge is not in the snapshot.
+* The reverse rows are updated too if they have been added.
+**/
+int setFrozenWeight(frozen_graph_t* frozen, int fromId, int toId, float weight);
+
 #endif // GRAPH_H
\ No newline at end of file
@@ -1,4 +1,7 @@
 #include <stdio.h> 
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include "data.h"
 
 /**
@@ -9,16 +12,38 @@
  * It will print "VALID" if the file is correctly formatted.
  * Otherwise, it will print the 1-based line number of the first error encountered to stdout.
  *
- * It prints a usage message if any command-line arguments are provided.
+ * With "-j N" the input is mapped (or read into memory) and validated in
+ * N threads by validateParallel(), which prints the same result.
+ *
+ * It prints a usage message if any other command-line arguments are provided.
  */
 int main(int argc, char *argv[]) {
-    
-    if (argc != 1) {
-        fprintf(stderr, "Usage: %s (reads from stdin)\n", argv[0]);
+    int error_line;
+    int threads = 0;
+    char *end;
+
+    if (argc == 3 && strcmp(argv[1], "-j") == 0) {
+        threads = (int)strtol(argv[2], &end, 10);
+        if (end == argv[2] || *end != '\0' || threads < 1) {
+            threads = 0;
+        }
+    }
+    if (argc != 1 && threads == 0) {
+        fprintf(stderr, "Usage: %s [-j threads] (reads from stdin)\n", argv[0]);
         return 1;
     }
 
-    int error_line = validate(); 
+    if (threads == 0) {
+        error_line = validate();
+    } else {
+        map_file_t *map = openMapStream(STDIN_FILENO);
+        error_line = map != NULL ? validateParallel(map, threads) : -1;
+        closeMapFile(map);
+        if (error_line < 0) {
+            fprintf(stderr, "Error: Out of memory\n");
+            return 1;
+        }
+    }
 
     // Print the result based on the return value from validate()
     if (error_line == 0) {
@@ -0,0 +1,263 @@
+#include "names.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_CAPACITY 64
+#define BUCKET_EMPTY -1
+
+/**
+ * Helper function to hash a string (32-bit FNV-1a).
+ */
+static unsigned int hashName(const char *name, int len) {
+    unsigned int h = 2166136261u;
+    for (int i = 0; i < len; i++) {
+        h ^= (unsigned char)name[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/**
+ * Helper function to find the entry holding a name.
+ * @return The entry position, or -1 if the name is not interned.
+ */
+static int findEntry(name_index_t *names, const char *name, int len, unsigned int hash) {
+    int mask = names->bucketSpace - 1;
+    int pos = (int)(hash & (unsigned int)mask);
+
+    while (names->buckets[pos] != BUCKET_EMPTY) {
+        name_entry_t *entry = &names->entries[names->buckets[pos]];
+        if (entry->hash == hash && entry->length == len && memcmp(entry->text, name, len) == 0) {
+            return names->buckets[pos];
+        }
+        pos = (pos + 1) & mask;
+    }
+    return -1;
+}
+
+/**
+ * Helper function to double the bucket array and re-insert every entry.
+ * @return 1 on success, 0 if memory allocation fails.
+ */
+static int growBuckets(name_index_t *names) {
+    int space = names->bucketSpace * 2;
+    int *buckets = (int *)malloc(sizeof(int) * space);
+    if (buckets == NULL) {
+        return 0;
+    }
+
+    int mask = space - 1;
+    for (int i = 0; i < space; i++) {
+        buckets[i] = BUCKET_EMPTY;
+    }
+    for (int i = 0; i < names->entryCount; i++) {
+        int pos = (int)(names->entries[i].hash & (unsigned int)mask);
+        while (buckets[pos] != BUCKET_EMPTY) {
+            pos = (pos + 1) & mask;
+        }
+        buckets[pos] = i;
+    }
+
+    free(names->buckets);
+    names->buckets = buckets;
+    names->bucketSpace = space;
+    return 1;
+}
+
+/**
+ * Helper function to find or add the entry for a name.
+ * @return The entry position, or -1 on failure.
+ */
+static int internEntry(name_index_t *names, const char *name, int len) {
+    if (names == NULL || name == NULL || names->borrowed) {
+        return -1;
+    }
+
+    unsigned int hash = hashName(name, len);
+    int found = findEntry(names, name, len, hash);
+    if (found != -1) {
+        return found;
+    }
+
+    //Keep the table at most half full
+    if ((names->entryCount + 1) * 2 > names->bucketSpace && !growBuckets(names)) {
+        return -1;
+    }
+
+    if (names->entryCount == names->entrySpace) {
+        int newSpace = names->entrySpace * 2;
+        name_entry_t *newEntries = (name_entry_t *)realloc(names->entries, sizeof(name_entry_t) * newSpace);
+        if (newEntries == NULL) {
+            return -1;
+        }
+        names->entries = newEntries;
+        names->entrySpace = newSpace;
+    }
+
+    char *text = strndup(name, len);
+    if (text == NULL) {
+        return -1;
+    }
+
+    int slot = names->entryCount;
+    name_entry_t *entry = &names->entries[slot];
+    entry->text = text;
+    entry->length = len;
+    entry->hash = hash;
+    entry->ids = NULL;
+    entry->idCount = 0;
+    entry->idSpace = 0;
+    names->entryCount++;
+
+    int mask = names->bucketSpace - 1;
+    int pos = (int)(hash & (unsigned int)mask);
+    while (names->buckets[pos] != BUCKET_EMPTY) {
+        pos = (pos + 1) & mask;
+    }
+    names->buckets[pos] = slot;
+
+    return slot;
+}
+
+/**
+ * Creates an empty name index.
+ */
+name_index_t *createNameIndex() {
+    name_index_t *names = (name_index_t *)malloc(sizeof(name_index_t));
+    if (names == NULL) {
+        return NULL;
+    }
+
+    names->entryCount = 0;
+    names->borrowed = 0;
+    names->entrySpace = INITIAL_CAPACITY;
+    names->bucketSpace = INITIAL_CAPACITY * 2;
+    names->entries = (name_entry_t *)malloc(sizeof(name_entry_t) * names->entrySpace);
+    names->buckets = (int *)malloc(sizeof(int) * names->bucketSpace);
+
+    if (names->entries == NULL || names->buckets == NULL) {
+        free(names->entries);
+        free(names->buckets);
+        free(names);
+        return NULL;
+    }
+
+    for (int i = 0; i < names->bucketSpace; i++) {
+        names->buckets[i] = BUCKET_EMPTY;
+    }
+
+    return names;
+}
+
+/**
+ * Frees the name index and every interned string.
+ */
+void freeNameIndex(name_index_t *names) {
+    if (names == NULL) {
+        return;
+    }
+
+    if (!names->borrowed) {
+        for (int i = 0; i < names->entryCount; i++) {
+            free(names->entries[i].text);
+            free(names->entries[i].ids);
+        }
+        free(names->buckets);
+    }
+    free(names->entries);
+    free(names);
+}
+
+/**
+ * Returns the interned copy of a name.
+ */
+const char *internName(name_index_t *names, const char *name, int len) {
+    int slot = internEntry(names, name, len);
+    if (slot == -1) {
+        return NULL;
+    }
+    return names->entries[slot].text;
+}
+
+/**
+ * Retrieves the position of a name in the entries array.
+ */
+int getNameEntry(name_index_t *names, const char *name, int len) {
+    if (names == NULL || name == NULL) {
+        return -1;
+    }
+    return findEntry(names, name, len, hashName(name, len));
+}
+
+/**
+ * Records that a node carries a name.
+ */
+int addNameId(name_index_t *names, const char *name, int id) {
+    if (name == NULL) {
+        return 0;
+    }
+
+    int slot = internEntry(names, name, (int)strlen(name));
+    if (slot == -1) {
+        return 0;
+    }
+
+    name_entry_t *entry = &names->entries[slot];
+    if (entry->idCount == entry->idSpace) {
+        int newSpace = entry->idSpace == 0 ? 1 : entry->idSpace * 2;
+        int *newIds = (int *)realloc(entry->ids, sizeof(int) * newSpace);
+        if (newIds == NULL) {
+            return 0;
+        }
+        entry->ids = newIds;
+        entry->idSpace = newSpace;
+    }
+
+    entry->ids[entry->idCount] = id;
+    entry->idCount++;
+    return 1;
+}
+
+/**
+ * Records that a node no longer carries a name.
+ */
+int removeNameId(name_index_t *names, const char *name, int id) {
+    if (names == NULL || name == NULL || names->borrowed) {
+        return 0;
+    }
+
+    int len = (int)strlen(name);
+    int slot = findEntry(names, name, len, hashName(name, len));
+    if (slot == -1) {
+        return 0;
+    }
+
+    name_entry_t *entry = &names->entries[slot];
+    for (int i = 0; i < entry->idCount; i++) {
+        if (entry->ids[i] == id) {
+            memmove(&entry->ids[i], &entry->ids[i + 1], sizeof(int) * (entry->idCount - i - 1));
+            entry->idCount--;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Retrieves the IDs of every node carrying a name.
+ */
+const int *findNameIds(name_index_t *names, const char *name, int *count) {
+    *count = 0;
+    if (names == NULL || name == NULL) {
+        return NULL;
+    }
+
+    int len = (int)strlen(name);
+    int slot = findEntry(names, name, len, hashName(name, len));
+    if (slot == -1 || names->entries[slot].idCount == 0) {
+        return NULL;
+    }
+
+    *count = names->entries[slot].idCount;
+    return names->entries[slot].ids;
+}
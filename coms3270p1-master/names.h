@@ -0,0 +1,91 @@
+#ifndef NAMES_H
+#define NAMES_H
+
+//One distinct name and the IDs of the nodes that carry it
+typedef struct {
+    char *text;
+    int length;
+    unsigned int hash;
+    int *ids;
+    int idCount;
+    int idSpace;
+} name_entry_t;
+
+//Hash table of interned names
+typedef struct {
+    name_entry_t *entries;
+    int entryCount;
+    int entrySpace;
+    int *buckets;
+    int bucketSpace;
+    int borrowed;
+} name_index_t;
+
+/**
+* Creates an empty name index and returns a pointer to it.
+* Returns NULL if memory allocation fails.
+* Each distinct name is copied once into the index (interned), and
+* the index is an open-addressing hash table (linear probing) over
+* an array of entries kept in insertion order.
+* An index whose borrowed flag is set points its texts, ID arrays and
+* buckets at memory it does not own (e.g. a mapped cache file); it is
+* read-only and freeNameIndex() only frees its entries array.
+**/
+name_index_t* createNameIndex();
+/**
+* Frees the name index, including every interned string.
+* If the pointer is NULL, the function does nothing.
+**/
+void freeNameIndex(name_index_t* names);
+/**
+* Returns the interned copy of a name, adding it if it is new.
+* @param names Pointer to the name index.
+* @param name The name to intern (need not be null-terminated).
+* @param len Number of characters in the name.
+* @return Pointer to the shared, null-terminated copy, or NULL on failure.
+* Equal names always give the same pointer, so interned names can be
+* compared with ==. The returned string is owned by the index and must
+* not be modified or freed.
+**/
+const char* internName(name_index_t* names, const char* name, int len);
+/**
+* Retrieves the position of a name in names->entries.
+* @param names Pointer to the name index.
+* @param name The name to look up (need not be null-terminated).
+* @param len Number of characters in the name.
+* @return The entry position, or -1 if the name is not interned.
+**/
+int getNameEntry(name_index_t* names, const char* name, int len);
+/**
+* Records that the node with the given ID carries the name.
+* @param names Pointer to the name index.
+* @param name The name of the node.
+* @param id ID of the node.
+* @return 1 on success, 0 on failure.
+* A name may be carried by any number of nodes. IDs are kept in the
+* order they were added.
+**/
+int addNameId(name_index_t* names, const char* name, int id);
+/**
+* Records that the node with the given ID no longer carries the name.
+* @param names Pointer to the name index.
+* @param name The name of the node.
+* @param id ID of the node.
+* @return 1 if the ID was removed, 0 if the name or ID was not found.
+* The other IDs keep their order. The name stays interned, so pointers
+* from internName() remain valid; findNameIds() returns NULL once no
+* node carries it.
+**/
+int removeNameId(name_index_t* names, const char* name, int id);
+/**
+* Retrieves the IDs of every node carrying a name.
+* @param names Pointer to the name index.
+* @param name The name to look up.
+* @param count Set to the number of IDs returned (0 if not found).
+* @return Pointer to the IDs in the order they were added,
+* or NULL if no node carries the name.
+* The array is owned by the index and is valid until the next change to it.
+**/
+const int* findNameIds(name_index_t* names, const char* name, int* count);
+
+#endif // NAMES_H
@@ -0,0 +1,903 @@
+#include "route.h"
+#include "stats.h"
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+
+#define RADIX_BUCKETS 65
+// Relative slack taken off the A* estimate so rounding cannot push it past the road distance
+#define ASTAR_SLACK 1e-9
+// Shortest edge (meters of straight line) the A* scale is taken from
+#define ASTAR_SCALE_MIN_LENGTH 1.0
+
+/**
+ * Creates scratch space for searches on a snapshot.
+ */
+route_scratch_t *createRouteScratch(int nodeCount, heap_kind_t kind) {
+    route_scratch_t *scratch = (route_scratch_t *)calloc(1, sizeof(route_scratch_t));
+    if (scratch == NULL) {
+        return NULL;
+    }
+
+    scratch->kind = kind;
+    scratch->nodeCount = nodeCount;
+
+    //Allocate at least one element so an empty snapshot still gets valid arrays
+    scratch->dist = (double *)malloc(sizeof(double) * (nodeCount + 1));
+    scratch->estimate = (double *)malloc(sizeof(double) * (nodeCount + 1));
+    scratch->priority = (double *)malloc(sizeof(double) * (nodeCount + 1));
+    scratch->visited = (unsigned char *)calloc(nodeCount + 1, sizeof(unsigned char));
+    scratch->touched = (int *)malloc(sizeof(int) * (nodeCount + 1));
+    scratch->heap = (int *)malloc(sizeof(int) * (nodeCount + 1));
+    scratch->heapPos = (int *)malloc(sizeof(int) * (nodeCount + 1));
+
+    if (scratch->dist == NULL || scratch->estimate == NULL || scratch->priority == NULL || scratch->visited == NULL || scratch->touched == NULL ||
+        scratch->heap == NULL || scratch->heapPos == NULL) {
+        freeRouteScratch(scratch);
+        return NULL;
+    }
+
+    for (int i = 0; i < nodeCount; i++) {
+        scratch->dist[i] = DBL_MAX;
+        scratch->heapPos[i] = -1;
+    }
+
+    return scratch;
+}
+
+/**
+ * Frees scratch space created by createRouteScratch().
+ */
+void freeRouteScratch(route_scratch_t *scratch) {
+    if (scratch == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < RADIX_BUCKETS; i++) {
+        free(scratch->buckets[i].keys);
+        free(scratch->buckets[i].nodes);
+    }
+    free(scratch->dist);
+    free(scratch->estimate);
+    free(scratch->priority);
+    free(scratch->visited);
+    free(scratch->touched);
+    free(scratch->heap);
+    free(scratch->heapPos);
+    free(scratch->predEdge);
+    free(scratch);
+}
+
+/**
+ * Makes later searches record the edge each node was reached by.
+ */
+int enableRoutePaths(route_scratch_t *scratch) {
+    if (scratch == NULL) {
+        return 0;
+    }
+    if (scratch->predEdge == NULL) {
+        scratch->predEdge = (int *)malloc(sizeof(int) * (scratch->nodeCount + 1));
+    }
+    return scratch->predEdge != NULL;
+}
+
+/**
+ * Helper function to put the touched entries back to their initial state.
+ */
+static void resetScratch(route_scratch_t *scratch) {
+    for (int i = 0; i < scratch->touchedCount; i++) {
+        int node = scratch->touched[i];
+        scratch->dist[node] = DBL_MAX;
+        scratch->visited[node] = 0;
+        scratch->heapPos[node] = -1;
+    }
+    scratch->touchedCount = 0;
+    scratch->settled = 0;
+    scratch->relaxed = 0;
+    scratch->heapCount = 0;
+    scratch->heapKey = scratch->dist;
+
+    for (int i = 0; i < RADIX_BUCKETS; i++) {
+        scratch->buckets[i].count = 0;
+    }
+    scratch->radixLast = 0;
+    scratch->radixCount = 0;
+}
+
+// --- 4-ary heap keyed on heapKey[] (dist[], or dist + estimate for A*), with decrease-key ---
+
+/**
+ * Helper function to move a heap entry up until its parent is not larger.
+ */
+static void heapSiftUp(route_scratch_t *scratch, int pos) {
+    int node = scratch->heap[pos];
+    double key = scratch->heapKey[node];
+
+    while (pos > 0) {
+        int parent = (pos - 1) / 4;
+        int parentNode = scratch->heap[parent];
+        if (scratch->heapKey[parentNode] <= key) {
+            break;
+        }
+        scratch->heap[pos] = parentNode;
+        scratch->heapPos[parentNode] = pos;
+        pos = parent;
+    }
+    scratch->heap[pos] = node;
+    scratch->heapPos[node] = pos;
+}
+
+/**
+ * Helper function to move a heap entry down until no child is smaller.
+ */
+static void heapSiftDown(route_scratch_t *scratch, int pos) {
+    int node = scratch->heap[pos];
+    double key = scratch->heapKey[node];
+
+    while (1) {
+        int first = pos * 4 + 1;
+        if (first >= scratch->heapCount) {
+            break;
+        }
+
+        int last = first + 4;
+        if (last > scratch->heapCount) {
+            last = scratch->heapCount;
+        }
+
+        int best = first;
+        for (int c = first + 1; c < last; c++) {
+            if (scratch->heapKey[scratch->heap[c]] < scratch->heapKey[scratch->heap[best]]) {
+                best = c;
+            }
+        }
+
+        int bestNode = scratch->heap[best];
+        if (scratch->heapKey[bestNode] >= key) {
+            break;
+        }
+        scratch->heap[pos] = bestNode;
+        scratch->heapPos[bestNode] = pos;
+        pos = best;
+    }
+    scratch->heap[pos] = node;
+    scratch->heapPos[node] = pos;
+}
+
+/**
+ * Helper function to add a node or lower its key after heapKey[] decreased.
+ */
+static void heapUpdate(route_scratch_t *scratch, int node) {
+    if (scratch->heapPos[node] == -1) {
+        scratch->heap[scratch->heapCount] = node;
+        scratch->heapPos[node] = scratch->heapCount;
+        scratch->heapCount++;
+    }
+    heapSiftUp(scratch, scratch->heapPos[node]);
+}
+
+/**
+ * Helper function to remove the node with the smallest heapKey[].
+ * @return The node, or -1 if the heap is empty.
+ */
+static int heapPop(route_scratch_t *scratch) {
+    if (scratch->heapCount == 0) {
+        return -1;
+    }
+
+    int top = scratch->heap[0];
+    scratch->heapPos[top] = -1;
+    scratch->heapCount--;
+
+    if (scratch->heapCount > 0) {
+        scratch->heap[0] = scratch->heap[scratch->heapCount];
+        heapSiftDown(scratch, 0);
+    }
+    return top;
+}
+
+// --- Monotone radix heap keyed on the bits of dist[] ---
+
+/**
+ * Helper function to turn a non-negative distance into an ordered integer key.
+ * For non-negative doubles the IEEE 754 bit pattern sorts the same way
+ * as the value, so no precision is lost.
+ */
+static uint64_t radixKey(double value) {
+    uint64_t key;
+    if (value <= 0) {
+        return 0;
+    }
+    memcpy(&key, &value, sizeof(key));
+    return key;
+}
+
+/**
+ * Helper function to pick the bucket for a key: 0 for keys equal to the
+ * last popped key, otherwise one more than the highest differing bit.
+ */
+static int radixBucket(uint64_t key, uint64_t last) {
+    if (key <= last) {
+        return 0;
+    }
+    return 64 - __builtin_clzll(key ^ last);
+}
+
+/**
+ * Helper function to append an entry to a bucket.
+ * @return 1 on success, 0 if memory allocation fails.
+ */
+static int radixAppend(radix_bucket_t *bucket, uint64_t key, int node) {
+    if (bucket->count == bucket->space) {
+        int newSpace = bucket->space == 0 ? 16 : bucket->space * 2;
+        uint64_t *newKeys = (uint64_t *)realloc(bucket->keys, sizeof(uint64_t) * newSpace);
+        if (newKeys == NULL) {
+            return 0;
+        }
+        bucket->keys = newKeys;
+
+        int *newNodes = (int *)realloc(bucket->nodes, sizeof(int) * newSpace);
+        if (newNodes == NULL) {
+            return 0;
+        }
+        bucket->nodes = newNodes;
+        bucket->space = newSpace;
+    }
+
+    bucket->keys[bucket->count] = key;
+    bucket->nodes[bucket->count] = node;
+    bucket->count++;
+    return 1;
+}
+
+/**
+ * Helper function to insert a node with its current dist[].
+ * Old entries for the node are left in place and skipped when popped.
+ */
+static int radixPush(route_scratch_t *scratch, int node) {
+    uint64_t key = radixKey(scratch->dist[node]);
+    if (!radixAppend(&scratch->buckets[radixBucket(key, scratch->radixLast)], key, node)) {
+        return 0;
+    }
+    scratch->radixCount++;
+    return 1;
+}
+
+/**
+ * Helper function to remove an entry with the smallest key.
+ * When bucket 0 is empty, the first non-empty bucket is emptied into
+ * lower buckets relative to its minimum, which becomes the new last key.
+ * @return The node, or -1 if the heap is empty.
+ */
+static int radixPop(route_scratch_t *scratch) {
+    if (scratch->radixCount == 0) {
+        return -1;
+    }
+
+    radix_bucket_t *zero = &scratch->buckets[0];
+    if (zero->count == 0) {
+        int b = 1;
+        while (scratch->buckets[b].count == 0) {
+            b++;
+        }
+
+        radix_bucket_t *bucket = &scratch->buckets[b];
+        uint64_t min = bucket->keys[0];
+        for (int i = 1; i < bucket->count; i++) {
+            if (bucket->keys[i] < min) {
+                min = bucket->keys[i];
+            }
+        }
+
+        //Every entry lands in a bucket below b, so none is moved twice
+        scratch->radixLast = min;
+        int count = bucket->count;
+        bucket->count = 0;
+        for (int i = 0; i < count; i++) {
+            radix_bucket_t *target = &scratch->buckets[radixBucket(bucket->keys[i], min)];
+            radixAppend(target, bucket->keys[i], bucket->nodes[i]);
+        }
+    }
+
+    zero->count--;
+    scratch->radixCount--;
+    return zero->nodes[zero->count];
+}
+
+/**
+ * Helper function to add a node to whichever heap the scratch uses,
+ * or lower its key after dist[] decreased.
+ * @return 1 on success, 0 if memory allocation fails.
+ */
+static int queuePush(route_scratch_t *scratch, int node) {
+    if (scratch->kind == HEAP_RADIX) {
+        return radixPush(scratch, node);
+    }
+    heapUpdate(scratch, node);
+    return 1;
+}
+
+/**
+ * Helper function to remove the node with the smallest key from
+ * whichever heap the scratch uses.
+ * @return The node, or -1 if the heap is empty.
+ */
+static int queuePop(route_scratch_t *scratch) {
+    return scratch->kind == HEAP_RADIX ? radixPop(scratch) : heapPop(scratch);
+}
+
+/**
+ * Helper function to start a search from one node.
+ */
+static void startSearch(route_scratch_t *scratch, int startIdx) {
+    resetScratch(scratch);
+    scratch->dist[startIdx] = 0;
+    scratch->touched[scratch->touchedCount++] = startIdx;
+    if (scratch->predEdge != NULL) {
+        scratch->predEdge[startIdx] = -1;
+    }
+    queuePush(scratch, startIdx);
+}
+
+/**
+ * Helper function to settle the unvisited node with the smallest distance.
+ * @return The node, or -1 if none is left.
+ */
+static int settleNext(route_scratch_t *scratch) {
+    int current;
+
+    while (1) {
+        current = queuePop(scratch);
+        if (current == -1) {
+            return -1;
+        }
+
+        //The radix heap keeps stale entries for nodes whose key was lowered
+        if (!scratch->visited[current]) {
+            break;
+        }
+    }
+    scratch->visited[current] = 1;
+    scratch->settled++;
+    return current;
+}
+
+/**
+ * Helper function to relax the edges in a settled node's CSR row.
+ * @return 1 on success, 0 if memory allocation fails.
+ */
+static int relaxEdges(frozen_graph_t *frozen, route_scratch_t *scratch, int current) {
+    STAT_ADD(scratch->relaxed, frozen->rowOffsets[current + 1] - frozen->rowOffsets[current]);
+    for (int e = frozen->rowOffsets[current]; e < frozen->rowOffsets[current + 1]; e++) {
+        int neighbor = frozen->colIndices[e];
+        if (scratch->visited[neighbor]) {
+            continue;
+        }
+
+        double alt = scratch->dist[current] + frozen->weights[e];
+        if (alt < scratch->dist[neighbor]) {
+            if (scratch->dist[neighbor] == DBL_MAX) {
+                scratch->touched[scratch->touchedCount++] = neighbor;
+            }
+            scratch->dist[neighbor] = alt;
+            if (scratch->predEdge != NULL) {
+                scratch->predEdge[neighbor] = e;
+            }
+            if (!queuePush(scratch, neighbor)) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+/**
+ * Dijkstra's algorithm over the CSR snapshot.
+ */
+double dijkstra(frozen_graph_t *frozen, route_scratch_t *scratch, int startId, int endId) {
+    int startIdx;
+    int endIdx;
+    int current;
+    double result;
+
+    if (frozen == NULL || scratch == NULL || frozen->nodeCount != scratch->nodeCount) {
+        return -1;
+    }
+
+    startIdx = getFrozenIndex(frozen, startId);
+    endIdx = getFrozenIndex(frozen, endId);
+    if (startIdx == -1 || endIdx == -1) {
+        return -1;
+    }
+
+    startSearch(scratch, startIdx);
+    while ((current = settleNext(scratch)) != -1) {
+        if (current == endIdx) {
+            break;
+        }
+        if (!relaxEdges(frozen, scratch, current)) {
+            return -1;
+        }
+    }
+
+    result = scratch->dist[endIdx];
+    return (result == DBL_MAX) ? -1 : result;
+}
+
+/**
+ * One search from a start node to a list of targets.
+ */
+int dijkstraToMany(frozen_graph_t *frozen, route_scratch_t *scratch, int startIdx, const int *targets, int targetCount, double *distances) {
+    int pending;
+    int current;
+
+    if (frozen == NULL || scratch == NULL || frozen->nodeCount != scratch->nodeCount ||
+        startIdx < 0 || startIdx >= frozen->nodeCount) {
+        return 0;
+    }
+
+    //pending is the first target not yet known to be settled; the search
+    //ends once it runs off the end of the list
+    startSearch(scratch, startIdx);
+    pending = 0;
+    while (1) {
+        while (pending < targetCount &&
+               (targets[pending] < 0 || targets[pending] >= frozen->nodeCount || scratch->visited[targets[pending]])) {
+            pending++;
+        }
+        if (pending == targetCount) {
+            break;
+        }
+
+        current = settleNext(scratch);
+        if (current == -1) {
+            break;
+        }
+        if (!relaxEdges(frozen, scratch, current)) {
+            return 0;
+        }
+    }
+
+    for (int i = 0; i < targetCount; i++) {
+        int target = targets[i];
+        if (target < 0 || target >= frozen->nodeCount || !scratch->visited[target]) {
+            distances[i] = -1;
+        }
+        else {
+            distances[i] = scratch->dist[target];
+        }
+    }
+    return 1;
+}
+
+/**
+ * Helper function to find the row a CSR edge belongs to.
+ */
+static int edgeSource(frozen_graph_t *frozen, int e) {
+    int lo = 0;
+    int hi = frozen->nodeCount - 1;
+
+    //Last row starting at or before e; empty rows share their offset with the next
+    while (lo < hi) {
+        int mid = lo + (hi - lo + 1) / 2;
+        if (frozen->rowOffsets[mid] <= e) {
+            lo = mid;
+        }
+        else {
+            hi = mid - 1;
+        }
+    }
+    return lo;
+}
+
+/**
+ * Lists the edges of the path the last search found to a node.
+ */
+int getRoutePath(frozen_graph_t *frozen, route_scratch_t *scratch, int endIdx, int *edges) {
+    int count;
+    int node;
+
+    if (frozen == NULL || scratch == NULL || scratch->predEdge == NULL || endIdx < 0 || endIdx >= frozen->nodeCount ||
+        !scratch->visited[endIdx]) {
+        return -1;
+    }
+
+    //Walk back to the start, then reverse
+    count = 0;
+    node = endIdx;
+    while (scratch->predEdge[node] != -1) {
+        edges[count++] = scratch->predEdge[node];
+        node = edgeSource(frozen, scratch->predEdge[node]);
+    }
+    for (int i = 0; i < count / 2; i++) {
+        int tmp = edges[i];
+        edges[i] = edges[count - 1 - i];
+        edges[count - 1 - i] = tmp;
+    }
+    return count;
+}
+
+/**
+ * Starts a one-to-all search that nextReach() advances.
+ */
+int startReach(frozen_graph_t *frozen, route_scratch_t *scratch, int startIdx) {
+    if (frozen == NULL || scratch == NULL || frozen->nodeCount != scratch->nodeCount ||
+        startIdx < 0 || startIdx >= frozen->nodeCount) {
+        return 0;
+    }
+    startSearch(scratch, startIdx);
+    return 1;
+}
+
+/**
+ * Settles the next node of a search started by startReach().
+ */
+int nextReach(frozen_graph_t *frozen, route_scratch_t *scratch, double maxDist) {
+    int current;
+
+    current = settleNext(scratch);
+    if (current == -1) {
+        return -1;
+    }
+
+    //Keys come out in order, so everything left is farther still
+    if (scratch->dist[current] > maxDist) {
+        return -1;
+    }
+    if (!relaxEdges(frozen, scratch, current)) {
+        return -2;
+    }
+    return current;
+}
+
+/**
+ * Helper function to double the per-node arrays so entries nodeCount to
+ * 2 * nodeCount - 1 can hold the backward search.
+ * @return 1 on success, 0 if memory allocation fails.
+ */
+static int growScratch(route_scratch_t *scratch) {
+    int n = scratch->nodeCount;
+    int space = 2 * n + 1;
+
+    if (scratch->bothWays) {
+        return 1;
+    }
+
+    double *dist = (double *)realloc(scratch->dist, sizeof(double) * space);
+    if (dist == NULL) {
+        return 0;
+    }
+    scratch->dist = dist;
+    unsigned char *visited = (unsigned char *)realloc(scratch->visited, space);
+    if (visited == NULL) {
+        return 0;
+    }
+    scratch->visited = visited;
+    int *touched = (int *)realloc(scratch->touched, sizeof(int) * space);
+    if (touched == NULL) {
+        return 0;
+    }
+    scratch->touched = touched;
+    int *heap = (int *)realloc(scratch->heap, sizeof(int) * space);
+    if (heap == NULL) {
+        return 0;
+    }
+    scratch->heap = heap;
+    int *heapPos = (int *)realloc(scratch->heapPos, sizeof(int) * space);
+    if (heapPos == NULL) {
+        return 0;
+    }
+    scratch->heapPos = heapPos;
+
+    for (int i = n; i < 2 * n; i++) {
+        scratch->dist[i] = DBL_MAX;
+        scratch->visited[i] = 0;
+        scratch->heapPos[i] = -1;
+    }
+    scratch->bothWays = 1;
+    return 1;
+}
+
+/**
+ * Helper function to reach a node from one side of a bidirectional search.
+ * entry is the node's index on that side and other its index on the
+ * opposite side; best is lowered if both sides have now reached it.
+ * frontier counts the nodes reached but not yet settled on that side.
+ * @return 1 on success, 0 if memory allocation fails.
+ */
+static int reachEntry(route_scratch_t *scratch, int entry, int other, double alt, double *best, int *frontier) {
+    if (alt < scratch->dist[entry]) {
+        if (scratch->dist[entry] == DBL_MAX) {
+            scratch->touched[scratch->touchedCount++] = entry;
+            (*frontier)++;
+        }
+        scratch->dist[entry] = alt;
+        if (!queuePush(scratch, entry)) {
+            return 0;
+        }
+    }
+    if (scratch->dist[other] != DBL_MAX && alt + scratch->dist[other] < *best) {
+        *best = alt + scratch->dist[other];
+    }
+    return 1;
+}
+
+/**
+ * Bidirectional Dijkstra over the CSR snapshot and its reverse rows.
+ */
+double bidirectionalDijkstra(frozen_graph_t *frozen, route_scratch_t *scratch, int startId, int endId) {
+    int n;
+    int startIdx;
+    int endIdx;
+    int current;
+    int e;
+    int side;
+    int frontier[2];
+    double best;
+
+    if (frozen == NULL || scratch == NULL || frozen->nodeCount != scratch->nodeCount || frozen->revOffsets == NULL) {
+        return -1;
+    }
+
+    startIdx = getFrozenIndex(frozen, startId);
+    endIdx = getFrozenIndex(frozen, endId);
+    if (startIdx == -1 || endIdx == -1 || !growScratch(scratch)) {
+        return -1;
+    }
+
+    resetScratch(scratch);
+    n = frozen->nodeCount;
+    best = DBL_MAX;
+    frontier[0] = 0;
+    frontier[1] = 0;
+
+    if (!reachEntry(scratch, startIdx, n + startIdx, 0, &best, &frontier[0]) ||
+        !reachEntry(scratch, n + endIdx, endIdx, 0, &best, &frontier[1])) {
+        return -1;
+    }
+
+    while (1) {
+        current = queuePop(scratch);
+        if (current == -1) {
+            break;
+        }
+        if (scratch->visited[current]) {
+            continue;
+        }
+
+        //Both sides have settled everything closer than this key, so a
+        //shorter path would have been seen already
+        if (2 * scratch->dist[current] >= best) {
+            break;
+        }
+        scratch->visited[current] = 1;
+        scratch->settled++;
+        side = current < n ? 0 : 1;
+        frontier[side]--;
+
+        if (side == 0) {
+            STAT_ADD(scratch->relaxed, frozen->rowOffsets[current + 1] - frozen->rowOffsets[current]);
+            for (e = frozen->rowOffsets[current]; e < frozen->rowOffsets[current + 1]; e++) {
+                int neighbor = frozen->colIndices[e];
+                if (!reachEntry(scratch, neighbor, n + neighbor, scratch->dist[current] + frozen->weights[e], &best, &frontier[0])) {
+                    return -1;
+                }
+            }
+        }
+        else {
+            int node = current - n;
+            STAT_ADD(scratch->relaxed, frozen->revOffsets[node + 1] - frozen->revOffsets[node]);
+            for (e = frozen->revOffsets[node]; e < frozen->revOffsets[node + 1]; e++) {
+                int neighbor = frozen->revColIndices[e];
+                if (!reachEntry(scratch, n + neighbor, neighbor, scratch->dist[current] + frozen->revWeights[e], &best, &frontier[1])) {
+                    return -1;
+                }
+            }
+        }
+
+        //A side with nothing left to settle has seen every path it could join
+        if (frontier[side] == 0) {
+            break;
+        }
+    }
+
+    return (best == DBL_MAX) ? -1 : best;
+}
+
+/**
+ * Bidirectional upward search over a contraction hierarchy.
+ */
+double chDijkstra(frozen_graph_t *frozen, const ch_graph_t *ch, route_scratch_t *scratch, int startId, int endId) {
+    int n;
+    int startIdx;
+    int endIdx;
+    int current;
+    int e;
+    int frontier[2];
+    double best;
+
+    if (frozen == NULL || ch == NULL || scratch == NULL || frozen->nodeCount != scratch->nodeCount ||
+        ch->nodeCount != frozen->nodeCount) {
+        return -1;
+    }
+
+    startIdx = getFrozenIndex(frozen, startId);
+    endIdx = getFrozenIndex(frozen, endId);
+    if (startIdx == -1 || endIdx == -1 || !growScratch(scratch)) {
+        return -1;
+    }
+
+    resetScratch(scratch);
+    n = frozen->nodeCount;
+    best = DBL_MAX;
+    frontier[0] = 0;
+    frontier[1] = 0;
+
+    if (!reachEntry(scratch, startIdx, n + startIdx, 0, &best, &frontier[0]) ||
+        !reachEntry(scratch, n + endIdx, endIdx, 0, &best, &frontier[1])) {
+        return -1;
+    }
+
+    while (1) {
+        current = queuePop(scratch);
+        if (current == -1) {
+            break;
+        }
+        if (scratch->visited[current]) {
+            continue;
+        }
+
+        //Unlike bidirectionalDijkstra() the two sides need not meet in the
+        //middle, so only a key past the best total ends the search
+        if (scratch->dist[current] >= best) {
+            break;
+        }
+        scratch->visited[current] = 1;
+        scratch->settled++;
+
+        if (current < n) {
+            STAT_ADD(scratch->relaxed, ch->upOffsets[current + 1] - ch->upOffsets[current]);
+            for (e = ch->upOffsets[current]; e < ch->upOffsets[current + 1]; e++) {
+                int neighbor = ch->upTargets[e];
+                if (!reachEntry(scratch, neighbor, n + neighbor, scratch->dist[current] + ch->upWeights[e], &best, &frontier[0])) {
+                    return -1;
+                }
+            }
+        }
+        else {
+            int node = current - n;
+            STAT_ADD(scratch->relaxed, ch->downOffsets[node + 1] - ch->downOffsets[node]);
+            for (e = ch->downOffsets[node]; e < ch->downOffsets[node + 1]; e++) {
+                int neighbor = ch->downSources[e];
+                if (!reachEntry(scratch, n + neighbor, neighbor, scratch->dist[current] + ch->downWeights[e], &best, &frontier[1])) {
+                    return -1;
+                }
+            }
+        }
+    }
+
+    return (best == DBL_MAX) ? -1 : best;
+}
+
+/**
+ * Computes the factor and offset that keep the A* estimate below road distance.
+ */
+double astarScale(frozen_graph_t *frozen, const geo_store_t *coords, double *offset) {
+    double scale = 1;
+
+    *offset = 0;
+    if (frozen == NULL || coords == NULL || coords->count < frozen->nodeCount) {
+        return -1;
+    }
+
+    //The scale comes from edges long enough that rounding barely changes their ratio
+    for (int i = 0; i < frozen->nodeCount; i++) {
+        if (frozen->rowOffsets[i] == frozen->rowOffsets[i + 1]) {
+            continue;
+        }
+        //A path through a node without coordinates cannot be bounded
+        if (!hasGeoPoint(coords, i)) {
+            return -1;
+        }
+        for (int e = frozen->rowOffsets[i]; e < frozen->rowOffsets[i + 1]; e++) {
+            int to = frozen->colIndices[e];
+            if (!hasGeoPoint(coords, to)) {
+                continue;
+            }
+            double straight = geoStoreDistance(coords, i, to);
+            if (straight >= ASTAR_SCALE_MIN_LENGTH && frozen->weights[e] < straight * scale) {
+                scale = frozen->weights[e] / straight;
+            }
+        }
+    }
+
+    //Shorter edges still below the scaled straight line are covered by the offset
+    for (int i = 0; i < frozen->nodeCount; i++) {
+        for (int e = frozen->rowOffsets[i]; e < frozen->rowOffsets[i + 1]; e++) {
+            int to = frozen->colIndices[e];
+            if (!hasGeoPoint(coords, to)) {
+                continue;
+            }
+            double scaled = geoStoreDistance(coords, i, to) * scale;
+            if (frozen->weights[e] < scaled) {
+                *offset += scaled - frozen->weights[e];
+            }
+        }
+    }
+    return scale;
+}
+
+/**
+ * A* search over the CSR snapshot.
+ */
+double astar(frozen_graph_t *frozen, route_scratch_t *scratch, const geo_store_t *coords, double scale, double offset, int startId, int endId) {
+    int startIdx;
+    int endIdx;
+    int current;
+    int e;
+    int guided;
+    double alt;
+    double estimate;
+    double result;
+
+    if (frozen == NULL || scratch == NULL || coords == NULL || frozen->nodeCount != scratch->nodeCount ||
+        coords->count < frozen->nodeCount) {
+        return -1;
+    }
+
+    startIdx = getFrozenIndex(frozen, startId);
+    endIdx = getFrozenIndex(frozen, endId);
+    if (startIdx == -1 || endIdx == -1) {
+        return -1;
+    }
+
+    resetScratch(scratch);
+    scratch->heapKey = scratch->priority;
+    guided = scale > 0 && hasGeoPoint(coords, endIdx);
+
+    scratch->dist[startIdx] = 0;
+    scratch->estimate[startIdx] = 0;
+    scratch->priority[startIdx] = 0;
+    scratch->touched[scratch->touchedCount++] = startIdx;
+    heapUpdate(scratch, startIdx);
+
+    while (1) {
+        current = heapPop(scratch);
+        if (current == -1) {
+            break;
+        }
+        scratch->visited[current] = 1;
+        scratch->settled++;
+
+        if (current == endIdx) {
+            break;
+        }
+
+        STAT_ADD(scratch->relaxed, frozen->rowOffsets[current + 1] - frozen->rowOffsets[current]);
+        for (e = frozen->rowOffsets[current]; e < frozen->rowOffsets[current + 1]; e++) {
+            int neighbor = frozen->colIndices[e];
+
+            alt = scratch->dist[current] + frozen->weights[e];
+            if (alt < scratch->dist[neighbor]) {
+                //The estimate is computed once, when a node is first reached
+                if (scratch->dist[neighbor] == DBL_MAX) {
+                    scratch->touched[scratch->touchedCount++] = neighbor;
+                    scratch->estimate[neighbor] = 0;
+                    if (guided && hasGeoPoint(coords, neighbor)) {
+                        estimate = geoStoreDistance(coords, neighbor, endIdx) * scale * (1.0 - ASTAR_SLACK) - offset;
+                        scratch->estimate[neighbor] = estimate > 0 ? estimate : 0;
+                    }
+                }
+                scratch->dist[neighbor] = alt;
+                scratch->priority[neighbor] = alt + scratch->estimate[neighbor];
+
+                //A settled node reached by a shorter path is searched again
+                scratch->visited[neighbor] = 0;
+                heapUpdate(scratch, neighbor);
+            }
+        }
+    }
+
+    result = scratch->dist[endIdx];
+    return (result == DBL_MAX) ? -1 : result;
+}
@@ -0,0 +1,219 @@
+#ifndef ROUTE_H
+#define ROUTE_H
+
+#include <stdint.h>
+#include "graph.h"
+#include "geo.h"
+#include "ch.h"
+
+//Priority queue used by the shortest-path search
+typedef enum {
+    HEAP_BINARY,
+    HEAP_RADIX
+} heap_kind_t;
+
+//One bucket of the radix heap
+typedef struct {
+    uint64_t *keys;
+    int *nodes;
+    int count;
+    int space;
+} radix_bucket_t;
+
+//Scratch space for shortest-path searches on one snapshot
+typedef struct {
+    heap_kind_t kind;
+    int nodeCount;
+    int bothWays;
+    double *dist;
+    double *estimate;
+    double *priority;
+    const double *heapKey;
+    unsigned char *visited;
+    int *touched;
+    int touchedCount;
+    int settled;
+    int relaxed;
+    int *heap;
+    int *heapPos;
+    int heapCount;
+    radix_bucket_t buckets[65];
+    uint64_t radixLast;
+    int radixCount;
+    int *predEdge;
+} route_scratch_t;
+
+/**
+* Creates scratch space for searches on a snapshot with nodeCount nodes.
+* @param nodeCount Number of nodes in the snapshot.
+* @param kind HEAP_BINARY for a 4-ary heap with decrease-key, or
+* HEAP_RADIX for a monotone radix heap keyed on the bits of the distance.
+* @return Pointer to the scratch space, or NULL if memory allocation fails.
+* The same scratch space can be reused for any number of searches,
+* and each search only resets the entries it touched.
+**/
+route_scratch_t* createRouteScratch(int nodeCount, heap_kind_t kind);
+/**
+* Frees scratch space created by createRouteScratch().
+* If the pointer is NULL, the function does nothing.
+**/
+void freeRouteScratch(route_scratch_t* scratch);
+/**
+* Makes dijkstra(), dijkstraToMany() and nextReach() record the CSR edge
+* each node was last reached by, so getRoutePath() can rebuild the path.
+* @param scratch Scratch space created by createRouteScratch().
+* @return 1 on success, 0 if memory allocation fails.
+* Scratch space that never calls this does not allocate or write the
+* predecessor array, so plain distance queries cost nothing extra.
+**/
+int enableRoutePaths(route_scratch_t* scratch);
+/**
+* Finds the shortest road distance between two nodes with Dijkstra's algorithm.
+* @param frozen Pointer to the snapshot.
+* @param scratch Scratch space created for the snapshot.
+* @param startId ID of the start node.
+* @param endId ID of the destination node.
+* @return The distance, or -1 if either node is missing or unreachable.
+* The search stops as soon as the destination is settled.
+* Edge weights are assumed to be non-negative.
+* scratch->settled holds the number of nodes settled by the search, and
+* scratch->relaxed the number of edges it relaxed (unless built with NO_STATS).
+**/
+double dijkstra(frozen_graph_t* frozen, route_scratch_t* scratch, int startId, int endId);
+/**
+* Finds the road distances from one node to many with a single search.
+* @param frozen Pointer to the snapshot.
+* @param scratch Scratch space created for the snapshot.
+* @param startIdx Dense index of the start node.
+* @param targets Dense indices of the targets; repeats are allowed and
+* out-of-range entries are reported as unreachable.
+* @param targetCount Number of targets.
+* @param distances Array of targetCount entries that receives each
+* target's distance, or -1 if it is unreachable.
+* @return 1 on success, 0 if the arguments are invalid or memory runs out.
+* Runs dijkstra() from the start until every target is settled (or the
+* reachable part of the graph is exhausted), so a row of a distance
+* matrix costs one search instead of one per target.
+* scratch->settled holds the number of nodes settled by the search.
+**/
+int dijkstraToMany(frozen_graph_t* frozen, route_scratch_t* scratch, int startIdx, const int* targets, int targetCount, double* distances);
+/**
+* Lists the edges of the shortest path the last search found to a node.
+* @param frozen Pointer to the snapshot the search ran on.
+* @param scratch Scratch space, with enableRoutePaths() called before the search.
+* @param endIdx Dense index of the destination, which the search must have settled.
+* @param edges Array with room for nodeCount entries that receives the CSR
+* edge positions from the start to the destination (an edge's weight and
+* road name are frozen->weights[e] and frozen->edgeData[e]).
+* @return Number of edges (0 if the destination is the start), or -1 if
+* the destination was not settled or paths are not being recorded.
+**/
+int getRoutePath(frozen_graph_t* frozen, route_scratch_t* scratch, int endIdx, int* edges);
+/**
+* Starts a one-to-all search from one node.
+* @param frozen Pointer to the snapshot.
+* @param scratch Scratch space created for the snapshot.
+* @param startIdx Dense index of the start node.
+* @return 1 on success, 0 if the arguments are invalid.
+* Call nextReach() to get the reachable nodes one at a time.
+**/
+int startReach(frozen_graph_t* frozen, route_scratch_t* scratch, int startIdx);
+/**
+* Settles the next node of a search started by startReach().
+* @param frozen Pointer to the snapshot.
+* @param scratch Scratch space the search was started with.
+* @param maxDist Largest distance to report.
+* @return Dense index of the node, whose road distance from the start is
+* in scratch->dist[], or -1 once no node within maxDist is left, or -2 if
+* memory runs out. The search is over once -1 is returned.
+* Nodes come out in order of distance, starting with the start itself at
+* 0. The search never looks past the first node beyond maxDist, so its
+* cost depends on the size of the area rather than of the map.
+**/
+int nextReach(frozen_graph_t* frozen, route_scratch_t* scratch, double maxDist);
+/**
+* Finds the shortest road distance between two nodes with a search from
+* each end that meets in the middle.
+* @param frozen Pointer to the snapshot, with addReverseRows() already called.
+* @param scratch Scratch space created for the snapshot.
+* @param startId ID of the start node.
+* @param endId ID of the destination node.
+* @return The same distance as dijkstra(), or -1 if either node is missing
+* or unreachable, the snapshot has no reverse rows, or memory runs out.
+* A forward search from the start over the outgoing rows and a backward
+* search from the destination over the reverse rows share one priority
+* queue (the backward copy of node i is entry nodeCount + i), so the side
+* with the closer frontier always goes next. Every edge relaxed into a node
+* the other side has reached updates the best total; once the smallest key
+* left is at least half of it, no shorter path can exist. Each side only
+* searches about half the radius, which on a road map settles a fraction of
+* the nodes dijkstra() does. Works with either heap kind.
+* The first search doubles the scratch arrays to hold both sides, and
+* scratch->settled counts the nodes settled on both sides.
+**/
+double bidirectionalDijkstra(frozen_graph_t* frozen, route_scratch_t* scratch, int startId, int endId);
+/**
+* Finds the shortest road distance between two nodes with a contraction hierarchy.
+* @param frozen Pointer to the snapshot.
+* @param ch Hierarchy built for the snapshot (see buildContractionHierarchy()).
+* @param scratch Scratch space created for the snapshot.
+* @param startId ID of the start node.
+* @param endId ID of the destination node.
+* @return The same distance as dijkstra(), or -1 if either node is missing
+* or unreachable, or memory runs out.
+* Works like bidirectionalDijkstra(), but the forward search only follows
+* upward edges and the backward search only downward edges into a node,
+* so both climb towards the few most important nodes and each settles a
+* few hundred nodes even on a large map. The search stops once the
+* smallest key left is at least the best total.
+* scratch->settled counts the nodes settled on both sides.
+**/
+double chDijkstra(frozen_graph_t* frozen, const ch_graph_t* ch, route_scratch_t* scratch, int startId, int endId);
+/**
+* Computes how much straight-line distance must be scaled down to never
+* overshoot road distance.
+* @param frozen Pointer to the snapshot.
+* @param coords Coordinates of the snapshot's nodes, by dense index.
+* @param offset Set to the total amount by which edges shorter than 1 m
+* of straight line fall below their scaled straight line.
+* @return The smallest ratio of an edge's weight to the Haversine distance
+* between its ends among edges at least 1 m long, capped at 1, or -1 if
+* some node with outgoing edges has no coordinates (the estimate could
+* not be bounded).
+* Roads are normally at least as long as the straight line, so the scale
+* is just below 1 from rounding in the data (0.9965 for Ames). Only very
+* short edges, where a centimeter of rounding changes the ratio a lot,
+* are left out of it; there are few of them and their total goes into
+* the offset. A path is at least the scaled sum of its edges' straight
+* lines, less the offset for the short edges it uses (each at most once),
+* so by the triangle inequality the scaled straight-line distance minus
+* the offset never exceeds the road distance to the destination, however
+* many edges the path has.
+**/
+double astarScale(frozen_graph_t* frozen, const geo_store_t* coords, double* offset);
+/**
+* Finds the shortest road distance between two nodes with A* search.
+* @param frozen Pointer to the snapshot.
+* @param scratch Scratch space created for the snapshot.
+* @param coords Coordinates of the snapshot's nodes, by dense index.
+* @param scale Value of astarScale() for the snapshot; if not positive,
+* the search is not guided and matches dijkstra() node for node.
+* @param offset The offset astarScale() computed with it.
+* @param startId ID of the start node.
+* @param endId ID of the destination node.
+* @return The same distance as dijkstra(), or -1 if either node is
+* missing or unreachable.
+* Nodes are taken in order of distance so far plus the estimate of the
+* rest: the Haversine distance to the destination times scale, minus
+* offset (0 for nodes without coordinates), so the search heads towards
+* the destination and settles far fewer nodes. The estimate never exceeds the remaining
+* road distance, and a node reached again by a shorter path is searched
+* again, so the result is exact even where rounding makes the estimate
+* inconsistent.
+* Always uses the 4-ary heap, because the radix heap needs keys that
+* never decrease.
+* scratch->settled holds the number of nodes settled by the search.
+**/
+double astar(frozen_graph_t* frozen, route_scratch_t* scratch, const geo_store_t* coords, double scale, double offset, int startId, int endId);
+
+#endif // ROUTE_H
@@ -0,0 +1,349 @@
+#include "spatial.h"
+#include "geo.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define WITHIN_SLACK 1e-9
+
+//Bounded max-heap of the best points found so far by findNearest()
+typedef struct {
+    spatial_hit_t *hits;
+    int count;
+    int k;
+} nearest_t;
+
+/**
+ * Helper function to order hits by distance, then by item.
+ */
+static int compareHits(const void *a, const void *b) {
+    const spatial_hit_t *x = (const spatial_hit_t *)a;
+    const spatial_hit_t *y = (const spatial_hit_t *)b;
+    if (x->key != y->key) {
+        return x->key < y->key ? -1 : 1;
+    }
+    return (x->item > y->item) - (x->item < y->item);
+}
+
+/**
+ * Helper function to turn degrees into a unit vector.
+ */
+static void toUnitVector(double lat, double lon, double v[3]) {
+    double latRad = lat * M_PI / 180.0;
+    double lonRad = lon * M_PI / 180.0;
+    v[0] = cos(latRad) * cos(lonRad);
+    v[1] = cos(latRad) * sin(lonRad);
+    v[2] = sin(latRad);
+}
+
+/**
+ * Helper function to get the squared distance between two unit vectors.
+ */
+static double distSq(const double *a, const double *b) {
+    double dx = a[0] - b[0];
+    double dy = a[1] - b[1];
+    double dz = a[2] - b[2];
+    return dx * dx + dy * dy + dz * dz;
+}
+
+/**
+ * Helper function to swap two tree positions.
+ */
+static void swapPoints(spatial_index_t *index, int a, int b) {
+    double tmp[3];
+    memcpy(tmp, &index->coords[a * 3], sizeof(tmp));
+    memcpy(&index->coords[a * 3], &index->coords[b * 3], sizeof(tmp));
+    memcpy(&index->coords[b * 3], tmp, sizeof(tmp));
+
+    int item = index->items[a];
+    index->items[a] = index->items[b];
+    index->items[b] = item;
+}
+
+/**
+ * Helper function to partially sort [lo, hi) on one axis so that
+ * position k holds the value it would have if the range were sorted.
+ */
+static void selectMedian(spatial_index_t *index, int lo, int hi, int k, int axis) {
+    hi--;
+    while (lo < hi) {
+        double pivot = index->coords[((lo + hi) / 2) * 3 + axis];
+        int i = lo;
+        int j = hi;
+        while (i <= j) {
+            while (index->coords[i * 3 + axis] < pivot) {
+                i++;
+            }
+            while (index->coords[j * 3 + axis] > pivot) {
+                j--;
+            }
+            if (i <= j) {
+                swapPoints(index, i, j);
+                i++;
+                j--;
+            }
+        }
+        if (k <= j) {
+            hi = j;
+        }
+        else if (k >= i) {
+            lo = i;
+        }
+        else {
+            return;
+        }
+    }
+}
+
+/**
+ * Helper function to build the subtree for [lo, hi), splitting on the
+ * axis along which the points are most spread out.
+ */
+static void buildTree(spatial_index_t *index, int lo, int hi) {
+    if (hi - lo <= 0) {
+        return;
+    }
+
+    double min[3] = {2, 2, 2};
+    double max[3] = {-2, -2, -2};
+    for (int i = lo; i < hi; i++) {
+        for (int a = 0; a < 3; a++) {
+            double c = index->coords[i * 3 + a];
+            if (c < min[a]) {
+                min[a] = c;
+            }
+            if (c > max[a]) {
+                max[a] = c;
+            }
+        }
+    }
+
+    int axis = 0;
+    for (int a = 1; a < 3; a++) {
+        if (max[a] - min[a] > max[axis] - min[axis]) {
+            axis = a;
+        }
+    }
+
+    int mid = (lo + hi) / 2;
+    selectMedian(index, lo, hi, mid, axis);
+    index->axes[mid] = (unsigned char)axis;
+    buildTree(index, lo, mid);
+    buildTree(index, mid + 1, hi);
+}
+
+/**
+ * Builds a spatial index over a set of points.
+ */
+spatial_index_t *createSpatialIndex(const double *lats, const double *lons, const int *items, int count) {
+    spatial_index_t *index = (spatial_index_t *)calloc(1, sizeof(spatial_index_t));
+    if (index == NULL) {
+        return NULL;
+    }
+
+    //Allocate at least one element so an empty index still gets valid arrays
+    index->count = count;
+    index->coords = (double *)malloc(sizeof(double) * 3 * (count + 1));
+    index->items = (int *)malloc(sizeof(int) * (count + 1));
+    index->axes = (unsigned char *)malloc(count + 1);
+    if (index->coords == NULL || index->items == NULL || index->axes == NULL) {
+        freeSpatialIndex(index);
+        return NULL;
+    }
+
+    for (int i = 0; i < count; i++) {
+        toUnitVector(lats[i], lons[i], &index->coords[i * 3]);
+        index->items[i] = items[i];
+    }
+    buildTree(index, 0, count);
+    return index;
+}
+
+/**
+ * Frees the spatial index.
+ */
+void freeSpatialIndex(spatial_index_t *index) {
+    if (index == NULL) {
+        return;
+    }
+
+    free(index->coords);
+    free(index->items);
+    free(index->axes);
+    free(index);
+}
+
+/**
+ * Helper function to move a heap entry down until no child is larger.
+ */
+static void nearestSiftDown(nearest_t *best, int pos) {
+    spatial_hit_t hit = best->hits[pos];
+    while (1) {
+        int child = pos * 2 + 1;
+        if (child >= best->count) {
+            break;
+        }
+        if (child + 1 < best->count && compareHits(&best->hits[child + 1], &best->hits[child]) > 0) {
+            child++;
+        }
+        if (compareHits(&best->hits[child], &hit) <= 0) {
+            break;
+        }
+        best->hits[pos] = best->hits[child];
+        pos = child;
+    }
+    best->hits[pos] = hit;
+}
+
+/**
+ * Helper function to keep a point if it is among the k closest so far.
+ */
+static void offerNearest(nearest_t *best, double key, int item) {
+    spatial_hit_t hit = {item, key};
+
+    if (best->count < best->k) {
+        int pos = best->count++;
+        while (pos > 0) {
+            int parent = (pos - 1) / 2;
+            if (compareHits(&best->hits[parent], &hit) >= 0) {
+                break;
+            }
+            best->hits[pos] = best->hits[parent];
+            pos = parent;
+        }
+        best->hits[pos] = hit;
+    }
+    else if (compareHits(&hit, &best->hits[0]) < 0) {
+        best->hits[0] = hit;
+        nearestSiftDown(best, 0);
+    }
+}
+
+/**
+ * Helper function to search the subtree for [lo, hi), visiting the side
+ * of the split the query is on first and the other side only if it can
+ * still hold a closer point.
+ */
+static void searchNearest(spatial_index_t *index, int lo, int hi, const double *q, nearest_t *best) {
+    if (hi - lo <= 0) {
+        return;
+    }
+
+    int mid = (lo + hi) / 2;
+    const double *p = &index->coords[mid * 3];
+    offerNearest(best, distSq(q, p), index->items[mid]);
+
+    int axis = index->axes[mid];
+    double diff = q[axis] - p[axis];
+    if (diff < 0) {
+        searchNearest(index, lo, mid, q, best);
+        if (best->count < best->k || diff * diff <= best->hits[0].key) {
+            searchNearest(index, mid + 1, hi, q, best);
+        }
+    }
+    else {
+        searchNearest(index, mid + 1, hi, q, best);
+        if (best->count < best->k || diff * diff <= best->hits[0].key) {
+            searchNearest(index, lo, mid, q, best);
+        }
+    }
+}
+
+/**
+ * Finds the k points closest to a location.
+ */
+int findNearest(spatial_index_t *index, double lat, double lon, int k, spatial_hit_t *hits) {
+    double q[3];
+    nearest_t best;
+
+    if (index == NULL || hits == NULL || k <= 0) {
+        return 0;
+    }
+
+    toUnitVector(lat, lon, q);
+    best.hits = hits;
+    best.count = 0;
+    best.k = k;
+    searchNearest(index, 0, index->count, q, &best);
+
+    qsort(hits, best.count, sizeof(spatial_hit_t), compareHits);
+    return best.count;
+}
+
+/**
+ * Helper function to append a hit to a growable array.
+ * @return 1 on success, 0 if memory allocation fails.
+ */
+static int appendHit(spatial_hit_t **hits, int *count, int *space, double key, int item) {
+    if (*count == *space) {
+        int newSpace = *space == 0 ? 16 : *space * 2;
+        spatial_hit_t *newHits = (spatial_hit_t *)realloc(*hits, sizeof(spatial_hit_t) * newSpace);
+        if (newHits == NULL) {
+            return 0;
+        }
+        *hits = newHits;
+        *space = newSpace;
+    }
+    (*hits)[*count].item = item;
+    (*hits)[*count].key = key;
+    (*count)++;
+    return 1;
+}
+
+/**
+ * Helper function to collect every point of the subtree for [lo, hi)
+ * whose squared chord is at most limit.
+ * @return 1 on success, 0 if memory allocation fails.
+ */
+static int searchWithin(spatial_index_t *index, int lo, int hi, const double *q, double limit,
+                        spatial_hit_t **hits, int *count, int *space) {
+    if (hi - lo <= 0) {
+        return 1;
+    }
+
+    int mid = (lo + hi) / 2;
+    const double *p = &index->coords[mid * 3];
+    double key = distSq(q, p);
+    if (key <= limit && !appendHit(hits, count, space, key, index->items[mid])) {
+        return 0;
+    }
+
+    int axis = index->axes[mid];
+    double diff = q[axis] - p[axis];
+    if ((diff <= 0 || diff * diff <= limit) && !searchWithin(index, lo, mid, q, limit, hits, count, space)) {
+        return 0;
+    }
+    if ((diff >= 0 || diff * diff <= limit) && !searchWithin(index, mid + 1, hi, q, limit, hits, count, space)) {
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Finds every point within a distance of a location.
+ */
+spatial_hit_t *findWithin(spatial_index_t *index, double lat, double lon, double meters, int *count) {
+    double q[3];
+    spatial_hit_t *hits = NULL;
+    int space = 0;
+
+    *count = 0;
+    if (index == NULL || meters < 0) {
+        return NULL;
+    }
+
+    //Chord subtending the radius; half the globe or more takes everything
+    double angle = meters / EARTH_RADIUS;
+    double chord = angle >= M_PI ? 2.0 : 2.0 * sin(angle / 2.0);
+    double limit = chord * chord * (1.0 + WITHIN_SLACK) + WITHIN_SLACK * WITHIN_SLACK;
+
+    toUnitVector(lat, lon, q);
+    if (!searchWithin(index, 0, index->count, q, limit, &hits, count, &space)) {
+        free(hits);
+        *count = 0;
+        return NULL;
+    }
+
+    qsort(hits, *count, sizeof(spatial_hit_t), compareHits);
+    return hits;
+}
@@ -0,0 +1,66 @@
+#ifndef SPATIAL_H
+#define SPATIAL_H
+
+//One point found by a spatial query; key is the squared chord length
+//on the unit sphere, which sorts the same way as surface distance
+typedef struct {
+    int item;
+    double key;
+} spatial_hit_t;
+
+//Static k-d tree over points on the Earth's surface
+typedef struct {
+    int count;
+    double *coords;
+    int *items;
+    unsigned char *axes;
+} spatial_index_t;
+
+/**
+* Builds a spatial index over a set of points.
+* @param lats Latitudes in degrees.
+* @param lons Longitudes in degrees.
+* @param items Number stored with each point and returned by queries
+* (e.g. a dense node index).
+* @param count Number of points.
+* @return Pointer to the index, or NULL if memory allocation fails.
+* Points are stored as unit vectors (x, y, z) in a balanced k-d tree laid
+* out implicitly in one array: the median of a range is its root and the
+* halves on either side are its subtrees. Straight-line (chord) distance
+* between unit vectors grows with great-circle distance, so the nearest
+* point in the tree is also the nearest along the surface, anywhere on
+* the globe.
+**/
+spatial_index_t* createSpatialIndex(const double* lats, const double* lons, const int* items, int count);
+/**
+* Frees the spatial index.
+* If the pointer is NULL, the function does nothing.
+**/
+void freeSpatialIndex(spatial_index_t* index);
+/**
+* Finds the k points closest to a location.
+* @param index Pointer to the spatial index.
+* @param lat Latitude in degrees.
+* @param lon Longitude in degrees.
+* @param k Number of points wanted.
+* @param hits Array of at least k entries that receives the points.
+* @return Number of points found (k, or fewer if the index is smaller),
+* sorted by distance and then by item.
+**/
+int findNearest(spatial_index_t* index, double lat, double lon, int k, spatial_hit_t* hits);
+/**
+* Finds every point within a distance of a location.
+* @param index Pointer to the spatial index.
+* @param lat Latitude in degrees.
+* @param lon Longitude in degrees.
+* @param meters Great-circle radius in meters.
+* @param count Set to the number of points returned.
+* @return Array of the points sorted by distance and then by item, which
+* the caller must free, or NULL if none were found or memory ran out.
+* The radius is widened by a few parts per billion so points on the
+* boundary are never lost to rounding; callers that need an exact cut-off
+* should recheck the distance of the last few hits.
+**/
+spatial_hit_t* findWithin(spatial_index_t* index, double lat, double lon, double meters, int* count);
+
+#endif // SPATIAL_H
@@ -0,0 +1,176 @@
+#include "stats.h"
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#define INITIAL_LATENCIES 64
+
+//Names printed for each load phase, in stats_phase_t order
+static const char *phaseNames[STATS_PHASES] = {
+    "open",
+    "validate + parse",
+    "node insert",
+    "edge insert",
+    "snapshot",
+    "name index"
+};
+
+/**
+ * Creates an empty set of statistics.
+ */
+run_stats_t *createStats() {
+    return (run_stats_t *)calloc(1, sizeof(run_stats_t));
+}
+
+/**
+ * Frees statistics created by createStats().
+ */
+void freeStats(run_stats_t *stats) {
+    if (stats == NULL) {
+        return;
+    }
+    free(stats->latencies);
+    free(stats);
+}
+
+/**
+ * Reads the monotonic clock.
+ */
+double statsClock() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Adds the time since a mark to a load phase.
+ */
+double lapStats(run_stats_t *stats, stats_phase_t phase, double since) {
+    double now = statsClock();
+
+    stats->phaseSeconds[phase] += now - since;
+    return now;
+}
+
+/**
+ * Helper function to store one latency, doubling the array when full.
+ * @return 1 on success, 0 if memory allocation fails.
+ */
+static int addLatency(run_stats_t *stats, double seconds) {
+    if (stats->latencyCount == stats->latencySpace) {
+        long space = stats->latencySpace > 0 ? stats->latencySpace * 2 : INITIAL_LATENCIES;
+        double *bigger = (double *)realloc(stats->latencies, sizeof(double) * space);
+        if (bigger == NULL) {
+            return 0;
+        }
+        stats->latencies = bigger;
+        stats->latencySpace = space;
+    }
+    stats->latencies[stats->latencyCount++] = seconds;
+    return 1;
+}
+
+/**
+ * Records one shortest-path query.
+ */
+void recordQuery(run_stats_t *stats, double seconds, int settled, int relaxed, int found) {
+    stats->queries++;
+    if (!found) {
+        stats->notFound++;
+    }
+    stats->settled += settled;
+    stats->relaxed += relaxed;
+    if (settled > stats->maxSettled) {
+        stats->maxSettled = settled;
+    }
+    if (relaxed > stats->maxRelaxed) {
+        stats->maxRelaxed = relaxed;
+    }
+    stats->querySeconds += seconds;
+    addLatency(stats, seconds);
+}
+
+/**
+ * Adds the counts and latencies of one set of statistics to another.
+ */
+void mergeStats(run_stats_t *stats, const run_stats_t *other) {
+    for (int i = 0; i < STATS_PHASES; i++) {
+        stats->phaseSeconds[i] += other->phaseSeconds[i];
+    }
+    stats->findCalls += other->findCalls;
+    stats->findProbes += other->findProbes;
+    stats->queries += other->queries;
+    stats->notFound += other->notFound;
+    stats->settled += other->settled;
+    stats->relaxed += other->relaxed;
+    if (other->maxSettled > stats->maxSettled) {
+        stats->maxSettled = other->maxSettled;
+    }
+    if (other->maxRelaxed > stats->maxRelaxed) {
+        stats->maxRelaxed = other->maxRelaxed;
+    }
+    stats->querySeconds += other->querySeconds;
+    for (long i = 0; i < other->latencyCount; i++) {
+        if (!addLatency(stats, other->latencies[i])) {
+            break;
+        }
+    }
+}
+
+/**
+ * Helper function to order latencies for qsort().
+ */
+static int compareSeconds(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+/**
+ * Helper function to pick a percentile of sorted latencies (nearest rank).
+ */
+static double percentile(const double *sorted, long count, double p) {
+    long rank = (long)ceil(p * count);
+
+    if (rank < 1) {
+        rank = 1;
+    }
+    return sorted[rank - 1];
+}
+
+/**
+ * Prints a summary of the statistics.
+ */
+void printStats(run_stats_t *stats, FILE *out) {
+    double loadSeconds = 0;
+
+    fprintf(out, "Stats:\n");
+    for (int i = 0; i < STATS_PHASES; i++) {
+        loadSeconds += stats->phaseSeconds[i];
+    }
+    for (int i = 0; i < STATS_PHASES; i++) {
+        fprintf(out, "  load %-17s %10.3f ms\n", phaseNames[i], stats->phaseSeconds[i] * 1e3);
+    }
+    fprintf(out, "  load %-17s %10.3f ms\n", "total", loadSeconds * 1e3);
+
+    fprintf(out, "  findNode calls       %10ld (%.2f probes per call)\n", stats->findCalls,
+            stats->findCalls > 0 ? (double)stats->findProbes / stats->findCalls : 0.0);
+
+    fprintf(out, "  queries              %10ld (%ld without a path)\n", stats->queries, stats->notFound);
+    if (stats->queries == 0) {
+        return;
+    }
+    fprintf(out, "  settled per query    %10.1f mean, %d max\n", (double)stats->settled / stats->queries, stats->maxSettled);
+    fprintf(out, "  relaxed per query    %10.1f mean, %d max\n", (double)stats->relaxed / stats->queries, stats->maxRelaxed);
+    fprintf(out, "  query time           %10.3f ms total, %.3f ms mean\n", stats->querySeconds * 1e3,
+            stats->querySeconds * 1e3 / stats->queries);
+    if (stats->latencyCount > 0) {
+        qsort(stats->latencies, stats->latencyCount, sizeof(double), compareSeconds);
+        fprintf(out, "  query latency        %10.3f ms median, %.3f ms p99, %.3f ms max\n",
+                percentile(stats->latencies, stats->latencyCount, 0.5) * 1e3,
+                percentile(stats->latencies, stats->latencyCount, 0.99) * 1e3,
+                stats->latencies[stats->latencyCount - 1] * 1e3);
+    }
+}
@@ -0,0 +1,104 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+
+//Counter updates in the hot paths go through STAT_ADD, and everything
+//else is guarded by STATS_ON, so building with -DNO_STATS compiles all
+//of it out; the counter fields stay so struct layouts never change.
+#ifdef NO_STATS
+#define STAT_ADD(counter, amount) ((void)0)
+#define STATS_ON(stats) 0
+#define STATS_LAP(stats, phase, mark) ((void)0)
+#else
+#define STAT_ADD(counter, amount) ((counter) += (amount))
+//True if stats is being collected
+#define STATS_ON(stats) ((stats) != NULL)
+//Adds the time since mark to a phase and moves mark to now
+#define STATS_LAP(stats, phase, mark) \
+    do { \
+        if ((stats) != NULL) { \
+            (mark) = lapStats((stats), (phase), (mark)); \
+        } \
+    } while (0)
+#endif
+
+//Load phases timed by -stats. Lines are validated while they are parsed,
+//so STATS_READ covers both.
+typedef enum {
+    STATS_OPEN,
+    STATS_READ,
+    STATS_NODES,
+    STATS_EDGES,
+    STATS_SNAPSHOT,
+    STATS_NAME_INDEX,
+    STATS_PHASES
+} stats_phase_t;
+
+//Everything -stats reports for one run
+typedef struct {
+    double phaseSeconds[STATS_PHASES];
+    long findCalls;
+    long findProbes;
+    long queries;
+    long notFound;
+    long settled;
+    long relaxed;
+    int maxSettled;
+    int maxRelaxed;
+    double querySeconds;
+    double *latencies;
+    long latencyCount;
+    long latencySpace;
+} run_stats_t;
+
+/**
+* Creates an empty set of statistics.
+* @return Pointer to the statistics, or NULL if memory allocation fails.
+**/
+run_stats_t* createStats();
+/**
+* Frees statistics created by createStats().
+* If the pointer is NULL, the function does nothing.
+**/
+void freeStats(run_stats_t* stats);
+/**
+* Reads the monotonic clock.
+* @return Seconds since an arbitrary fixed point.
+**/
+double statsClock();
+/**
+* Adds the time since a mark to a load phase.
+* @param stats Pointer to the statistics.
+* @param phase Phase the time was spent in.
+* @param since Value of statsClock() when the phase started.
+* @return The current statsClock(), to mark the start of the next phase.
+**/
+double lapStats(run_stats_t* stats, stats_phase_t phase, double since);
+/**
+* Records one shortest-path query.
+* @param stats Pointer to the statistics.
+* @param seconds Wall time of the query, including the name lookups.
+* @param settled Nodes the search settled.
+* @param relaxed Edges the search relaxed.
+* @param found 1 if a path was found, 0 otherwise.
+* A latency that cannot be stored for lack of memory is still counted
+* in the totals, but left out of the percentiles.
+**/
+void recordQuery(run_stats_t* stats, double seconds, int settled, int relaxed, int found);
+/**
+* Adds the counts and latencies of one set of statistics to another.
+* @param stats Pointer to the statistics to add to.
+* @param other Pointer to the statistics to add.
+**/
+void mergeStats(run_stats_t* stats, const run_stats_t* other);
+/**
+* Prints a summary: time per load phase, findNode() probes per call,
+* and the count, latency percentiles, settled nodes and relaxed edges
+* of the queries.
+* @param stats Pointer to the statistics.
+* @param out Stream to print to.
+**/
+void printStats(run_stats_t* stats, FILE* out);
+
+#endif // STATS_H
@@ -36,8 +36,187 @@ void freeCustomGraphData(graph_t *graph) {
     }
 }
 
+/**
+ * Helper function to print one check's result, as tests/run.sh does.
+ * Returns ok, so callers can count failures.
+ */
+static int report(const char *name, int ok) {
+    printf("%s %s\n", ok ? "ok  " : "FAIL", name);
+    return ok;
+}
+
+/**
+ * Helper function to check that a node's outgoing edges are exactly the
+ * given destinations, in adjacency-list order (newest first), and that
+ * each is also in its destination's incoming list.
+ */
+static int edgesAre(graph_t *graph, int id, const int *toIds, int count) {
+    node_t *node = getNode(graph, id);
+    if (node == NULL) {
+        return 0;
+    }
+    int i = 0;
+    for (edge_t *edge = node->edges; edge != NULL; edge = edge->next) {
+        if (i == count || edge->toNode->id != toIds[i++] || edge->fromNode != node) {
+            return 0;
+        }
+        if (graph->reverseEdges) {
+            edge_t *in = edge->toNode->inEdges;
+            while (in != NULL && in != edge) {
+                in = in->nextIn;
+            }
+            if (in == NULL) {
+                return 0;
+            }
+        }
+    }
+    return i == count;
+}
+
+/**
+ * Helper function to check that every live slot holds a node the index
+ * finds at that slot, and that nodeCount and removedCount agree.
+ */
+static int slotsConsistent(graph_t *graph) {
+    int live = 0;
+    for (int i = 0; i < graph->nodeCount; i++) {
+        if (graph->nodes[i] != NULL) {
+            live++;
+            if (getNodeSlot(graph, graph->nodes[i]->id) != i) {
+                return 0;
+            }
+        }
+    }
+    return live == graph->nodeCount - graph->removedCount;
+}
+
+/**
+ * Runs the behavioral checks of node removal and compaction, printing one
+ * line per check. Returns the number of failed checks.
+ */
+static int runChecks(void) {
+    int passed = 0;
+    int total = 0;
+
+    // Removing a node and adding its ID back: the old slot stays empty and
+    // the new node starts without the old node's edges
+    graph_t *graph = createGraph();
+    for (int id = 1; id <= 5; id++) {
+        addNode(graph, id, NULL);
+    }
+    addEdge(graph, 1, 3, 1.0f, NULL);
+    addEdge(graph, 3, 4, 2.0f, NULL);
+    addEdge(graph, 2, 4, 3.0f, NULL);
+    int removed = removeNode(graph, 3);
+    total++;
+    passed += report("removeNode drops the node and its edges",
+                     removed == 1 && getNode(graph, 3) == NULL && getEdge(graph, 1, 3) == NULL &&
+                     getEdge(graph, 3, 4) == NULL && graph->edgeCount == 1 && removeNode(graph, 3) == 0);
+    total++;
+    passed += report("removeNode leaves a tombstone and enables reverse edges",
+                     graph->nodes[2] == NULL && graph->removedCount == 1 && graph->nodeCount == 5 &&
+                     graph->reverseEdges && slotsConsistent(graph));
+    node_t *again = addNode(graph, 3, NULL);
+    addEdge(graph, 3, 1, 4.0f, NULL);
+    int fromNew[] = {1};
+    int fromTwo[] = {4};
+    total++;
+    passed += report("re-adding a removed ID appends a fresh node",
+                     again != NULL && getNode(graph, 3) == again && getNodeSlot(graph, 3) == 5 &&
+                     graph->nodes[2] == NULL && again->inEdges == NULL && edgesAre(graph, 3, fromNew, 1) &&
+                     edgesAre(graph, 2, fromTwo, 1) && getEdge(graph, 1, 3) == NULL && slotsConsistent(graph));
+    freeGraph(graph);
+
+    // Lookups after backward-shift deletion: at half load the index has
+    // runs of neighboring buckets, and deleting from the middle of a run
+    // must not hide the IDs probed past it
+    graph = createGraph();
+    int count = 2000;
+    for (int i = 0; i < count; i++) {
+        addNode(graph, i * 7919, NULL);
+    }
+    int found = 1;
+    for (int i = 0; i < count; i += 3) {
+        removeNode(graph, i * 7919);
+    }
+    for (int i = 0; i < count; i++) {
+        node_t *node = getNode(graph, i * 7919);
+        if (i % 3 == 0 ? node != NULL : (node == NULL || node->id != i * 7919 || graph->nodes[i] != node)) {
+            found = 0;
+        }
+    }
+    total++;
+    passed += report("IDs are found after backward-shift deletes", found && slotsConsistent(graph));
+    for (int i = 0; i < count; i += 3) {
+        addNode(graph, i * 7919, NULL);
+    }
+    found = 1;
+    for (int i = 0; i < count; i++) {
+        if (getNode(graph, i * 7919) == NULL) {
+            found = 0;
+        }
+    }
+    total++;
+    passed += report("deleted IDs can be added and found again", found && graph->nodeCount == count + (count + 2) / 3);
+    freeGraph(graph);
+
+    // Edge lists after removeNodes() and compactGraph(): the survivors keep
+    // their edges and order, and the snapshot is unchanged by compaction
+    graph = createGraph();
+    for (int id = 10; id <= 60; id += 10) {
+        addNode(graph, id, NULL);
+    }
+    addEdge(graph, 10, 20, 1.0f, NULL);
+    addEdge(graph, 10, 30, 2.0f, NULL);
+    addEdge(graph, 10, 40, 3.0f, NULL);
+    addEdge(graph, 20, 30, 4.0f, NULL);
+    addEdge(graph, 30, 60, 5.0f, NULL);
+    addEdge(graph, 50, 10, 6.0f, NULL);
+    addEdge(graph, 60, 50, 7.0f, NULL);
+    int gone[] = {30, 40, 30, 99};
+    removed = removeNodes(graph, gone, 4);
+    frozen_graph_t *before = freezeGraph(graph);
+    int slotsBefore = graph->nodeCount;
+    int reclaimed = compactGraph(graph);
+    frozen_graph_t *after = freezeGraph(graph);
+    int fromTen[] = {20};
+    int none[] = {0};
+    int fromFifty[] = {10};
+    int fromSixty[] = {50};
+    total++;
+    passed += report("removeNodes drops edges to and from the removed nodes",
+                     removed == 2 && graph->edgeCount == 3 && edgesAre(graph, 10, fromTen, 1) &&
+                     edgesAre(graph, 20, none, 0) && edgesAre(graph, 50, fromFifty, 1) &&
+                     edgesAre(graph, 60, fromSixty, 1));
+    total++;
+    passed += report("compactGraph moves the survivors down in order",
+                     reclaimed == 2 && slotsBefore == 6 && graph->nodeCount == 4 && graph->removedCount == 0 &&
+                     graph->nodes[0]->id == 10 && graph->nodes[1]->id == 20 && graph->nodes[2]->id == 50 &&
+                     graph->nodes[3]->id == 60 && slotsConsistent(graph) && getNode(graph, 30) == NULL);
+    int same = before != NULL && after != NULL && before->nodeCount == 4 && after->nodeCount == 4 &&
+               before->edgeCount == after->edgeCount;
+    for (int i = 0; same && i < after->nodeCount; i++) {
+        same = before->ids[i] == after->ids[i] && before->rowOffsets[i + 1] == after->rowOffsets[i + 1] &&
+               getFrozenIndex(before, after->ids[i]) == i;
+    }
+    for (int e = 0; same && e < after->edgeCount; e++) {
+        same = before->colIndices[e] == after->colIndices[e] && before->weights[e] == after->weights[e];
+    }
+    total++;
+    passed += report("freezeGraph gives the same snapshot before and after compaction", same);
+    freeFrozenGraph(before);
+    freeFrozenGraph(after);
+    freeGraph(graph);
+
+    return total - passed;
+}
+
+int main(int argc, char *argv[]) {
+    // testgraph -check runs the built-in checks instead of reading stdin
+    if (argc > 1 && strcmp(argv[1], "-check") == 0) {
+        return runChecks() == 0 ? 0 : 1;
+    }
 
-int main() {
     graph_t *graph = createGraph();
     if (graph == NULL) {
         fprintf(stderr, "Failed to create graph\n");
@@ -0,0 +1,56 @@
+#!/bin/sh
+# Regression checks for testgraph and citydata, run by 'make test' from
+# the directory holding the makefile. Prints one line per check and
+# exits with 1 if any failed.
+
+failed=0
+
+# check <name> <expected> <actual>
+check() {
+    if [ "$2" = "$3" ]; then
+        echo "ok   $1"
+    else
+        echo "FAIL $1"
+        echo "     expected: $2"
+        echo "     got:      $3"
+        failed=1
+    fi
+}
+
+# Node removal, re-adding, index deletes and compaction (prints its own lines)
+./testgraph -check || failed=1
+
+# A POI with a nan longitude passes validation; the hull engine must skip it
+# (as the exact scan does) instead of overrunning its buffers
+check "diameter with a nan POI" \
+    "$(./citydata -f tests/nan_poi.tsv -exact -diameter 2>&1)" \
+    "$(./citydata -f tests/nan_poi.tsv -diameter 2>&1)"
+
+# roaddist Alpha Delta, then the delta file, then roaddist Alpha Delta again, in
+# -serve so errors come back in order; extra options select the search
+deltaRun() {
+    printf 'roaddist\tAlpha\tDelta\ndelta\ttests/%s.delta\nroaddist\tAlpha\tDelta\n' "$1" |
+        ./citydata -f tests/delta_city.tsv $2 -serve 2>&1 | tr '\n' '|'
+}
+
+for search in "" -astar -bidir -ch; do
+    # A file that fails to parse on its last line changes nothing
+    check "malformed delta changes nothing (${search:-dijkstra})" \
+        "250.000|Error: Invalid delta at line 4 of tests/malformed.delta (0 earlier changes applied)|250.000|" \
+        "$(deltaRun malformed "$search")"
+    # A road to a node the graph does not have yet creates it, and routes use it
+    check "add-road to a new destination (${search:-dijkstra})" \
+        "250.000|Applied 2 changes|50.000|" \
+        "$(deltaRun new_destination "$search")"
+    # A removed road is closed in the snapshot in place (its weight set to INFINITY)
+    check "remove-road closes the road (${search:-dijkstra})" \
+        "250.000|Applied 1 changes|300.000|" \
+        "$(deltaRun close_road "$search")"
+    # An infinite length is not a valid reweight; closing a road is remove-road
+    check "reweight-road to inf is rejected (${search:-dijkstra})" \
+        "250.000|Error: Invalid delta at line 1 of tests/reweight_inf.delta (0 earlier changes applied)|250.000|" \
+        "$(deltaRun reweight_inf "$search")"
+done
+rm -f tests/delta_city.tsv.ch
+
+exit $failed